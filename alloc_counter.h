@@ -0,0 +1,91 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_ALLOC_COUNTER_H
+#define TCODE_ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// 统计每个线程调用operator new的次数，用来检查渲染热路径里没有堆分配。
+// 计数需要替换全局的operator new，只能在一个.cpp文件里进行：在包含本文件之前定义TCODE_COUNT_ALLOCATIONS。
+// 没有替换时计数始终为0。普通和对齐（alignas超过16字节的类型、AlignedFloats、Arena）的版本都计数
+inline thread_local uint64_t threadAllocationCount = 0;
+
+inline uint64_t ThreadAllocationCount() { return threadAllocationCount; }
+
+#ifdef TCODE_COUNT_ALLOCATIONS
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#if defined(__GNUC__)
+#define TCODE_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define TCODE_NOINLINE __declspec(noinline)
+#else
+#define TCODE_NOINLINE
+#endif
+
+inline void *CountedAllocate(size_t size, size_t alignment) {
+    threadAllocationCount++;
+    if (size == 0)
+        size = 1;
+    void *p;
+#ifdef _WIN32
+    p = alignment > alignof(std::max_align_t) ? _aligned_malloc(size, alignment) : std::malloc(size);
+#else
+    if (alignment <= alignof(std::max_align_t))
+        p = std::malloc(size);
+    else if (posix_memalign(&p, alignment, size) != 0)
+        p = nullptr;
+#endif
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+// 释放不内联：否则GCC在调用处看到operator new的指针交给free，会报-Wmismatched-new-delete
+TCODE_NOINLINE inline void CountedFree(void *p, size_t alignment) noexcept {
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void) alignment;
+#endif
+    std::free(p);
+}
+
+void *operator new(size_t size) { return CountedAllocate(size, 0); }
+
+void *operator new[](size_t size) { return CountedAllocate(size, 0); }
+
+void *operator new(size_t size, std::align_val_t align) { return CountedAllocate(size, size_t(align)); }
+
+void *operator new[](size_t size, std::align_val_t align) { return CountedAllocate(size, size_t(align)); }
+
+void operator delete(void *p) noexcept { CountedFree(p, 0); }
+
+void operator delete[](void *p) noexcept { CountedFree(p, 0); }
+
+void operator delete(void *p, size_t) noexcept { CountedFree(p, 0); }
+
+void operator delete[](void *p, size_t) noexcept { CountedFree(p, 0); }
+
+void operator delete(void *p, std::align_val_t align) noexcept { CountedFree(p, size_t(align)); }
+
+void operator delete[](void *p, std::align_val_t align) noexcept { CountedFree(p, size_t(align)); }
+
+void operator delete(void *p, size_t, std::align_val_t align) noexcept { CountedFree(p, size_t(align)); }
+
+void operator delete[](void *p, size_t, std::align_val_t align) noexcept { CountedFree(p, size_t(align)); }
+
+#endif // TCODE_COUNT_ALLOCATIONS
+
+#endif //TCODE_ALLOC_COUNTER_H
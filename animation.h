@@ -0,0 +1,197 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_ANIMATION_H
+#define TCODE_ANIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "scene.h"
+#include "scene_file.h"
+
+struct Keyframe {
+    float time;         // 第几帧，可以是小数
+    Vec3 value;
+};
+
+// 一个三维量（位置）的关键帧，按时间排序，之间线性插值，超出两端时取端点的值
+class KeyframeTrack {
+public:
+    void add(float time, const Vec3 &value) {
+        auto it = std::upper_bound(keys.begin(), keys.end(), time,
+                                   [](float t, const Keyframe &k) { return t < k.time; });
+        keys.insert(it, {time, value});
+    }
+
+    bool empty() const { return keys.empty(); }
+
+    Vec3 at(float time) const {
+        if (time <= keys.front().time)
+            return keys.front().value;
+        if (time >= keys.back().time)
+            return keys.back().value;
+        auto it = std::upper_bound(keys.begin(), keys.end(), time,
+                                   [](float t, const Keyframe &k) { return t < k.time; });
+        const Keyframe &a = it[-1], &b = it[0];
+        float f = (time - a.time) / (b.time - a.time);
+        return a.value + (b.value - a.value) * f;
+    }
+
+private:
+    std::vector<Keyframe> keys;
+};
+
+// 帧序列：相机、球和光源的位置关键帧，另外可以让所有球和光源绕一根竖直轴匀速转动（转台）。
+// 平面和网格不动。apply把场景摆到某一帧，之后调用scene.update()更新BVH
+class Animation {
+public:
+    int frames = 1;
+
+    // 记下场景中各物体的初始位置（没有关键帧的物体停在这里），场景加载完之后调用一次
+    void bind(const Scene &scene) {
+        restCamera = scene.camera;
+        restSpheres.resize(scene.objects.spheres.size());
+        for (size_t i = 0; i < restSpheres.size(); i++)
+            restSpheres[i] = scene.objects.spheres[i].getCenter();
+        restLights.resize(scene.lights.size());
+        for (size_t i = 0; i < restLights.size(); i++)
+            restLights[i] = scene.lights[i]->position;
+        sphereTracks.assign(restSpheres.size(), nullptr);
+        lightTracks.assign(restLights.size(), nullptr);
+        for (const Track &track: tracks) {  // bind之后tracks不再增删，指针一直有效
+            if (track.kind == SphereTrack && track.index < sphereTracks.size())
+                sphereTracks[track.index] = &track.keys;
+            else if (track.kind == LightTrack && track.index < lightTracks.size())
+                lightTracks[track.index] = &track.keys;
+        }
+    }
+
+    KeyframeTrack &cameraTrack() { return camera; }
+
+    KeyframeTrack &sphereTrack(uint32_t index) { return track(SphereTrack, index); }
+
+    KeyframeTrack &lightTrack(uint32_t index) { return track(LightTrack, index); }
+
+    // 球和光源在整个序列中绕过center的竖直轴转turns圈，最后一帧的下一帧回到第一帧
+    void setSpin(const Vec3 &center, float turns) {
+        spinCenter = center;
+        spinTurns = turns;
+    }
+
+    // 把场景摆到第frame帧：移动相机、球和光源。不分配内存，之后需要调用scene.update()
+    void apply(Scene &scene, float frame) const {
+        float angle = float(2 * M_PI) * spinTurns * frame / float(std::max(frames, 1));
+        float c = cosf(angle), s = sinf(angle);
+        auto spin = [&](const Vec3 &p) {
+            if (spinTurns == 0)
+                return p;
+            Vec3 d = p - spinCenter;
+            return spinCenter + Vec3(c * d[0] + s * d[2], d[1], -s * d[0] + c * d[2]);
+        };
+        scene.camera = camera.empty() ? restCamera : camera.at(frame);
+        for (size_t i = 0; i < restSpheres.size(); i++) {
+            const KeyframeTrack *keys = sphereTracks[i];
+            scene.objects.spheres[i].setCenter(spin(keys != nullptr ? keys->at(frame) : restSpheres[i]));
+        }
+        for (size_t i = 0; i < restLights.size(); i++) {
+            const KeyframeTrack *keys = lightTracks[i];
+            scene.lights[i]->position = spin(keys != nullptr ? keys->at(frame) : restLights[i]);
+        }
+    }
+
+private:
+    enum TrackKind {
+        SphereTrack, LightTrack
+    };
+
+    struct Track {
+        TrackKind kind;
+        uint32_t index;
+        KeyframeTrack keys;
+    };
+
+    KeyframeTrack camera;
+    std::vector<Track> tracks;
+    Vec3 spinCenter = Vec3(0, 0, 0);
+    float spinTurns = 0;
+    Vec3 restCamera = Vec3(0, 0, 0);
+    std::vector<Vec3> restSpheres, restLights;
+    std::vector<const KeyframeTrack *> sphereTracks, lightTracks;       // 每个球、光源的关键帧，没有为nullptr
+
+    KeyframeTrack &track(TrackKind kind, uint32_t index) {
+        for (Track &t: tracks) {
+            if (t.kind == kind && t.index == index)
+                return t.keys;
+        }
+        tracks.push_back({kind, index, KeyframeTrack()});
+        return tracks.back().keys;
+    }
+};
+
+// 动画文件，每行一条，#之后是注释：
+//   frames N                         帧数
+//   camera frame  x y z              相机位置的关键帧
+//   sphere index  frame  x y z       第index个球（按加入场景的顺序，从0开始）球心的关键帧
+//   light  index  frame  x y z       第index个光源中心的关键帧
+//   spin   x y z  turns              球和光源绕过(x, y, z)的竖直轴转turns圈（转台）
+// 数值必须是有限数（strtof也接受nan、inf）。读完之后按场景绑定，下标超出场景的物体数时报错
+inline bool LoadAnimation(const char *path, const Scene &scene, Animation &animation) {
+    std::string text;
+    if (!ReadWholeFile(path, text)) {
+        fprintf(stderr, "%s: unable to read animation file\n", path);
+        return false;
+    }
+    std::string keyword;
+    int lineNumber = 0;
+    text.push_back('\n');
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = text.find('\n', begin);
+        text[end] = '\0';
+        SceneLine line(&text[begin]);
+        begin = end + 1;
+        lineNumber++;
+        if (!line.word(keyword))
+            continue;
+        bool ok = true;
+        Vec3 a;
+        float f, time;
+        if (keyword == "frames") {
+            ok = line.number(f) && f >= 1 && std::isfinite(f);
+            animation.frames = ok ? int(f) : 1;
+        } else if (keyword == "camera") {
+            ok = line.number(time) && line.vec(a) && std::isfinite(time) && IsFinite(a);
+            if (ok)
+                animation.cameraTrack().add(time, a);
+        } else if (keyword == "sphere" || keyword == "light") {
+            bool sphere = keyword == "sphere";
+            ok = line.number(f) && line.number(time) && line.vec(a) && std::isfinite(time) && IsFinite(a);
+            size_t count = sphere ? scene.objects.spheres.size() : scene.lights.size();
+            if (ok && (f < 0 || f >= float(count) || f != floorf(f))) {
+                fprintf(stderr, "%s:%d: no %s with index %g in the scene\n", path, lineNumber, keyword.c_str(), f);
+                return false;
+            }
+            if (ok)
+                (sphere ? animation.sphereTrack(uint32_t(f)) : animation.lightTrack(uint32_t(f))).add(time, a);
+        } else if (keyword == "spin") {
+            ok = line.vec(a) && line.number(f) && IsFinite(a) && std::isfinite(f);
+            if (ok)
+                animation.setSpin(a, f);
+        } else {
+            fprintf(stderr, "%s:%d: unknown keyword `%s`\n", path, lineNumber, keyword.c_str());
+            return false;
+        }
+        if (!ok || !line.end()) {
+            fprintf(stderr, "%s:%d: malformed `%s` line\n", path, lineNumber, keyword.c_str());
+            return false;
+        }
+    }
+    animation.bind(scene);
+    return true;
+}
+
+#endif //TCODE_ANIMATION_H
@@ -0,0 +1,77 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_ARENA_H
+#define TCODE_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 区域分配器：对象从大块内存中依次切出，不单独释放，随Arena一起销毁（有析构函数的对象按创建的逆序析构）。
+// 场景的材质、光源等生命周期相同的小对象都放在这里，不再一个个new出来
+class Arena {
+public:
+    static constexpr size_t BlockSize = 64 * 1024;
+    static const size_t MaxAlign = 64;
+
+    Arena() = default;
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() { clear(); }
+
+    template<class T, class... Args>
+    T *make(Args &&... args) {
+        static_assert(alignof(T) <= MaxAlign, "alignment too large for Arena");
+        T *object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+            destructors.push_back({object, [](void *p) { static_cast<T *>(p)->~T(); }});
+        return object;
+    }
+
+    // 申请size字节、按align对齐的内存
+    void *allocate(size_t size, size_t align) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (blocks.empty() || offset + size > blockSize) {
+            blockSize = std::max(BlockSize, size);        // 特别大的对象单独占一块
+            blocks.push_back(static_cast<char *>(::operator new(blockSize, std::align_val_t(MaxAlign))));
+            offset = 0;
+        }
+        used = offset + size;
+        bytes += size;
+        return blocks.back() + offset;
+    }
+
+    // 析构所有对象并归还内存
+    void clear() {
+        for (size_t i = destructors.size(); i-- > 0;)
+            destructors[i].destroy(destructors[i].object);
+        destructors.clear();
+        for (char *block: blocks)
+            ::operator delete(block, std::align_val_t(MaxAlign));
+        blocks.clear();
+        used = blockSize = bytes = 0;
+    }
+
+    size_t allocatedBytes() const { return bytes; }
+
+private:
+    struct Destructor {
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    std::vector<char *> blocks;
+    std::vector<Destructor> destructors;
+    size_t used = 0;          // 当前块已用字节数
+    size_t blockSize = 0;     // 当前块大小
+    size_t bytes = 0;         // 分配给对象的总字节数
+};
+
+#endif //TCODE_ARENA_H
@@ -0,0 +1,686 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+// 基准测试：不需要窗口和OpenGL，分别测各种物体的求交核、SIMD球求交核、阴影查询、着色、整帧渲染、抗锯齿和光照图的速度，
+// 结果输出成JSON或CSV，方便比较不同版本
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#define TCODE_COUNT_ALLOCATIONS
+#include "alloc_counter.h"
+#include "animation.h"
+#include "mesh.h"
+#include "preview.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scene.h"
+#include "simd_sphere.h"
+#include "tracer.h"
+
+using namespace std;
+
+struct BenchOptions {
+    double minTime = 0.3;                      // 每项至少测多少秒
+    int width = 320, height = 240;             // 整帧渲染的图像大小
+    vector<int> sceneSizes = {16, 256, 4096, 65536};   // 整帧渲染的合成场景中的球数
+    bool csv = false;
+    bool profile = false;                      // 整帧再开着统计渲染一次，给出统计的开销和光线、测试数
+    const char *output = nullptr;              // 结果文件，没有指定时输出到标准输出
+    const char *filter = nullptr;              // 只跑名字包含这个字符串的测试
+    RenderSettings settings;
+};
+
+struct BenchResult {
+    string name;
+    string unit;
+    double value;           // 按unit表示的结果
+    uint64_t count;         // 测试中完成的操作数
+    double seconds;         // 测试总耗时
+};
+
+BenchOptions options;
+vector<BenchResult> results;
+unsigned renderThreads = 1;     // 整帧渲染实际使用的线程数
+volatile float sink;        // 存放测试结果，防止编译器把被测的计算优化掉
+uint64_t allocatingFrames = 0;  // 光线追踪期间有堆分配的帧数，不为0时main返回1
+uint64_t failedChecks = 0;      // 结果不对的检查数，不为0时main返回1
+
+// 光线追踪期间不应该有堆分配（alloc_counter.h），有的话报错并记下，整个测试以失败结束
+static void CheckAllocations(const char *bench, const RenderStats &render) {
+    if (render.tracingAllocations == 0)
+        return;
+    fprintf(stderr, "%s: %llu heap allocations while tracing\n", bench, (unsigned long long) render.tracingAllocations);
+    allocatingFrames++;
+}
+
+static bool Selected(const string &name) {
+    return options.filter == nullptr || name.find(options.filter) != string::npos;
+}
+
+// 反复调用batch直到总时间不少于minTime，batch返回这一次完成的操作数；结果记为每秒百万次操作
+template<class BatchFn>
+void Measure(const string &name, const char *unit, BatchFn batch) {
+    if (!Selected(name))
+        return;
+    batch();        // 预热
+    uint64_t count = 0;
+    double seconds = 0;
+    auto begin = chrono::steady_clock::now();
+    while (seconds < options.minTime) {
+        count += batch();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    }
+    results.push_back({name, unit, count / seconds * 1e-6, count, seconds});
+}
+
+// 从以center为中心、半径distance的球面上随机一点，射向center附近边长2 * spread的立方体中随机一点，大约一半能打中目标
+static vector<Ray> AimedRays(const Vec3 &center, float spread, float distance, int count, uint32_t seed) {
+    Random random(seed);
+    vector<Ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; i++) {
+        Vec3 dir;
+        do {
+            dir = Vec3(random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1);
+        } while (LengthSquared(dir) > 1 || LengthSquared(dir) < 1e-4f);
+        Vec3 start = center + Normalize(dir) * distance;
+        Vec3 target = center + Vec3(random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1,
+                                    random.nextFloat() * 2 - 1) * spread;
+        rays.push_back(Ray(start, target - start));
+    }
+    return rays;
+}
+
+// 单个物体的最近交点和遮挡查询
+template<class Object>
+void BenchObject(const string &name, const Object &object, const vector<Ray> &rays) {
+    Measure(name + ".intersect", "Mrays/s", [&]() {
+        float acc = 0;
+        for (const Ray &ray: rays)
+            acc += object.intersect(ray).t;
+        sink = acc;
+        return uint64_t(rays.size());
+    });
+    Measure(name + ".occluded", "Mrays/s", [&]() {
+        int acc = 0;
+        for (const Ray &ray: rays)
+            acc += object.occluded(ray, epsilon, 10.0f);
+        sink = float(acc);
+        return uint64_t(rays.size());
+    });
+}
+
+// 经纬度剖分的球面网格，用来测三角形求交
+static TriangleMesh MakeSphereMesh(const Vec3 &center, float radius, int slices, int stacks, Material *material) {
+    TriangleMesh mesh(material);
+    for (int i = 0; i <= stacks; i++) {
+        float theta = float(M_PI) * i / stacks;
+        for (int j = 0; j < slices; j++) {
+            float phi = 2 * float(M_PI) * j / slices;
+            mesh.addVertex(center + Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)) * radius);
+        }
+    }
+    for (int i = 0; i < stacks; i++) {
+        for (int j = 0; j < slices; j++) {
+            uint32_t a = i * slices + j, b = i * slices + (j + 1) % slices;
+            uint32_t c = a + slices, d = b + slices;
+            if (i > 0)
+                mesh.addTriangle(a, b, c);
+            if (i + 1 < stacks)
+                mesh.addTriangle(b, d, c);
+        }
+    }
+    mesh.build();
+    return mesh;
+}
+
+static void BenchPrimitives() {
+    RoughMaterial material(Vec3(0.3f, 0.2f, 0.1f), Vec3(0.2f, 0.2f, 0.2f), 10);
+    Vec3 center(0.1f, -0.2f, 0.3f);
+    vector<Ray> rays = AimedRays(center, 0.5f, 3, 4096, 1);
+    BenchObject("sphere", Sphere(center, 0.4f, &material), rays);
+    BenchObject("plane", Plane(center, Normalize(Vec3(0.2f, 1, 0.1f)), &material), rays);
+    TriangleMesh mesh = MakeSphereMesh(center, 0.4f, 64, 32, &material);
+    BenchObject("mesh" + to_string(mesh.triangleCount()), mesh, rays);
+}
+
+// SIMD球求交核：每条光线测试一组SphereCount个球，结果记为每秒的光线-球测试数
+static void BenchSphereKernels() {
+    const int SphereCount = 64;
+    Random random(2);
+    SphereSoA soa;
+    soa.resize(SphereCount);
+    for (int i = 0; i < SphereCount; i++) {
+        soa.set(i, Vec3(random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1),
+                0.05f + 0.1f * random.nextFloat());
+    }
+    vector<Ray> rays = AimedRays(Vec3(0, 0, 0), 1, 3, 1024, 3);
+    ShadowPacket packet;
+    packet.reset(Vec3(0, 0, 3));
+    for (int k = 0; k < ShadowPacketMax; k++)
+        packet.add(Vec3(random.nextFloat() * 2 - 1, random.nextFloat() * 2 - 1, -3));
+    for (int width: {1, 4, 8, 16}) {
+        SphereKernel kernel = FindSphereKernel(width);
+        if (kernel.width != width)        // CPU不支持这个宽度
+            continue;
+        string name = string("kernel.") + kernel.name;
+        Measure(name + ".nearest", "Mtests/s", [&]() {
+            float acc = 0;
+            for (const Ray &ray: rays) {
+                float t = INFINITY;
+                acc += float(kernel.nearest(soa, ray, 0, SphereCount, 0, t));
+            }
+            sink = acc;
+            return uint64_t(rays.size()) * SphereCount;
+        });
+        Measure(name + ".any", "Mtests/s", [&]() {
+            float acc = 0;
+            for (const Ray &ray: rays)
+                acc += float(kernel.any(soa, ray, 0, SphereCount, 0, INFINITY));
+            sink = acc;
+            return uint64_t(rays.size()) * SphereCount;     // 找到交点就提前返回，实际测试数更少
+        });
+        Measure(name + ".shadow", "Mtests/s", [&]() {
+            ShadowPacket p = packet;
+            int lanes = p.paddedCount();
+            for (int i = 0; i < SphereCount; i++)
+                kernel.shadow(soa, i, p, lanes);
+            sink = float(p.visibleCount());
+            return uint64_t(p.count) * SphereCount;
+        });
+    }
+}
+
+// 合成场景：默认场景的房间（5个平面、2个面光源），里面随机放sphereCount个球，每8个中有一个是反射球。
+// 球的总体积大致不随数量变化。lightGrid大于0时两个光源换成天花板下lightGrid x lightGrid个小光源，总强度相同
+static void MakeSyntheticScene(Scene &scene, int sphereCount, int lightGrid = 0) {
+    scene.camera = Vec3(0, 0, 4 - epsilon);
+    scene.ambientLight = Vec3(0.4f, 0.4f, 0.4f);
+    if (lightGrid == 0) {
+        scene.addLight(Vec3(1.5f, 1.5f, 1.5f), Vec3(0.3f, 0.95f, -0.3f), 0.2f);
+        scene.addLight(Vec3(2, 2, 2), Vec3(-0.2f, 0.95f, 0.4f), 0.3f);
+    }
+    for (int i = 0; i < lightGrid; i++) {
+        for (int j = 0; j < lightGrid; j++) {
+            Vec3 position(-0.9f + 1.8f * (i + 0.5f) / lightGrid, 0.95f, -0.9f + 1.8f * (j + 0.5f) / lightGrid);
+            scene.addLight(Vec3(3.5f) / float(lightGrid * lightGrid), position, 0.6f / lightGrid);
+        }
+    }
+    Vec3 ks(0.2f, 0.2f, 0.2f);
+    Material *yellow = scene.create<RoughMaterial>(Vec3(0.3f, 0.2f, 0.1f), ks, 10);
+    Material *blue = scene.create<RoughMaterial>(Vec3(0.1f, 0.2f, 0.3f), ks, 10);
+    Material *pink = scene.create<RoughMaterial>(Vec3(3, 0, 0.2f), ks, 10);
+    Material *red = scene.create<RoughMaterial>(Vec3(0.3f, 0, 0), ks, 10);
+    Material *mirror = scene.create<ReflectiveMaterial>(Vec3(0.14f, 0.16f, 0.13f), Vec3(4.1f, 2.3f, 3.1f));
+    scene.add(Plane(Vec3(0, 0, -1), Vec3(0, 0, 1), yellow));
+    scene.add(Plane(Vec3(0, 1, 0), Vec3(0, -1, 0), blue));
+    scene.add(Plane(Vec3(0, -1, 0), Vec3(0, 1, 0), blue));
+    scene.add(Plane(Vec3(1, 0, 0), Vec3(-1, 0, 0), pink));
+    scene.add(Plane(Vec3(-1, 0, 0), Vec3(1, 0, 0), pink));
+    Material *rough[4] = {yellow, blue, pink, red};
+    Random random(static_cast<uint32_t>(sphereCount));
+    float radius = 0.25f / cbrtf(float(sphereCount) / 6);
+    for (int i = 0; i < sphereCount; i++) {
+        Vec3 center(random.nextFloat() * 1.6f - 0.8f, random.nextFloat() * 1.4f - 0.9f, random.nextFloat() * 1.8f - 0.9f);
+        scene.add(Sphere(center, radius * (0.5f + random.nextFloat()), i % 8 == 7 ? mirror : rough[i % 4]));
+    }
+    scene.build();
+}
+
+// 阴影查询和着色：逐条阴影光线的遮挡查询、一个点对一个面光源的光照（阴影光线束）、主光线的完整着色
+static void BenchShading() {
+    Scene scene;
+    MakeSyntheticScene(scene, 256);
+    Tracer tracer(scene, options.settings);
+    Random random(4);
+    const int PointCount = 4096;
+    vector<Vec3> points(PointCount);        // 房间里随机的点（可能在球内）
+    for (Vec3 &p: points)
+        p = Vec3(random.nextFloat() * 1.8f - 0.9f, random.nextFloat() * 1.8f - 0.9f, random.nextFloat() * 1.8f - 0.9f);
+    const Light &light = *scene.lights[0];
+    vector<Ray> shadowRays;
+    vector<float> shadowDistances;
+    for (const Vec3 &p: points) {
+        Vec3 target = light.position + Vec3(random.nextFloat() - 0.5f, 0, random.nextFloat() - 0.5f) * light.r;
+        shadowRays.push_back(Ray(p, target - p));
+        shadowDistances.push_back(Length(target - p) - epsilon);
+    }
+    Measure("scene256.occluded", "Mrays/s", [&]() {
+        int acc = 0;
+        for (size_t i = 0; i < shadowRays.size(); i++) {
+            ObjectId lastOccluder = NoObject;
+            acc += scene.occluded(shadowRays[i], epsilon, shadowDistances[i], lastOccluder);
+        }
+        sink = float(acc);
+        return uint64_t(shadowRays.size());
+    });
+    for (bool adaptive: {false, true}) {
+        RenderSettings settings = options.settings;
+        settings.adaptiveShadows = adaptive;
+        Tracer shadowTracer(scene, settings);
+        string name = adaptive ? "scene256.light.adaptive" : "scene256.light.fixed";
+        uint64_t shadowCount = 0;
+        bool warmup = true;
+        Measure(name, "Mpoints/s", [&]() {
+            uint64_t raysBefore = threadShadowRays;
+            Vec3 acc(0, 0, 0);
+            for (const Vec3 &p: points) {
+                ObjectId lastOccluder = NoObject;
+                acc += shadowTracer.calLightIntensity(p, light, lastOccluder);
+            }
+            sink = acc[0];
+            if (!warmup)
+                shadowCount += threadShadowRays - raysBefore;
+            warmup = false;
+            return uint64_t(points.size());
+        });
+        if (!results.empty() && results.back().name == name) {        // 同时记下阴影光线的速度
+            double seconds = results.back().seconds;
+            results.push_back({name + ".rays", "Mrays/s", shadowCount / seconds * 1e-6, shadowCount, seconds});
+        }
+    }
+    // 主光线：从相机射向图像中随机的像素，包括反射和阴影在内的完整着色
+    vector<Ray> cameraRays;
+    float angle = tanf(float(M_PI) * 0.5f * 40 / 180), aspect = 4.0f / 3;
+    for (int i = 0; i < PointCount; i++) {
+        Vec3 dir((random.nextFloat() * 2 - 1) * angle * aspect, (random.nextFloat() * 2 - 1) * angle, -1);
+        cameraRays.push_back(Ray(scene.camera, dir));
+    }
+    Measure("scene256.trace", "Mrays/s", [&]() {
+        Vec3 acc(0, 0, 0);
+        for (const Ray &ray: cameraRays)
+            acc += tracer.trace(ray, 0);
+        sink = acc[0];
+        return uint64_t(cameraRays.size());
+    });
+}
+
+// 整帧渲染：合成场景的球数逐级增加，记下建BVH和渲染一帧（一遍画完）的时间
+static void BenchFrames() {
+    for (int count: options.sceneSizes) {
+        string name = "frame" + to_string(count);
+        if (!Selected(name))
+            continue;
+        unique_ptr<Scene> scene(new Scene);
+        MakeSyntheticScene(*scene, count);
+        const BVH::Stats &stats = scene->bvh.getStats();
+        results.push_back({"build" + to_string(count), "ms", stats.buildMs, uint64_t(count), stats.buildMs * 1e-3});
+        RenderSettings settings = options.settings;
+        settings.coarseStride = 1;
+        Tracer tracer(*scene, settings);
+        FrameBuffer frame(options.width, options.height);
+        atomic<bool> cancel(false);
+        RenderStats render;
+        RenderFrame(tracer, frame, cancel, render, [](int, int) {});
+        CheckAllocations("frame", render);
+        renderThreads = render.threads;
+        results.push_back({name, "ms", render.seconds * 1e3, uint64_t(options.width) * options.height, render.seconds});
+        results.push_back({name + ".shadow", "Mrays/s", render.shadowRays / render.seconds * 1e-6, render.shadowRays,
+                           render.seconds});
+        if (!options.profile)
+            continue;
+        TraceProfile profile;
+        RenderFrame(tracer, frame, cancel, render, [](int, int) {}, &profile);
+        CheckAllocations("frame", render);
+        TraceCounters total = profile.total();
+        uint64_t pixels = uint64_t(options.width) * options.height;
+        results.push_back({name + ".profiled", "ms", render.seconds * 1e3, pixels, render.seconds});
+        results.push_back({name + ".rays", "rays/pixel", double(total.rays()) / pixels, total.rays(), render.seconds});
+        results.push_back({name + ".tests", "tests/pixel", double(total.tests()) / pixels, total.tests(), render.seconds});
+    }
+}
+
+// 动画：所有球和光源绕竖直轴转动（转台），每帧移动物体并refit BVH的耗时，与重建BVH比较；
+// 再复用渲染资源连续渲染几帧，统计每帧光线追踪以外的开销
+static void BenchAnimation() {
+    for (int count: options.sceneSizes) {
+        string name = "anim" + to_string(count);
+        if (!Selected(name))
+            continue;
+        unique_ptr<Scene> scene(new Scene);
+        MakeSyntheticScene(*scene, count);
+        Animation animation;
+        animation.frames = 1000;
+        animation.setSpin(Vec3(0, -0.1f, 0), 1);
+        animation.bind(*scene);
+        int frames = 0, rebuilds = 0;
+        double seconds = 0;
+        auto begin = chrono::steady_clock::now();
+        while (seconds < options.minTime) {
+            animation.apply(*scene, float(frames++ % animation.frames));
+            bool rebuilt;
+            scene->update(RefitRebuildRatio, &rebuilt);
+            rebuilds += rebuilt;
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        }
+        results.push_back({name + ".update", "ms", seconds * 1e3 / frames, uint64_t(frames), seconds});
+        results.push_back({name + ".rebuilds", "count", double(rebuilds), uint64_t(frames), seconds});
+        scene->build();
+        results.push_back({name + ".rebuild", "ms", scene->bvh.getStats().buildMs, uint64_t(count),
+                           scene->bvh.getStats().buildMs * 1e-3});
+
+        RenderSettings settings = options.settings;
+        settings.coarseStride = 1;
+        Tracer tracer(*scene, settings);
+        RenderContext context(settings, options.width, options.height);
+        FrameBuffer frame(options.width, options.height);
+        atomic<bool> cancel(false);
+        const int SequenceFrames = 4;
+        double tracing = 0;
+        begin = chrono::steady_clock::now();
+        for (int i = 0; i < SequenceFrames; i++) {
+            animation.apply(*scene, float(i * 10));
+            scene->update();
+            RenderStats render;
+            RenderFrame(context, tracer, frame, cancel, render, [](int, int) {});
+            CheckAllocations("anim", render);
+            tracing += render.seconds;
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        results.push_back({name + ".frame", "ms", seconds * 1e3 / SequenceFrames, uint64_t(SequenceFrames), seconds});
+        results.push_back({name + ".overhead", "ms", (seconds - tracing) * 1e3 / SequenceFrames,
+                           uint64_t(SequenceFrames), seconds - tracing});
+    }
+}
+
+// 交互预览：256个球的场景中边转动相机边画预览，按16毫秒的预算自动调整质量，记录稳定后每帧的耗时和步长
+static void BenchPreview() {
+    if (!Selected("preview"))
+        return;
+    Scene scene;
+    MakeSyntheticScene(scene, 256);
+    RenderContext context(options.settings, options.width, options.height);
+    FrameBuffer frame(options.width, options.height);
+    atomic<bool> cancel(false);
+    PreviewBudget budget(16);
+    const int Frames = 60, Measured = 20;      // 前面的帧用来收敛，只统计最后Measured帧
+    double seconds = 0;
+    for (int i = 0; i < Frames; i++) {
+        scene.cameraYaw = float(i % 20) - 10;
+        context.passes.assign(1, budget.pass());
+        Tracer tracer(scene, budget.settings(options.settings));
+        RenderStats render;
+        RenderFrame(context, tracer, frame, cancel, render, [](int, int) {});
+        CheckAllocations("preview", render);
+        budget.update(render.seconds * 1e3);
+        if (i >= Frames - Measured)
+            seconds += render.seconds;
+    }
+    results.push_back({"preview.frame", "ms", seconds * 1e3 / Measured, uint64_t(Measured), seconds});
+    results.push_back({"preview.stride", "pixels", double(budget.stride()), uint64_t(Measured), seconds});
+}
+
+// 抗锯齿：256个球的场景分别不做、自适应和每像素均匀16个采样各画一帧，记录耗时，
+// 以及不做和自适应的图像与均匀16x之间的均方根误差
+static void BenchAntialias() {
+    if (!Selected("aa"))
+        return;
+    Scene scene;
+    MakeSyntheticScene(scene, 256);
+    const char *names[3] = {"aa.off", "aa.adaptive", "aa.uniform16"};
+    RenderSettings modes[3] = {options.settings, options.settings, options.settings};
+    modes[0].aaMaxSamples = 1;
+    modes[1].aaMaxSamples = 16;
+    modes[2].aaMaxSamples = 16;
+    modes[2].aaContrast = -1, modes[2].aaError = 0, modes[2].aaBudget = 15;     // 每个像素都补满16个
+    vector<unique_ptr<FrameBuffer>> frames;
+    double seconds[3];
+    for (int i = 0; i < 3; i++) {
+        modes[i].coarseStride = 1;
+        Tracer tracer(scene, modes[i]);
+        frames.emplace_back(new FrameBuffer(options.width, options.height));
+        atomic<bool> cancel(false);
+        RenderStats render;
+        RenderFrame(tracer, *frames.back(), cancel, render, [](int, int) {});
+        CheckAllocations("aa", render);
+        seconds[i] = render.seconds;
+        uint64_t pixels = uint64_t(options.width) * options.height;
+        results.push_back({names[i], "ms", render.seconds * 1e3, pixels, render.seconds});
+        if (i > 0)
+            results.push_back({string(names[i]) + ".samples", "samples/pixel", 1 + double(render.aaSamples) / pixels,
+                               render.aaSamples, render.seconds});
+    }
+    for (int i = 0; i < 2; i++) {
+        double sum = 0;
+        for (int y = 0; y < options.height; y++)
+            for (int x = 0; x < options.width; x++)
+                for (int c = 0; c < 3; c++) {
+                    float d = std::min(frames[i]->get(x, y, c), 1.0f) - std::min(frames[2]->get(x, y, c), 1.0f);
+                    sum += d * d;
+                }
+        double rmse = sqrt(sum / (double(options.width) * options.height * 3));
+        results.push_back({string(names[i]) + ".rmse", "rmse", rmse, uint64_t(options.width) * options.height,
+                           seconds[i]});
+    }
+    results.push_back({"aa.cost", "fraction", (seconds[1] - seconds[0]) / (seconds[2] - seconds[0]), 1,
+                       seconds[1] + seconds[2]});
+}
+
+// 光照图：256个球的场景烘焙所有平面和球的光照图的时间，用光照图渲染一帧的时间（与frame256比较），
+// 以及每帧移动一个球之后增量更新的时间和重新烘焙的纹素比例
+static void BenchLightmaps() {
+    if (!Selected("lightmap"))
+        return;
+    Scene scene;
+    MakeSyntheticScene(scene, 256);
+    RenderSettings settings = options.settings;
+    settings.coarseStride = 1;
+    settings.lightmaps = true;
+    RenderContext context(settings, options.width, options.height);
+    Lightmaps lightmaps;
+    Tracer tracer(scene, settings, &lightmaps);
+    BakeLightmaps(lightmaps, tracer, context.pool);
+    const Lightmaps::Stats &stats = lightmaps.getStats();
+    results.push_back({"lightmap.bake", "ms", stats.bakeMs, stats.texels, stats.bakeMs * 1e-3});
+    results.push_back({"lightmap.memory", "MB", stats.texels * sizeof(float) / double(1 << 20), stats.maps,
+                       stats.bakeMs * 1e-3});
+    FrameBuffer frame(options.width, options.height);
+    atomic<bool> cancel(false);
+    RenderStats render;
+    RenderFrame(context, tracer, frame, cancel, render, [](int, int) {});
+    CheckAllocations("lightmap", render);
+    results.push_back({"lightmap.frame", "ms", render.seconds * 1e3, uint64_t(options.width) * options.height,
+                       render.seconds});
+    const int Frames = 8;
+    double seconds = 0;
+    size_t baked = 0;
+    Sphere &sphere = scene.objects.spheres[0];
+    Vec3 center = sphere.getCenter();
+    for (int i = 0; i < Frames; i++) {
+        sphere.setCenter(center + Vec3(0, 0.01f * float(i + 1), 0));
+        scene.update();
+        BakeLightmaps(lightmaps, tracer, context.pool);
+        seconds += stats.bakeMs * 1e-3;
+        baked += stats.baked;
+    }
+    results.push_back({"lightmap.update", "ms", seconds * 1e3 / Frames, uint64_t(Frames), seconds});
+    results.push_back({"lightmap.rebaked", "fraction", double(baked) / Frames / stats.texels, baked, seconds});
+}
+
+// 很多光源：256个球的场景把光源换成4x4、16x16、64x64个小光源，不做抗锯齿，按贡献抽光源（--light-samples）
+// 渲染一帧的时间（lightsN），16个光源时再逐个计算全部光源画一帧（lights16.all），以及两者的均方根误差
+static void BenchLights() {
+    if (!Selected("lights"))
+        return;
+    unique_ptr<FrameBuffer> exact;
+    for (int side: {4, 16, 64}) {
+        string name = "lights" + to_string(side * side);
+        Scene scene;
+        MakeSyntheticScene(scene, 256, side);
+        RenderSettings settings = options.settings;
+        settings.coarseStride = 1;
+        settings.aaMaxSamples = 1;
+        FrameBuffer frame(options.width, options.height);
+        atomic<bool> cancel(false);
+        RenderStats render;
+        uint64_t pixels = uint64_t(options.width) * options.height;
+        if (side == 4) {
+            RenderSettings all = settings;
+            all.lightSamples = 0;
+            Tracer tracer(scene, all);
+            exact.reset(new FrameBuffer(options.width, options.height));
+            RenderFrame(tracer, *exact, cancel, render, [](int, int) {});
+            CheckAllocations("lights", render);
+            results.push_back({name + ".all", "ms", render.seconds * 1e3, pixels, render.seconds});
+        }
+        Tracer tracer(scene, settings);
+        RenderFrame(tracer, frame, cancel, render, [](int, int) {});
+        CheckAllocations("lights", render);
+        results.push_back({name, "ms", render.seconds * 1e3, pixels, render.seconds});
+        results.push_back({name + ".shadow", "Mrays/s", render.shadowRays / render.seconds * 1e-6, render.shadowRays,
+                           render.seconds});
+        if (side != 4)
+            continue;
+        double sum = 0;
+        for (int y = 0; y < options.height; y++)
+            for (int x = 0; x < options.width; x++)
+                for (int c = 0; c < 3; c++) {
+                    float d = std::min(frame.get(x, y, c), 1.0f) - std::min(exact->get(x, y, c), 1.0f);
+                    sum += d * d;
+                }
+        results.push_back({name + ".rmse", "rmse", sqrt(sum / (double(pixels) * 3)), pixels, render.seconds});
+    }
+}
+
+// 按贡献抽光源的估计是否无偏：16x16个光源下面贴着光源的点，法线接近水平，一半左右的光源在背面（明暗交界处，
+// 很多叶子的重要度上界为正而其中的光源全在背面）。比较各点抽样估计的平均和逐个计算全部光源（不算遮挡）的平均，
+// 记为lights.bias（两者之比），偏差超过2%时报错
+static void CheckLightSampling() {
+    if (!Selected("lights.bias"))
+        return;
+    Scene scene;
+    MakeSyntheticScene(scene, 16, 16);
+    Tracer tracer(scene, options.settings);
+    int samples = std::min(options.settings.lightSamples, MaxLightSamples);
+    if (samples == 0)
+        return;
+    auto contribution = [&](int i, const Hit &hit) {        // 与LightBVH的重要度相同
+        const Light &light = *scene.lights[i];
+        float cosTheta = Dot(hit.normal, Normalize(light.position - hit.position));
+        return cosTheta > 0 ? light.power() * cosTheta : 0.0f;
+    };
+    Random random(25);
+    const int PointCount = 65536;
+    int lights[MaxLightSamples];
+    float weights[MaxLightSamples];
+    double sampled = 0, exact = 0;
+    for (int p = 0; p < PointCount; p++) {
+        Hit hit;
+        hit.position = Vec3(random.nextFloat() * 1.8f - 0.9f, 0.8f + random.nextFloat() * 0.13f,
+                            random.nextFloat() * 1.8f - 0.9f);
+        float angle = random.nextFloat() * 6.2831853f;
+        hit.normal = Normalize(Vec3(cosf(angle), random.nextFloat() * 0.2f - 0.1f, sinf(angle)));
+        int count = tracer.sampleLights(hit, samples, lights, weights);
+        for (int k = 0; k < count; k++)
+            sampled += weights[k] * contribution(lights[k], hit);
+        for (size_t i = 0; i < scene.lights.size(); i++)
+            exact += contribution(int(i), hit);
+    }
+    double ratio = sampled / exact;
+    results.push_back({"lights.bias", "ratio", ratio, uint64_t(PointCount), 0});
+    if (fabs(ratio - 1) > 0.02) {
+        fprintf(stderr, "lights: sampled light estimate is %.4g times the exact sum\n", ratio);
+        failedChecks++;
+    }
+}
+
+static void WriteResults(FILE *out) {
+    if (options.csv) {
+        fprintf(out, "name,unit,value,count,seconds\n");
+        for (const BenchResult &r: results)
+            fprintf(out, "%s,%s,%.6g,%llu,%.6g\n", r.name.c_str(), r.unit.c_str(), r.value, (unsigned long long) r.count,
+                    r.seconds);
+        return;
+    }
+    fprintf(out, "{\n  \"kernel\": \"%s\",\n  \"threads\": %u,\n  \"frame\": [%d, %d],\n  \"results\": [\n",
+            ActiveSphereKernel().name, renderThreads, options.width, options.height);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.6g, \"count\": %llu, \"seconds\": %.6g}%s\n",
+                r.name.c_str(), r.unit.c_str(), r.value, (unsigned long long) r.count, r.seconds,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// 命令行参数：--csv（默认输出JSON），--output 文件，--filter 名字的一部分，--min-time 秒，--size 宽 高，
+// --spheres 16,256,...（整帧渲染的场景大小），--threads N，--simd 1|4|8|16，--fixed-shadows，--no-packets，--recursive，
+// --profile（整帧再开着统计渲染一次）
+static bool ParseArguments(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            options.csv = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.profile = true;
+        } else if (strcmp(argv[i], "--fixed-shadows") == 0) {
+            options.settings.adaptiveShadows = false;
+        } else if (strcmp(argv[i], "--no-packets") == 0) {
+            options.settings.packets = false;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            options.settings.wavefront = false;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            options.width = max(atoi(argv[++i]), 1);
+            options.height = max(atoi(argv[++i]), 1);
+        } else if (i + 1 == argc) {
+            fprintf(stderr, "Unknown or incomplete argument '%s'\n", argv[i]);
+            return false;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            options.output = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0) {
+            options.minTime = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--spheres") == 0) {
+            options.sceneSizes.clear();
+            for (const char *p = argv[++i]; *p != '\0';) {
+                char *end;
+                long n = strtol(p, &end, 10);
+                if (end == p || n <= 0) {
+                    fprintf(stderr, "Invalid sphere counts '%s'\n", argv[i]);
+                    return false;
+                }
+                options.sceneSizes.push_back(int(n));
+                p = *end == ',' ? end + 1 : end;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "-t") == 0) {
+            options.settings.threads = unsigned(max(atoi(argv[++i]), 0));
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            ActiveSphereKernel() = FindSphereKernel(atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!ParseArguments(argc, argv))
+        return 1;
+    BenchPrimitives();
+    BenchSphereKernels();
+    BenchShading();
+    BenchFrames();
+    BenchAnimation();
+    BenchPreview();
+    BenchAntialias();
+    BenchLightmaps();
+    BenchLights();
+    CheckLightSampling();
+    FILE *out = options.output == nullptr ? stdout : fopen(options.output, "w");
+    if (out == nullptr) {
+        fprintf(stderr, "Error: cannot open '%s'\n", options.output);
+        return 1;
+    }
+    WriteResults(out);
+    if (out != stdout)
+        fclose(out);
+    return allocatingFrames == 0 && failedChecks == 0 ? 0 : 1;
+}
@@ -0,0 +1,312 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_BVH_H
+#define TCODE_BVH_H
+
+#include <chrono>
+#include <vector>
+#include "objects.h"
+#include "bvh_builder.h"
+#include "counters.h"
+#include "object_store.h"
+#include "simd_sphere.h"
+#include "packet.h"
+
+// 层次包围盒（BVH），用分桶SAH（表面积启发式）建树，只管理有界的物体，物体用ObjectStore中的编号表示。
+// 叶子里的球另外按SoA存一份，叶子大小取向量化核的宽度，一次测试整个叶子。
+// 开启统计时（counters.h）记录包围盒测试数和球的测试数，叶子里的球按整个叶子计
+class BVH {
+public:
+    typedef BVHNode Node;
+    typedef BVHStats Stats;
+
+    // objects在BVH的整个生命周期内不能增删物体
+    void build(const ObjectStore &objects, const std::vector<ObjectId> &ids) {
+        auto begin = std::chrono::steady_clock::now();
+        store = &objects;
+        kernel = ActiveSphereKernel();
+        leafSize = std::max(kernel.width, 4);
+        primStorage.assign(ids.begin(), ids.end());
+        std::vector<BVHBuilder::PrimRef> refs(primStorage.size());
+        for (size_t i = 0; i < primStorage.size(); i++) {
+            objects.bounds(primStorage[i], refs[i].box);
+            refs[i].centroid = refs[i].box.center();
+            refs[i].index = int(i);
+        }
+        BVHBuilder::Build(refs, leafSize, nodeStorage, stats);
+        // 按叶子顺序重排物体，遍历时叶子里的物体在内存中连续
+        std::vector<ObjectId> ordered(primStorage.size());
+        for (size_t i = 0; i < refs.size(); i++)
+            ordered[i] = primStorage[refs[i].index];
+        primStorage.swap(ordered);
+        nodes = ArrayView<Node>(nodeStorage);
+        prims = ArrayView<ObjectId>(primStorage);
+        soa.resize(int(prims.size()));
+        hasGeneric = false;
+        for (size_t i = 0; i < prims.size(); i++) {
+            if (isGeneric(int(i))) {
+                hasGeneric = true;        // 其他有界物体在SoA中是永不相交的占位，逐个求交
+                continue;
+            }
+            soa.set(int(i), objects.spheres[GetObjectIndex(prims[i])]);
+        }
+        buildCost = SAHCost(nodes);
+        stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // 物体移动之后（个数和编号不变）原地更新结点的包围盒和球的SoA，不改变树的结构。子结点的下标总是比父结点大，
+    // 倒着扫一遍就能自底向上更新。返回更新后的SAH代价与建树时之比，越大说明树越差。
+    // 树来自adopt（映射的只读内存）时按当前位置重建一次，之后就可以原地更新了
+    float refit() {
+        if (nodeStorage.empty()) {
+            if (!nodes.empty()) {
+                std::vector<ObjectId> ids(prims.data(), prims.data() + prims.size());
+                build(*store, ids);
+            }
+            return 1;
+        }
+        for (size_t i = nodeStorage.size(); i-- > 0;) {
+            Node &node = nodeStorage[i];
+            if (node.count == 0) {
+                node.box = nodeStorage[i + 1].box;
+                node.box.grow(nodeStorage[node.offset].box);
+                continue;
+            }
+            node.box = AABB();
+            for (int j = node.offset; j < node.offset + node.count; j++) {
+                AABB box;
+                store->bounds(prims[j], box);
+                node.box.grow(box);
+                if (!isGeneric(j)) {
+                    soa.set(j, store->spheres[GetObjectIndex(prims[j])]);
+                }
+            }
+        }
+        return buildCost > 0 ? SAHCost(nodes) / buildCost : 1;
+    }
+
+    // 直接使用外部（比如映射进内存的场景文件）已经建好的树，不复制也不重建。这些数组在BVH使用期间必须有效，
+    // 格式与build的结果相同：_nodes是结点，_prims是按叶子顺序排列的物体编号，sphereData是与_prims同序的球SoA
+    // （cx、cy、cz、r2依次存放，每个数组_prims.size() + SphereSoA::Padding个float，64字节对齐）
+    void adopt(const ObjectStore &objects, ArrayView<Node> _nodes, ArrayView<ObjectId> _prims, const float *sphereData,
+               const Stats &_stats) {
+        store = &objects;
+        kernel = ActiveSphereKernel();
+        nodeStorage.clear();
+        primStorage.clear();
+        nodes = _nodes;
+        prims = _prims;
+        soa.borrow(int(prims.size()), sphereData);
+        hasGeneric = false;
+        for (size_t i = 0; i < prims.size() && !hasGeneric; i++)
+            hasGeneric = isGeneric(int(i));
+        stats = _stats;
+        stats.buildMs = 0;
+        buildCost = SAHCost(nodes);
+    }
+
+    ArrayView<Node> getNodes() const { return nodes; }
+
+    ArrayView<ObjectId> getPrims() const { return prims; }
+
+    const SphereSoA &getSpheres() const { return soa; }
+
+    // 最近交点查询：只接受比nearHit.t更近的交点，找到时更新nearHit和nearId
+    bool intersect(const Ray &ray, Hit &nearHit, ObjectId &nearId) const {
+        if (nodes.empty())
+            return false;
+        Vec3 invDir = Vec3(1.0f) / ray.dir;
+        struct Entry {
+            int node;
+            float tNear;
+        } stack[MaxDepth + 2];
+        int top = 0;
+        ScopedCount nodeTests(NodeTests), sphereTests(SphereTests);
+        nodeTests.n = 1;
+        float tRoot;
+        if (!nodes[0].box.intersect(ray.start, invDir, nearHit.t, tRoot))
+            return false;
+        stack[top++] = {0, tRoot};
+        bool found = false;
+        while (top > 0) {
+            Entry e = stack[--top];
+            if (e.tNear >= nearHit.t)        // 入栈之后已经找到了更近的交点
+                continue;
+            const Node &node = nodes[e.node];
+            if (node.count > 0) {
+                sphereTests.n += node.count;
+                if (intersectLeaf(node, ray, nearHit, nearId))
+                    found = true;
+                continue;
+            }
+            nodeTests.n += 2;
+            // 两个孩子都相交时先访问近的那个
+            Entry left{e.node + 1, 0}, right{node.offset, 0};
+            bool hitLeft = nodes[left.node].box.intersect(ray.start, invDir, nearHit.t, left.tNear);
+            bool hitRight = nodes[right.node].box.intersect(ray.start, invDir, nearHit.t, right.tNear);
+            if (hitLeft && hitRight) {
+                if (left.tNear > right.tNear)
+                    std::swap(left, right);
+                stack[top++] = right;
+                stack[top++] = left;
+            } else if (hitLeft) {
+                stack[top++] = left;
+            } else if (hitRight) {
+                stack[top++] = right;
+            }
+        }
+        return found;
+    }
+
+    // 光线束遍历：收集与视锥可能相交的叶子（按遍历顺序），叶子数超过maxLeaves时返回false，由调用者改用单条光线
+    bool collectLeaves(const Frustum &frustum, int *leaves, int maxLeaves, int &leafCount) const {
+        leafCount = 0;
+        if (nodes.empty())
+            return true;
+        int stack[MaxDepth + 2];
+        int top = 0;
+        stack[top++] = 0;
+        ScopedCount nodeTests(NodeTests);
+        while (top > 0) {
+            int index = stack[--top];
+            const Node &node = nodes[index];
+            nodeTests.n++;
+            if (frustum.outside(node.box))
+                continue;
+            if (node.count > 0) {
+                if (leafCount == maxLeaves)
+                    return false;
+                leaves[leafCount++] = index;
+                continue;
+            }
+            // 沿视锥中心方向近的孩子先访问，叶子大致按由近到远收集，逐条光线求交时远处的叶子更容易被剪掉
+            int left = index + 1, right = node.offset;
+            if (frustum.distance(nodes[left].box) > frustum.distance(nodes[right].box))
+                std::swap(left, right);
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+        return true;
+    }
+
+    // 只在collectLeaves收集到的叶子里求最近交点，语义同intersect
+    bool intersectLeaves(const Ray &ray, const int *leaves, int leafCount, Hit &nearHit, ObjectId &nearId) const {
+        Vec3 invDir = Vec3(1.0f) / ray.dir;
+        bool found = false;
+        ScopedCount nodeTests(NodeTests), sphereTests(SphereTests);
+        nodeTests.n = leafCount;
+        for (int k = 0; k < leafCount; k++) {
+            const Node &node = nodes[leaves[k]];
+            float tNear;
+            if (!node.box.intersect(ray.start, invDir, nearHit.t, tNear))
+                continue;
+            sphereTests.n += node.count;
+            if (intersectLeaf(node, ray, nearHit, nearId))
+                found = true;
+        }
+        return found;
+    }
+
+    // 阴影光线束：用collectLeaves收集到的叶子遮挡光线束的前lanes条光线，所有光线都被挡住时提前结束
+    void occludePacket(const int *leaves, int leafCount, ShadowPacket &packet, int lanes) const {
+        ScopedCount sphereTests(SphereTests);
+        for (int k = 0; k < leafCount; k++) {
+            const Node &node = nodes[leaves[k]];
+            for (int i = node.offset; i < node.offset + node.count; i++) {
+                if (isGeneric(i)) {
+                    store->occludePacket(prims[i], packet, lanes);
+                } else {
+                    kernel.shadow(soa, i, packet, lanes);
+                    sphereTests.n += lanes;
+                }
+            }
+            if (packet.visibleCount() == 0)
+                return;
+        }
+    }
+
+    // 遮挡查询：找到(tMin, tMax)内任意一个交点就返回，occluder为找到的物体
+    bool occluded(const Ray &ray, float tMin, float tMax, ObjectId &occluder) const {
+        if (nodes.empty())
+            return false;
+        Vec3 invDir = Vec3(1.0f) / ray.dir;
+        int stack[MaxDepth + 2];
+        int top = 0;
+        stack[top++] = 0;
+        ScopedCount nodeTests(NodeTests), sphereTests(SphereTests);
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            float tNear;
+            nodeTests.n++;
+            if (!node.box.intersect(ray.start, invDir, tMax, tNear))
+                continue;
+            if (node.count > 0) {
+                sphereTests.n += node.count;
+                int i = kernel.any(soa, ray, node.offset, node.offset + node.count, tMin, tMax);
+                if (i >= 0) {
+                    occluder = prims[i];
+                    return true;
+                }
+                for (i = node.offset; hasGeneric && i < node.offset + node.count; i++) {
+                    if (isGeneric(i) && store->occluded(prims[i], ray, tMin, tMax)) {
+                        occluder = prims[i];
+                        return true;
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.offset;
+            stack[top++] = int(&node - nodes.data()) + 1;
+        }
+        return false;
+    }
+
+    const Stats &getStats() const { return stats; }
+
+    const char *kernelName() const { return kernel.name; }
+
+    bool empty() const { return nodes.empty(); }
+
+private:
+    static const int MaxDepth = BVHMaxDepth;
+
+    std::vector<Node> nodeStorage;       // build建的树；adopt时为空
+    std::vector<ObjectId> primStorage;
+    ArrayView<Node> nodes;               // 遍历用的结点，指向nodeStorage或外部的数组
+    ArrayView<ObjectId> prims;
+    const ObjectStore *store = nullptr;
+    SphereSoA soa;                       // 与prims同序的球数据
+    SphereKernel kernel = ActiveSphereKernel();
+    int leafSize = 4;                    // 叶子最多的物体数
+    bool hasGeneric = false;             // 是否有球以外的有界物体
+    float buildCost = 0;                 // 建树时的SAH代价，refit之后与它比较
+    Stats stats;
+
+    bool isGeneric(int i) const { return GetObjectType(prims[i]) != SPHERE; }        // 球以外的有界物体
+
+    bool intersectLeaf(const Node &node, const Ray &ray, Hit &nearHit, ObjectId &nearId) const {
+        bool found = false;
+        float t = nearHit.t;
+        int i = kernel.nearest(soa, ray, node.offset, node.offset + node.count, 0, t);
+        if (i >= 0) {
+            nearHit = store->spheres[GetObjectIndex(prims[i])].hitAt(ray, t);
+            nearId = prims[i];
+            found = true;
+        }
+        for (i = node.offset; hasGeneric && i < node.offset + node.count; i++) {
+            if (!isGeneric(i))
+                continue;
+            Hit hit = store->intersect(prims[i], ray, nearHit.t);
+            if (hit.t > 0 && hit.t < nearHit.t) {
+                nearHit = hit;
+                nearId = prims[i];
+                found = true;
+            }
+        }
+        return found;
+    }
+};
+
+#endif //TCODE_BVH_H
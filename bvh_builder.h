@@ -0,0 +1,176 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_BVH_BUILDER_H
+#define TCODE_BVH_BUILDER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "objects.h"
+
+// 只读的数组视图，指向vector或者外部内存
+template<class T>
+class ArrayView {
+    const T *ptr = nullptr;
+    size_t count = 0;
+public:
+    ArrayView() = default;
+
+    ArrayView(const T *_ptr, size_t _count) : ptr(_ptr), count(_count) {}
+
+    explicit ArrayView(const std::vector<T> &v) : ptr(v.data()), count(v.size()) {}
+
+    const T &operator[](size_t i) const { return ptr[i]; }
+
+    const T *data() const { return ptr; }
+
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+};
+
+struct BVHNode {
+    AABB box;
+    int offset;     // 内部结点：右孩子下标（左孩子紧跟在自己后面）；叶子：第一个物体的下标
+    int count;      // 叶子中的物体数，0表示内部结点
+};
+
+struct BVHStats {
+    int nodeCount = 0;
+    int leafCount = 0;
+    int depth = 0;
+    double buildMs = 0;     // 建树耗时（毫秒）
+};
+
+const int BVHMaxDepth = 60;      // 树的最大深度，遍历栈的大小由它决定
+
+// 树的SAH代价（以根结点的表面积归一化）：内部结点按一次包围盒测试计，叶子按其中的物体数计。
+// 物体移动后只更新包围盒（refit）时树会变差，和建树时的代价相比决定要不要重建
+inline float SAHCost(ArrayView<BVHNode> nodes) {
+    float rootArea = nodes.empty() ? 0 : nodes[0].box.area();
+    if (rootArea <= 0)
+        return 0;
+    double cost = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
+        cost += double(nodes[i].box.area()) * (nodes[i].count > 0 ? nodes[i].count : 1);
+    return float(cost / rootArea);
+}
+
+// 分桶SAH（表面积启发式）建树，场景的BVH和网格内部的BVH共用。refs是各物体的包围盒，
+// 建完后按叶子顺序重排，叶子的offset、count是重排后refs中的范围
+class BVHBuilder {
+public:
+    struct PrimRef {
+        AABB box;
+        Vec3 centroid;
+        int index;      // 物体原来的下标
+    };
+
+    static void Build(std::vector<PrimRef> &refs, int leafSize, std::vector<BVHNode> &nodes, BVHStats &stats) {
+        nodes.clear();
+        nodes.reserve(refs.size() * 2);
+        stats = BVHStats();
+        BVHBuilder builder(refs, leafSize, nodes, stats);
+        if (!refs.empty())
+            builder.buildNode(0, int(refs.size()), 1);
+        stats.nodeCount = int(nodes.size());
+    }
+
+private:
+    static const int BinCount = 12;
+
+    std::vector<PrimRef> &refs;
+    int leafSize;                       // 不超过这个数的物体直接做成叶子
+    std::vector<BVHNode> &nodes;
+    BVHStats &stats;
+
+    BVHBuilder(std::vector<PrimRef> &_refs, int _leafSize, std::vector<BVHNode> &_nodes, BVHStats &_stats)
+            : refs(_refs), leafSize(_leafSize), nodes(_nodes), stats(_stats) {}
+
+    void makeLeaf(int nodeIndex, int begin, int end) {
+        nodes[nodeIndex].offset = begin;
+        nodes[nodeIndex].count = end - begin;
+        stats.leafCount++;
+    }
+
+    void buildNode(int begin, int end, int depth) {
+        int nodeIndex = int(nodes.size());
+        nodes.push_back(BVHNode());
+        stats.depth = std::max(stats.depth, depth);
+        BVHNode &node = nodes[nodeIndex];
+        AABB centroidBox;
+        for (int i = begin; i < end; i++) {
+            node.box.grow(refs[i].box);
+            centroidBox.grow(refs[i].centroid);
+        }
+        int count = end - begin;
+        if (count <= leafSize || depth >= BVHMaxDepth) {
+            makeLeaf(nodeIndex, begin, end);
+            return;
+        }
+        // 选择质心分布最宽的轴
+        Vec3 extent = centroidBox.max - centroidBox.min;
+        int axis = 0;
+        if (extent[1] > extent[axis]) axis = 1;
+        if (extent[2] > extent[axis]) axis = 2;
+        if (extent[axis] <= 0) {        // 所有质心重合，无法再分
+            makeLeaf(nodeIndex, begin, end);
+            return;
+        }
+        // 分桶统计
+        AABB binBox[BinCount];
+        int binCount[BinCount] = {0};
+        float scale = BinCount / extent[axis];
+        auto binOf = [&](const PrimRef &r) {
+            int b = int((r.centroid[axis] - centroidBox.min[axis]) * scale);
+            return std::min(b, BinCount - 1);
+        };
+        for (int i = begin; i < end; i++) {
+            int b = binOf(refs[i]);
+            binCount[b]++;
+            binBox[b].grow(refs[i].box);
+        }
+        // 从右往左累积，再从左往右扫描求每个分割位置的代价
+        float rightArea[BinCount];
+        int rightCount[BinCount];
+        AABB acc;
+        int accCount = 0;
+        for (int b = BinCount - 1; b > 0; b--) {
+            acc.grow(binBox[b]);
+            accCount += binCount[b];
+            rightArea[b] = acc.area();
+            rightCount[b] = accCount;
+        }
+        acc = AABB();
+        accCount = 0;
+        float bestCost = INFINITY;
+        int bestSplit = -1;
+        for (int b = 1; b < BinCount; b++) {
+            acc.grow(binBox[b - 1]);
+            accCount += binCount[b - 1];
+            if (accCount == 0 || rightCount[b] == 0)
+                continue;
+            float cost = acc.area() * accCount + rightArea[b] * rightCount[b];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+        if (bestSplit < 0) {
+            makeLeaf(nodeIndex, begin, end);
+            return;
+        }
+        PrimRef *mid = std::partition(refs.data() + begin, refs.data() + end,
+                                      [&](const PrimRef &r) { return binOf(r) < bestSplit; });
+        int midIndex = int(mid - refs.data());
+        buildNode(begin, midIndex, depth + 1);
+        int right = int(nodes.size());
+        buildNode(midIndex, end, depth + 1);
+        nodes[nodeIndex].offset = right;
+        nodes[nodeIndex].count = 0;
+    }
+};
+
+#endif //TCODE_BVH_BUILDER_H
@@ -0,0 +1,60 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_CAMERA_H
+#define TCODE_CAMERA_H
+
+#include <algorithm>
+#include <cmath>
+#include "my_math.h"
+
+const float CameraFOV = 40;         // 竖直方向的视场角（度）
+const float MaxCameraPitch = 89;    // 抬头、低头的上限，避免朝向与竖直方向平行
+
+// 针孔相机：位置、朝向和投影参数。朝向用yaw（绕竖直轴，0度看向-z，正值向左转）和pitch（正值抬头）表示，
+// 由my_math.h中的CameraMatrix44（UVN矩阵）求出相机的三个轴；视场角和宽高比取自PersProjInfo。
+// yaw = pitch = 0时与原来固定看向-z的相机完全相同
+class Camera {
+public:
+    Camera(const Vec3 &_position, float yaw, float pitch, const PersProjInfo &projection) : position(_position) {
+        float y = float(DegToRad(yaw)), p = float(DegToRad(pitch));
+        Vector3f target = {-sinf(y) * cosf(p), sinf(p), -cosf(y) * cosf(p)};
+        Vector3f up = {0, 1, 0};
+        Matrix44f m;
+        CameraMatrix44(m, target, up);
+        if (yaw == 0 && pitch == 0)       // 三角函数的舍入会让轴有一点偏差，默认朝向直接用坐标轴
+            m[0] = -1, m[4] = 0, m[8] = 0, m[1] = 0, m[5] = 1, m[9] = 0, m[2] = 0, m[6] = 0, m[10] = -1;
+        u = Vec3(m[0], m[4], m[8]);      // U = Up x N，指向相机左侧
+        v = Vec3(m[1], m[5], m[9]);
+        n = Vec3(m[2], m[6], m[10]);
+        tanHalfFOV = float(tan(DegToRad(projection.FOV / 2)));
+        aspect = projection.Width / projection.Height;
+        invWidth = 1 / projection.Width, invHeight = 1 / projection.Height;
+    }
+
+    const Vec3 &getPosition() const { return position; }
+
+    // 像素坐标(px, py)（可以是小数，像素中心为x+0.5）对应的光线方向，未归一化
+    Vec3 pixelDir(double px, double py) const {
+        float xx = (2 * (px * invWidth) - 1) * tanHalfFOV * aspect;
+        float yy = (1 - 2 * (py * invHeight)) * tanHalfFOV;
+        return n + v * yy - u * xx;
+    }
+
+    // 相机自己坐标系中的移动：right向右、up向上、ahead向前（沿水平方向，不随pitch上下）
+    static Vec3 Move(float yaw, float right, float up, float ahead) {
+        float y = float(DegToRad(yaw));
+        return Vec3(cosf(y) * right - sinf(y) * ahead, up, -sinf(y) * right - cosf(y) * ahead);
+    }
+
+    static float ClampPitch(float pitch) { return std::min(std::max(pitch, -MaxCameraPitch), MaxCameraPitch); }
+
+private:
+    Vec3 position;
+    Vec3 u, v, n;                        // 相机的左、上、前三个轴
+    float tanHalfFOV, aspect;
+    float invWidth, invHeight;
+};
+
+#endif //TCODE_CAMERA_H
@@ -0,0 +1,70 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_COUNTERS_H
+#define TCODE_COUNTERS_H
+
+#include <cstdint>
+
+// 统计的事件：各种光线数和各种求交测试数
+enum TraceCounter {
+    PrimaryRays, SecondaryRays, ShadowRays,
+    NodeTests,          // BVH结点的包围盒（或视锥）测试，包括网格内部的BVH
+    SphereTests, PlaneTests, TriangleTests, OtherTests,
+    CounterCount
+};
+
+const int DepthBins = 8;        // 弹射次数直方图的格数，更深的都算在最后一格
+
+// 一个线程的计数，只由这个线程写，按缓存行对齐，线程之间不会互相干扰
+struct alignas(64) TraceCounters {
+    uint64_t counts[CounterCount] = {};
+    uint64_t depth[DepthBins] = {};         // 按弹射次数统计追踪的光线（0是主光线）
+    uint64_t tiles = 0;                     // 画过的块数（每遍分别计）
+    double tileSeconds = 0;                 // 画块的总时间
+
+    void add(const TraceCounters &o) {
+        for (int i = 0; i < CounterCount; i++)
+            counts[i] += o.counts[i];
+        for (int i = 0; i < DepthBins; i++)
+            depth[i] += o.depth[i];
+        tiles += o.tiles;
+        tileSeconds += o.tileSeconds;
+    }
+
+    uint64_t rays() const { return counts[PrimaryRays] + counts[SecondaryRays] + counts[ShadowRays]; }
+
+    uint64_t tests() const {
+        return counts[NodeTests] + counts[SphereTests] + counts[PlaneTests] + counts[TriangleTests] + counts[OtherTests];
+    }
+};
+
+// 当前线程的计数器，nullptr表示不统计（默认）。求交函数先在局部变量里计数，查询结束时调用一次Count，
+// 不统计时只多一次判断
+inline thread_local TraceCounters *threadCounters = nullptr;
+
+inline void Count(TraceCounter counter, uint64_t n = 1) {
+    if (threadCounters != nullptr)
+        threadCounters->counts[counter] += n;
+}
+
+// 在局部变量里计数，离开作用域时一次加到当前线程的计数器上
+struct ScopedCount {
+    TraceCounter counter;
+    uint64_t n = 0;
+
+    explicit ScopedCount(TraceCounter _counter) : counter(_counter) {}
+
+    ~ScopedCount() { Count(counter, n); }
+};
+
+// 追踪了一条第depth次弹射的光线
+inline void CountRay(int depth) {
+    if (threadCounters == nullptr)
+        return;
+    threadCounters->counts[depth == 0 ? PrimaryRays : SecondaryRays]++;
+    threadCounters->depth[depth < DepthBins ? depth : DepthBins - 1]++;
+}
+
+#endif //TCODE_COUNTERS_H
@@ -0,0 +1,179 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+// 分布式渲染（见farm.h），不需要窗口和OpenGL：
+//   tcode_farm coordinator --scene 场景文件 [--listen 地址] [--output 图.ppm] [--spawn N] ...
+//   tcode_farm worker [--connect 地址] [--threads N]
+// 地址为tcp:主机:端口或unix:路径，默认tcp:127.0.0.1:7070。协调者加--spawn N时自己在本机启动N个worker进程
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include "farm.h"
+#include "scene_file.h"
+
+using namespace std;
+
+const char *DefaultFarmAddress = "tcp:127.0.0.1:7070";
+
+// 协调者的参数：--scene 场景文件，--listen 地址，--output 图.ppm（默认farm.ppm），--size 宽x高（默认1024x768），
+// --farm-tile N（分给worker的块边长，默认64，取--tile的整数倍），--tile N，--shadow-samples N，--initial-shadow-samples N，
+// --fixed-shadows，--no-packets，--recursive，--aa N，--aa-contrast x，--aa-error x，--aa-budget x，--lightmaps，
+// --lightmap-res N，--light-samples N（与窗口程序相同），
+// --timeout 秒（默认60），--spawn N（在本机启动N个worker），--threads N（启动的worker各用几个线程）
+static int Coordinator(int argc, char **argv, const char *self) {
+    const char *scenePath = nullptr, *address = DefaultFarmAddress, *output = "farm.ppm";
+    int width = 1024, height = 768, spawn = 0;
+    unsigned threads = 0;
+    FarmJob job;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--fixed-shadows") == 0) {
+            job.settings.adaptiveShadows = false;
+        } else if (strcmp(argv[i], "--no-packets") == 0) {
+            job.settings.packets = false;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            job.settings.wavefront = false;
+        } else if (strcmp(argv[i], "--lightmaps") == 0) {
+            job.settings.lightmaps = true;
+        } else if (i + 1 == argc) {
+            fprintf(stderr, "unknown or incomplete option '%s'\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--scene") == 0) {
+            scenePath = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0) {
+            address = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                fprintf(stderr, "malformed size '%s' (expected WIDTHxHEIGHT)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--farm-tile") == 0) {
+            job.farmTile = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--tile") == 0) {
+            job.settings.tileSize = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--shadow-samples") == 0) {
+            job.settings.shadowSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--initial-shadow-samples") == 0) {
+            job.settings.initialShadowSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--aa") == 0) {
+            job.settings.aaMaxSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--aa-contrast") == 0) {
+            job.settings.aaContrast = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--aa-error") == 0) {
+            job.settings.aaError = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--aa-budget") == 0) {
+            job.settings.aaBudget = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--lightmap-res") == 0) {
+            job.settings.lightmapTexels = max(float(atof(argv[++i])), 1.0f);
+        } else if (strcmp(argv[i], "--light-samples") == 0) {
+            job.settings.lightSamples = min(max(atoi(argv[++i]), 0), MaxLightSamples);
+        } else if (strcmp(argv[i], "--timeout") == 0) {
+            job.timeout = max(atof(argv[++i]), 1.0);
+        } else if (strcmp(argv[i], "--spawn") == 0) {
+            spawn = max(atoi(argv[++i]), 0);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = unsigned(max(atoi(argv[++i]), 0));
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (scenePath == nullptr) {
+        fprintf(stderr, "coordinator: --scene is required\n");
+        return 1;
+    }
+    // worker画的块由若干个渲染块组成，分界与本机渲染相同，图像逐像素一致
+    int tileSize = job.settings.tileSize;
+    job.farmTile = (job.farmTile + tileSize - 1) / tileSize * tileSize;
+
+    Scene scene;
+    bool cacheCurrent;
+    if (!LoadScene(scenePath, scene, &cacheCurrent))
+        return 1;
+    string cachePath = string(scenePath) + ".bin";
+    if (!cacheCurrent) {        // 磁盘上的缓存可能是旧场景，worker不检查源文件，会画错
+        fprintf(stderr, "%s: scene cache is not up to date, refusing to send it to workers\n", cachePath.c_str());
+        return 1;
+    }
+    if (!ReadWholeFile(cachePath.c_str(), job.sceneData)) {
+        fprintf(stderr, "%s: unable to read scene cache\n", cachePath.c_str());
+        return 1;
+    }
+    job.scene = &scene;
+
+    int listener = FarmSocket(address, true);
+    if (listener < 0)
+        return 1;
+    vector<pid_t> children;
+    string threadArg = to_string(threads);
+    printf("Coordinator: listening on %s, %dx%d image, %d-pixel tiles, scene %.1f KB\n", address, width, height,
+           job.farmTile, job.sceneData.size() / 1024.0);
+    fflush(stdout);         // 子进程不要再输出一遍缓冲里的内容
+    for (int i = 0; i < spawn; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            execlp(self, self, "worker", "--connect", address, "--threads", threadArg.c_str(), (char *) nullptr);
+            fprintf(stderr, "%s: unable to start worker\n", self);
+            _exit(127);
+        }
+        if (pid > 0)
+            children.push_back(pid);
+    }
+
+    FrameBuffer frame(width, height);
+    FarmStats stats;
+    bool ok = RenderOnFarm(listener, job, frame, stats);
+    close(listener);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+    for (pid_t pid: children)
+        waitpid(pid, nullptr, 0);
+    if (!ok)
+        return 1;
+    printf("Farm: %.3f s, %zu tiles, %d workers (%d lost), %zu tiles reassigned, %zu backup tiles\n", stats.seconds,
+           stats.tiles, stats.workers, stats.lost, stats.reassigned, stats.backups);
+    return frame.writePPM(output) ? 0 : 1;
+}
+
+// worker的参数：--connect 地址，--threads N；测试容错用的--fail-after N（画完N块后退出）和--slow 毫秒（每块多等一会儿）
+static int Worker(int argc, char **argv) {
+    const char *address = DefaultFarmAddress;
+    unsigned threads = 0;
+    int failAfter = 0, slowMs = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i + 1 == argc) {
+            fprintf(stderr, "unknown or incomplete option '%s'\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--connect") == 0) {
+            address = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = unsigned(max(atoi(argv[++i]), 0));
+        } else if (strcmp(argv[i], "--fail-after") == 0) {
+            failAfter = max(atoi(argv[++i]), 0);
+        } else if (strcmp(argv[i], "--slow") == 0) {
+            slowMs = max(atoi(argv[++i]), 0);
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    return RunFarmWorker(address, threads, failAfter, slowMs) ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    signal(SIGPIPE, SIG_IGN);       // 对方断开时send返回错误，不要让进程被信号杀掉
+    if (argc >= 2 && strcmp(argv[1], "coordinator") == 0)
+        return Coordinator(argc - 2, argv + 2, argv[0]);
+    if (argc >= 2 && strcmp(argv[1], "worker") == 0)
+        return Worker(argc - 2, argv + 2);
+    fprintf(stderr, "usage: %s coordinator --scene FILE [options] | worker [--connect ADDRESS] [options]\n", argv[0]);
+    return 1;
+}
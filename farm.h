@@ -0,0 +1,623 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_FARM_H
+#define TCODE_FARM_H
+
+// 分布式渲染：协调者把图像切成块分给多个worker进程，worker通过TCP或Unix域套接字连上协调者，
+// 收到场景（二进制场景缓存的内容，每个任务只传一次）后逐块渲染，把块的像素传回去。
+// 只支持POSIX系统。消息按本机字节序和结构体布局直接传，协调者和worker必须是同一种机器上编译的同一版程序，
+// 握手时检查版本号和BVH结点的大小
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "tracer.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0      // 没有这个标志的系统上由调用者忽略SIGPIPE
+#endif
+
+const uint32_t FarmProtocolVersion = 5;
+const int FarmInFlight = 2;             // 每个worker手上最多同时有几块，传输和渲染重叠
+const int FarmPollMs = 100;             // 等待消息时每隔多久检查一次整帧是否已经画完
+
+enum FarmMessageType : uint32_t {
+    HelloMessage,       // worker -> 协调者：FarmHelloRecord
+    JobMessage,         // 协调者 -> worker：FarmJobRecord，后面跟着场景缓存
+    TileMessage,        // 协调者 -> worker：FarmTileRecord
+    ResultMessage,      // worker -> 协调者：FarmTileRecord，后面跟着块的像素（每像素3个float，按行）
+    DoneMessage,        // 协调者 -> worker：没有更多的块了
+    ReadyMessage        // worker -> 协调者：场景已经加载、光照图已经烘焙，可以开始分块了
+};
+
+struct FarmMessage {    // 每条消息的头，后面跟bytes字节的内容
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t bytes;
+};
+
+struct FarmHelloRecord {
+    char magic[8];      // "TCFARM"
+    uint32_t version;
+    uint32_t nodeSize;  // sizeof(BVH::Node)，不同的结构体布局不能共用场景缓存
+    uint32_t threads;
+};
+
+struct FarmJobRecord {
+    uint32_t width, height;
+    float camera[3], yaw, pitch;
+    uint32_t tileSize, shadowSamples, initialShadowSamples;
+    uint32_t packets, wavefront, adaptiveShadows;
+    uint32_t aaMaxSamples;
+    float aaContrast, aaError, aaBudget;
+    uint32_t lightmaps;
+    float lightmapTexels;
+    uint32_t lightSamples;
+    uint64_t sceneBytes;
+};
+
+struct FarmTileRecord {
+    uint32_t index;     // 块在协调者的块列表中的下标
+    int32_t x0, y0, x1, y1;
+};
+
+// 解析地址："tcp:主机:端口"（"tcp::端口"监听所有网卡，"tcp:"可以省略）或"unix:路径"
+inline bool ParseFarmAddress(const char *address, bool &local, std::string &host, std::string &port) {
+    std::string s(address);
+    if (s.compare(0, 5, "unix:") == 0) {
+        local = true;
+        host = s.substr(5);
+        return !host.empty();
+    }
+    if (s.compare(0, 4, "tcp:") == 0)
+        s = s.substr(4);
+    size_t colon = s.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    local = false;
+    host = s.substr(0, colon);
+    port = s.substr(colon + 1);
+    return !port.empty();
+}
+
+// 按地址监听（listening为true）或者连接，返回套接字，失败时输出错误并返回-1
+inline int FarmSocket(const char *address, bool listening) {
+    bool local;
+    std::string host, port;
+    if (!ParseFarmAddress(address, local, host, port)) {
+        fprintf(stderr, "%s: malformed address (expected tcp:host:port or unix:path)\n", address);
+        return -1;
+    }
+    int fd = -1;
+    if (local) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (host.size() < sizeof(addr.sun_path)) {
+            memcpy(addr.sun_path, host.c_str(), host.size() + 1);
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listening)
+                unlink(host.c_str());       // 上次没有删掉的套接字文件
+            bool ok = fd >= 0 && (listening ? bind(fd, (sockaddr *) &addr, sizeof(addr)) == 0 && listen(fd, 64) == 0
+                                            : connect(fd, (sockaddr *) &addr, sizeof(addr)) == 0);
+            if (!ok && fd >= 0)
+                close(fd), fd = -1;
+        }
+    } else {
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        addrinfo *list = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &list) == 0) {
+            for (addrinfo *a = list; a != nullptr && fd < 0; a = a->ai_next) {
+                fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd < 0)
+                    continue;
+                int one = 1;
+                if (listening)
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                else
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                bool ok = listening ? bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, 64) == 0
+                                    : connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+                if (!ok)
+                    close(fd), fd = -1;
+            }
+            freeaddrinfo(list);
+        }
+    }
+    if (fd < 0)
+        fprintf(stderr, "%s: unable to %s\n", address, listening ? "listen" : "connect");
+    return fd;
+}
+
+inline bool SendAll(int fd, const void *data, size_t bytes) {
+    const char *p = static_cast<const char *>(data);
+    while (bytes > 0) {
+        ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n, bytes -= size_t(n);
+    }
+    return true;
+}
+
+inline bool RecvAll(int fd, void *data, size_t bytes) {
+    char *p = static_cast<char *>(data);
+    while (bytes > 0) {
+        ssize_t n = recv(fd, p, bytes, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n, bytes -= size_t(n);
+    }
+    return true;
+}
+
+// 发一条消息：记录后面可以再跟一段数据
+inline bool SendMessage(int fd, FarmMessageType type, const void *record, size_t recordBytes,
+                        const void *payload = nullptr, size_t payloadBytes = 0) {
+    FarmMessage header = {type, 0, recordBytes + payloadBytes};
+    return SendAll(fd, &header, sizeof(header)) && SendAll(fd, record, recordBytes) &&
+           SendAll(fd, payload, payloadBytes);
+}
+
+// 等到fd可读，返回false表示超过了deadline或者stop()为true
+template<class StopFn>
+bool WaitReadable(int fd, std::chrono::steady_clock::time_point deadline, StopFn stop) {
+    for (;;) {
+        if (stop() || std::chrono::steady_clock::now() >= deadline)
+            return false;
+        pollfd p = {fd, POLLIN, 0};
+        int n = poll(&p, 1, FarmPollMs);
+        if (n > 0)
+            return true;
+        if (n < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+// 协调者的任务表：还没分配的块排成队列，记录每块有哪些worker正在画。队列空了以后，空闲的worker再领一块
+// 别人正在画、等得最久、还没有备份的块（备份任务），谁先交回用谁的，慢的worker拖不住整帧；
+// worker断开或超时后，它手上只有它在画的块回到队列
+class FarmSchedule {
+public:
+    explicit FarmSchedule(size_t tileCount) : tiles(tileCount), remaining(tileCount) {
+        for (uint32_t i = 0; i < tileCount; i++)
+            queue.push_back(i);
+    }
+
+    // 给worker分配一块。没有可分配的块时，wait为true就一直等到有块回到队列、整帧画完或者stop()，否则返回false
+    bool next(int worker, bool wait, uint32_t &index) {
+        std::unique_lock<std::mutex> lk(lock);
+        for (;;) {
+            if (remaining == 0 || stopped)
+                return false;
+            while (!queue.empty()) {
+                uint32_t i = queue.front();
+                queue.pop_front();
+                if (!tiles[i].done) {
+                    assign(i, worker);
+                    index = i;
+                    return true;
+                }
+            }
+            int best = -1;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                const TileState &t = tiles[i];
+                if (t.done || t.holders.size() != 1 || t.holders[0] == worker)     // 它自己手上的块不能再给它
+                    continue;
+                if (best < 0 || t.assigned < tiles[best].assigned)
+                    best = int(i);
+            }
+            if (best >= 0) {
+                assign(uint32_t(best), worker);
+                backups++;
+                index = uint32_t(best);
+                return true;
+            }
+            if (!wait)
+                return false;
+            changed.wait(lk);
+        }
+    }
+
+    // worker交回一块，返回true表示这是第一份结果，应该写进图像
+    bool complete(int worker, uint32_t index) {
+        std::lock_guard<std::mutex> lk(lock);
+        TileState &t = tiles[index];
+        t.drop(worker);
+        if (t.done)
+            return false;
+        t.done = true;
+        if (--remaining == 0)
+            changed.notify_all();
+        return true;
+    }
+
+    // worker断开，它手上的块如果没有别人在画就回到队列
+    void release(int worker, const std::vector<uint32_t> &held) {
+        std::lock_guard<std::mutex> lk(lock);
+        for (uint32_t i: held) {
+            TileState &t = tiles[i];
+            t.drop(worker);
+            if (!t.done && t.holders.empty()) {
+                queue.push_front(i);
+                reassigned++;
+            }
+        }
+        changed.notify_all();
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lk(lock);
+        stopped = true;
+        changed.notify_all();
+    }
+
+    bool finished() {
+        std::lock_guard<std::mutex> lk(lock);
+        return remaining == 0 || stopped;
+    }
+
+    bool complete() {
+        std::lock_guard<std::mutex> lk(lock);
+        return remaining == 0;
+    }
+
+    size_t getReassigned() {
+        std::lock_guard<std::mutex> lk(lock);
+        return reassigned;
+    }
+
+    size_t getBackups() {
+        std::lock_guard<std::mutex> lk(lock);
+        return backups;
+    }
+
+private:
+    struct TileState {
+        bool done = false;
+        std::vector<int> holders;   // 正在画这一块的worker，最多两个（一份备份）
+        std::chrono::steady_clock::time_point assigned;
+
+        void drop(int worker) {
+            auto it = std::find(holders.begin(), holders.end(), worker);
+            if (it != holders.end())
+                holders.erase(it);
+        }
+    };
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<TileState> tiles;
+    std::deque<uint32_t> queue;
+    size_t remaining;
+    size_t reassigned = 0, backups = 0;
+    bool stopped = false;
+
+    void assign(uint32_t i, int worker) {
+        TileState &t = tiles[i];
+        if (t.holders.empty())
+            t.assigned = std::chrono::steady_clock::now();
+        t.holders.push_back(worker);
+    }
+};
+
+struct FarmJob {
+    const Scene *scene;
+    std::string sceneData;      // 场景缓存文件的内容
+    RenderSettings settings;
+    int farmTile = 64;          // 分给worker的块的边长，是settings.tileSize的整数倍
+    double timeout = 60;        // worker准备好以后这么多秒没有交回任何块就断开它；没有worker连着时也等这么久
+};
+
+struct FarmStats {
+    double seconds = 0;
+    size_t tiles = 0;
+    int workers = 0;            // 连上来的worker数
+    int lost = 0;               // 中途断开或超时的worker数
+    size_t reassigned = 0;      // 因为worker断开而重新分配的块
+    size_t backups = 0;         // 备份任务数
+};
+
+// 协调者：在listener上接受worker的连接，每个连接一个线程，把job中的场景传给它，再按任务表分块，
+// 收回的像素写进frame。整帧画完返回true；没有worker可用超过job.timeout秒时返回false
+inline bool RenderOnFarm(int listener, const FarmJob &job, FrameBuffer &frame, FarmStats &stats) {
+    auto begin = std::chrono::steady_clock::now();
+    const int width = frame.getWidth(), height = frame.getHeight();
+    std::vector<Tile> tiles = MakeTiles(width, height, job.farmTile);
+    FarmSchedule schedule(tiles.size());
+    FarmJobRecord record;
+    memset(&record, 0, sizeof(record));
+    record.width = uint32_t(width);
+    record.height = uint32_t(height);
+    StoreVec3(record.camera, job.scene->camera);
+    record.yaw = job.scene->cameraYaw;
+    record.pitch = job.scene->cameraPitch;
+    record.tileSize = uint32_t(job.settings.tileSize);
+    record.shadowSamples = uint32_t(job.settings.shadowSamples);
+    record.initialShadowSamples = uint32_t(job.settings.initialShadowSamples);
+    record.packets = job.settings.packets;
+    record.wavefront = job.settings.wavefront;
+    record.adaptiveShadows = job.settings.adaptiveShadows;
+    record.aaMaxSamples = uint32_t(job.settings.aaMaxSamples);
+    record.aaContrast = job.settings.aaContrast;
+    record.aaError = job.settings.aaError;
+    record.aaBudget = job.settings.aaBudget;
+    record.lightmaps = job.settings.lightmaps;
+    record.lightmapTexels = job.settings.lightmapTexels;
+    record.lightSamples = uint32_t(job.settings.lightSamples);
+    record.sceneBytes = job.sceneData.size();
+    auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(job.timeout));
+    std::mutex statsLock;
+    std::atomic<int> active(0);
+
+    // 一个worker连接：握手、传场景，之后一直分块、收结果，直到整帧画完或者连接出错
+    auto serve = [&](int fd, int id) {
+        auto stop = [&]() { return schedule.finished(); };
+        std::vector<uint32_t> held;
+        std::vector<float> pixels;
+        FarmMessage header;
+        FarmHelloRecord hello;
+        bool ok = WaitReadable(fd, std::chrono::steady_clock::now() + timeout, stop) &&
+                  RecvAll(fd, &header, sizeof(header)) && header.type == HelloMessage &&
+                  header.bytes == sizeof(hello) && RecvAll(fd, &hello, sizeof(hello));
+        if (ok && (memcmp(hello.magic, "TCFARM", 7) != 0 || hello.version != FarmProtocolVersion ||
+                   hello.nodeSize != sizeof(BVH::Node))) {
+            fprintf(stderr, "worker %d: incompatible build, disconnected\n", id);
+            close(fd);
+            active--;
+            return;
+        }
+        ok = ok && SendMessage(fd, JobMessage, &record, sizeof(record), job.sceneData.data(), job.sceneData.size());
+        // 等worker加载场景、烘焙光照图，这段时间不计入超时（烘焙可能比timeout还长），连接仍然算作活跃。
+        // worker出错退出时连接断开，RecvAll失败
+        ok = ok && WaitReadable(fd, std::chrono::steady_clock::time_point::max(), stop) &&
+             RecvAll(fd, &header, sizeof(header)) && header.type == ReadyMessage && header.bytes == 0;
+        if (ok)
+            printf("Worker %d: connected, %u threads\n", id, hello.threads);
+        size_t done = 0;
+        while (ok) {
+            uint32_t index;
+            while (int(held.size()) < FarmInFlight && schedule.next(id, held.empty(), index)) {
+                const Tile &t = tiles[index];
+                FarmTileRecord tile = {index, t.x0, t.y0, t.x1, t.y1};
+                if (!SendMessage(fd, TileMessage, &tile, sizeof(tile))) {
+                    held.push_back(index);
+                    ok = false;
+                    break;
+                }
+                held.push_back(index);
+            }
+            if (!ok || held.empty())
+                break;
+            if (!WaitReadable(fd, std::chrono::steady_clock::now() + timeout, stop)) {
+                ok = schedule.finished();     // 整帧已经画完，手上剩下的只是备份任务
+                break;
+            }
+            FarmTileRecord tile;
+            ok = RecvAll(fd, &header, sizeof(header)) && header.type == ResultMessage &&
+                 header.bytes >= sizeof(tile) && RecvAll(fd, &tile, sizeof(tile));
+            auto it = ok ? std::find(held.begin(), held.end(), tile.index) : held.end();
+            if (it == held.end()) {        // 不是交给它的块，按协议出错处理：断开并重新分配它手上的块
+                ok = false;
+                break;
+            }
+            const Tile &t = tiles[tile.index];
+            size_t count = size_t(t.x1 - t.x0) * (t.y1 - t.y0) * 3;
+            pixels.resize(count);
+            ok = header.bytes == sizeof(tile) + count * sizeof(float) &&
+                 RecvAll(fd, pixels.data(), count * sizeof(float));
+            if (!ok)
+                break;
+            held.erase(it);
+            if (schedule.complete(id, tile.index)) {
+                const float *c = pixels.data();
+                for (int y = t.y0; y < t.y1; y++) {
+                    for (int x = t.x0; x < t.x1; x++, c += 3)
+                        frame.set(x, y, c);
+                }
+                frame.markDirty(t.x0, t.y0, t.x1, t.y1);
+                frame.publish();
+                done++;
+            }
+        }
+        if (!held.empty())
+            schedule.release(id, held);
+        bool lost = !ok && !schedule.complete();
+        if (lost)
+            fprintf(stderr, "worker %d: connection lost or timed out after %zu tiles, %zu tiles reassigned\n", id, done,
+                    held.size());
+        else
+            SendMessage(fd, DoneMessage, nullptr, 0);
+        close(fd);
+        {
+            std::lock_guard<std::mutex> lk(statsLock);
+            stats.lost += lost ? 1 : 0;
+        }
+        active--;
+    };
+
+    std::vector<std::thread> connections;
+    auto idleSince = std::chrono::steady_clock::now();
+    bool ok = true;
+    while (!schedule.finished()) {
+        pollfd p = {listener, POLLIN, 0};
+        if (poll(&p, 1, FarmPollMs) > 0) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));     // Unix域套接字上会失败，不影响
+                active++;
+                connections.emplace_back(serve, fd, int(connections.size()));
+            }
+        }
+        if (active > 0) {
+            idleSince = std::chrono::steady_clock::now();
+        } else if (std::chrono::steady_clock::now() - idleSince > timeout) {
+            fprintf(stderr, "no workers connected for %.0f s, giving up\n", job.timeout);
+            schedule.stop();
+            ok = false;
+        }
+    }
+    for (std::thread &t: connections)
+        t.join();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    stats.tiles = tiles.size();
+    stats.workers = int(connections.size());
+    stats.reassigned = schedule.getReassigned();
+    stats.backups = schedule.getBackups();
+    return ok;
+}
+
+// worker：连上协调者，收到场景后加载场景、烘焙光照图，发ReadyMessage，再逐块渲染并把像素传回去，直到收到DoneMessage。
+// 场景缓存写进临时文件再映射，与本机加载缓存文件的做法相同。failAfter（大于0时）和slowMs用来测试协调者的容错：
+// 画完failAfter块后直接退出，每块多等slowMs毫秒
+inline bool RunFarmWorker(const char *address, unsigned threads, int failAfter = 0, int slowMs = 0) {
+    int fd = FarmSocket(address, false);
+    if (fd < 0)
+        return false;
+    FarmHelloRecord hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, "TCFARM", 7);
+    hello.version = FarmProtocolVersion;
+    hello.nodeSize = sizeof(BVH::Node);
+    hello.threads = threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+    FarmMessage header;
+    FarmJobRecord job;
+    std::string sceneData;
+    bool ok = SendMessage(fd, HelloMessage, &hello, sizeof(hello)) && RecvAll(fd, &header, sizeof(header)) &&
+              header.type == JobMessage && header.bytes >= sizeof(job) && RecvAll(fd, &job, sizeof(job)) &&
+              header.bytes == sizeof(job) + job.sceneBytes;
+    if (ok) {
+        sceneData.resize(size_t(job.sceneBytes));
+        ok = RecvAll(fd, &sceneData[0], sceneData.size());
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: no job received from coordinator\n", address);
+        close(fd);
+        return false;
+    }
+
+    Scene scene;
+    char path[] = "/tmp/tcode_farm_XXXXXX";
+    int temp = mkstemp(path);
+    ok = temp >= 0 && write(temp, sceneData.data(), sceneData.size()) == ssize_t(sceneData.size());
+    if (temp >= 0)
+        close(temp);
+    ok = ok && LoadSceneCache(path, scene, 0, 0, false);
+    if (temp >= 0)
+        unlink(path);       // 映射之后删掉文件，映射的内存一直有效
+    if (!ok) {
+        fprintf(stderr, "%s: unable to load the scene sent by the coordinator\n", address);
+        close(fd);
+        return false;
+    }
+    sceneData = std::string();
+    scene.cameraYaw = job.yaw;
+    scene.cameraPitch = job.pitch;
+    scene.camera = LoadVec3(job.camera);
+    RenderSettings settings;
+    settings.threads = threads;
+    settings.tileSize = int(job.tileSize);
+    settings.shadowSamples = int(job.shadowSamples);
+    settings.initialShadowSamples = int(job.initialShadowSamples);
+    settings.packets = job.packets != 0;
+    settings.wavefront = job.wavefront != 0;
+    settings.adaptiveShadows = job.adaptiveShadows != 0;
+    settings.aaMaxSamples = int(job.aaMaxSamples);
+    settings.aaContrast = job.aaContrast;
+    settings.aaError = job.aaError;
+    settings.aaBudget = job.aaBudget;
+    settings.lightmaps = job.lightmaps != 0;
+    settings.lightmapTexels = job.lightmapTexels;
+    settings.lightSamples = int(job.lightSamples);
+    settings.coarseStride = 1;
+    Lightmaps lightmaps;
+    Tracer tracer(scene, settings, settings.lightmaps ? &lightmaps : nullptr);
+    RenderContext context(settings, int(job.width), int(job.height), false);
+    if (settings.lightmaps)     // 与协调者本机渲染时一样在相机设好之后烘焙，光照图逐纹素一致
+        BakeLightmaps(lightmaps, tracer, context.pool);
+    if (!SendMessage(fd, ReadyMessage, nullptr, 0)) {     // 准备好了，协调者从这时开始分块、计算超时
+        fprintf(stderr, "%s: connection to coordinator lost\n", address);
+        close(fd);
+        return false;
+    }
+    std::unique_ptr<FrameBuffer> frame;     // 只存放当前这一块，遇到更大的块时重新分配
+    std::atomic<bool> cancel(false);
+    std::vector<float> pixels;
+    int rendered = 0;
+    printf("Worker: %zu objects, %ux%u image, %u threads\n", scene.objects.size(), job.width, job.height,
+           context.pool.size());
+    for (;;) {
+        FarmTileRecord tile;
+        if (!RecvAll(fd, &header, sizeof(header)) || header.type == DoneMessage)
+            break;
+        ok = header.type == TileMessage && header.bytes == sizeof(tile) && RecvAll(fd, &tile, sizeof(tile)) &&
+             tile.x0 >= 0 && tile.y0 >= 0 && tile.x0 < tile.x1 && tile.y0 < tile.y1 &&
+             tile.x1 <= int(job.width) && tile.y1 <= int(job.height);
+        if (!ok) {
+            fprintf(stderr, "%s: malformed message from coordinator\n", address);
+            break;
+        }
+        // 一遍画完（步长1），结果与本机渐进渲染的最后结果相同
+        int tileWidth = tile.x1 - tile.x0, tileHeight = tile.y1 - tile.y0;
+        if (frame == nullptr || frame->getWidth() < tileWidth || frame->getHeight() < tileHeight)
+            frame.reset(new FrameBuffer(tileWidth, tileHeight));
+        frame->setOrigin(tile.x0, tile.y0);
+        context.tiles = SplitTile({tile.x0, tile.y0, tile.x1, tile.y1}, settings.tileSize);
+        RenderStats stats;
+        RenderFrame(context, tracer, *frame, cancel, stats, [](int, int) {});
+        if (slowMs > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(slowMs));
+        pixels.clear();
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                for (int c = 0; c < 3; c++)
+                    pixels.push_back(frame->get(x, y, c));
+            }
+        }
+        if (!SendMessage(fd, ResultMessage, &tile, sizeof(tile), pixels.data(), pixels.size() * sizeof(float)))
+            break;
+        if (++rendered == failAfter) {
+            fprintf(stderr, "worker: exiting after %d tiles (--fail-after)\n", rendered);
+            _exit(1);
+        }
+    }
+    printf("Worker: rendered %d tiles\n", rendered);
+    close(fd);
+    return ok;
+}
+
+#endif //TCODE_FARM_H
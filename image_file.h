@@ -0,0 +1,337 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_IMAGE_FILE_H
+#define TCODE_IMAGE_FILE_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "renderer.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+enum ImageFormat {
+    PPMImage,       // 8位RGB（P6）
+    PFMImage,       // 32位浮点RGB，保留超出[0, 1]的值
+    PNGImage        // 8位RGB，不压缩（deflate的存储块），不依赖zlib
+};
+
+// 按扩展名（.ppm/.pfm/.png，不区分大小写）判断格式，不认识时返回false
+inline bool ImageFormatFromPath(const char *path, ImageFormat &format) {
+    std::string ext(path);
+    size_t dot = ext.rfind('.');
+    ext = dot == std::string::npos ? "" : ext.substr(dot + 1);
+    for (char &c: ext)
+        c = char(tolower((unsigned char) c));
+    if (ext == "ppm")
+        format = PPMImage;
+    else if (ext == "pfm")
+        format = PFMImage;
+    else if (ext == "png")
+        format = PNGImage;
+    else
+        return false;
+    return true;
+}
+
+// 边写边输出的图像文件：按从上到下的顺序一次交一带（若干整行），不需要整幅图像在内存里。
+// PFM规定从最下面一行开始存，每行长度固定，按行号直接定位写入
+class ImageFile {
+public:
+    ImageFile() = default;
+
+    ImageFile(const ImageFile &) = delete;
+    ImageFile &operator=(const ImageFile &) = delete;
+
+    ~ImageFile() {
+        if (file != nullptr)
+            fclose(file);
+    }
+
+    bool open(const char *_path, ImageFormat _format, int _width, int _height) {
+        path = _path;
+        format = _format;
+        width = _width, height = _height;
+        nextRow = 0;
+        seekFailed = false;
+        file = fopen(_path, "wb");
+        if (file == nullptr) {
+            fprintf(stderr, "%s: unable to write image\n", _path);
+            return false;
+        }
+        if (format == PPMImage) {
+            fprintf(file, "P6\n%d %d\n255\n", width, height);
+        } else if (format == PFMImage) {
+            fprintf(file, "PF\n%d %d\n%s\n", width, height, LittleEndian() ? "-1.0" : "1.0");
+            dataStart = Tell(file);
+        } else {
+            static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+            fwrite(signature, 1, 8, file);
+            unsigned char ihdr[13];
+            PutBE32(ihdr, uint32_t(width));
+            PutBE32(ihdr + 4, uint32_t(height));
+            ihdr[8] = 8, ihdr[9] = 2, ihdr[10] = 0, ihdr[11] = 0, ihdr[12] = 0;  // 8位RGB，不隔行
+            writeChunk("IHDR", ihdr, sizeof(ihdr));
+            adlerA = 1, adlerB = 0;
+        }
+        return ok();
+    }
+
+    // 写入[band.originY, band.originY + rows)这几行，必须紧接着上一带
+    bool write(const FrameBuffer &band, int rows) {
+        int y0 = band.getOriginY();
+        if (file == nullptr || y0 != nextRow || rows <= 0 || y0 + rows > height)
+            return false;
+        if (format == PFMImage) {
+            std::vector<float> &row = floats;
+            row.resize(size_t(width) * 3);
+            for (int y = y0; y < y0 + rows; y++) {
+                for (int x = 0; x < width; x++) {
+                    for (int c = 0; c < 3; c++)
+                        row[size_t(x) * 3 + c] = band.get(x, y, c);
+                }
+                // 大图的偏移会超过2 GiB，Windows上long只有32位，用64位的偏移
+                int64_t offset = dataStart + int64_t(height - 1 - y) * int64_t(row.size() * sizeof(float));
+                if (!Seek(file, offset)) {
+                    seekFailed = true;
+                    return false;
+                }
+                fwrite(row.data(), sizeof(float), row.size(), file);
+            }
+        } else {
+            // PNG每行前面有一个过滤方式字节（0表示不过滤）
+            size_t prefix = format == PNGImage ? 1 : 0, rowBytes = prefix + size_t(width) * 3;
+            bytes.resize(rowBytes * rows);
+            rgba.resize(size_t(width) * 4);
+            for (int y = y0; y < y0 + rows; y++) {
+                unsigned char *out = &bytes[rowBytes * (y - y0)];
+                band.toRGBA8(0, y, width, y + 1, rgba.data(), rgba.size());
+                if (prefix)
+                    *out++ = 0;
+                for (int x = 0; x < width; x++)
+                    out[x * 3] = rgba[x * 4], out[x * 3 + 1] = rgba[x * 4 + 1], out[x * 3 + 2] = rgba[x * 4 + 2];
+            }
+            if (format == PPMImage)
+                fwrite(bytes.data(), 1, bytes.size(), file);
+            else
+                writeIDAT(y0 + rows == height);
+        }
+        nextRow = y0 + rows;
+        return ok();
+    }
+
+    // 所有行都写完之后调用
+    bool close() {
+        if (file == nullptr)
+            return false;
+        bool complete = nextRow == height;
+        if (format == PNGImage && complete)
+            writeChunk("IEND", nullptr, 0);
+        bool good = ok() && complete;
+        good = fclose(file) == 0 && good;
+        file = nullptr;
+        if (!good)
+            fprintf(stderr, "%s: unable to write image\n", path.c_str());
+        return good;
+    }
+
+private:
+    FILE *file = nullptr;
+    std::string path;
+    ImageFormat format = PPMImage;
+    int width = 0, height = 0;
+    int nextRow = 0;
+    int64_t dataStart = 0;
+    bool seekFailed = false;
+    uint32_t adlerA = 1, adlerB = 0;        // zlib数据的Adler-32校验
+    std::vector<unsigned char> bytes, rgba, chunk;
+    std::vector<float> floats;
+
+    bool ok() const { return file != nullptr && ferror(file) == 0 && !seekFailed; }
+
+    static bool Seek(FILE *f, int64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+        return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    static int64_t Tell(FILE *f) {
+#ifdef _WIN32
+        return _ftelli64(f);
+#else
+        return int64_t(ftello(f));
+#endif
+    }
+
+    static bool LittleEndian() {
+        uint16_t one = 1;
+        unsigned char first;
+        memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    static void PutBE32(unsigned char *p, uint32_t v) {
+        p[0] = (unsigned char) (v >> 24), p[1] = (unsigned char) (v >> 16), p[2] = (unsigned char) (v >> 8),
+        p[3] = (unsigned char) v;
+    }
+
+    static uint32_t CRC32(uint32_t crc, const unsigned char *data, size_t n) {
+        static const std::vector<uint32_t> table = []() {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < n; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void writeChunk(const char *type, const unsigned char *data, size_t n) {
+        unsigned char head[8];
+        PutBE32(head, uint32_t(n));
+        memcpy(head + 4, type, 4);
+        uint32_t crc = CRC32(CRC32(0, head + 4, 4), data, n);
+        unsigned char tail[4];
+        PutBE32(tail, crc);
+        fwrite(head, 1, 8, file);
+        if (n > 0)
+            fwrite(data, 1, n, file);
+        fwrite(tail, 1, 4, file);
+    }
+
+    // 把bytes中的几行作为一个IDAT块写出：整个zlib流跨越各个IDAT块，第一块前加zlib头，最后一块加Adler-32
+    void writeIDAT(bool last) {
+        const size_t MaxStored = 65535;
+        chunk.clear();
+        if (nextRow == 0)
+            chunk.push_back(0x78), chunk.push_back(0x01);
+        for (size_t at = 0; at < bytes.size(); at += MaxStored) {
+            size_t n = std::min(MaxStored, bytes.size() - at);
+            bool final = last && at + n == bytes.size();
+            chunk.push_back(final ? 1 : 0);
+            chunk.push_back((unsigned char) n), chunk.push_back((unsigned char) (n >> 8));
+            chunk.push_back((unsigned char) ~n), chunk.push_back((unsigned char) (~n >> 8));
+            chunk.insert(chunk.end(), bytes.begin() + long(at), bytes.begin() + long(at + n));
+        }
+        for (size_t i = 0; i < bytes.size();) {     // 每5552个字节取一次模，中间不会溢出
+            size_t end = std::min(bytes.size(), i + 5552);
+            for (; i < end; i++)
+                adlerA += bytes[i], adlerB += adlerA;
+            adlerA %= 65521, adlerB %= 65521;
+        }
+        if (last) {
+            unsigned char adler[4];
+            PutBE32(adler, (adlerB << 16) | adlerA);
+            chunk.insert(chunk.end(), adler, adler + 4);
+        }
+        writeChunk("IDAT", chunk.data(), chunk.size());
+    }
+};
+
+// 后台写文件的线程：渲染线程从acquire()拿一个空的带缓冲，画好后submit()，写线程按顺序编码写出再把缓冲还回来。
+// 只有bands个带缓冲，渲染比写文件快时acquire()等待，内存不会超过bands带；编码和光线追踪同时进行
+class BandWriter {
+public:
+    BandWriter(ImageFile &_file, int width, int bandRows, int bands) : file(_file) {
+        for (int i = 0; i < bands; i++) {
+            buffers.emplace_back(new FrameBuffer(width, bandRows));
+            free.push_back(buffers.back().get());
+        }
+        writer = std::thread(&BandWriter::run, this);
+    }
+
+    ~BandWriter() { finish(); }
+
+    // 取一个空的带缓冲，已经出错时返回nullptr
+    FrameBuffer *acquire() {
+        std::unique_lock<std::mutex> lk(lock);
+        changed.wait(lk, [&]() { return !free.empty() || failed; });
+        if (failed)
+            return nullptr;
+        FrameBuffer *band = free.front();
+        free.pop_front();
+        return band;
+    }
+
+    // 交出画好的一带，有效的是从band->getOriginY()开始的rows行
+    void submit(FrameBuffer *band, int rows) {
+        std::lock_guard<std::mutex> lk(lock);
+        filled.push_back({band, rows});
+        changed.notify_all();
+    }
+
+    // 等所有交出的带写完，返回是否都写成功了
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            stopping = true;
+            changed.notify_all();
+        }
+        if (writer.joinable())
+            writer.join();
+        return !failed;
+    }
+
+    double getWriteSeconds() const { return writeSeconds; }
+
+private:
+    struct Band {
+        FrameBuffer *buffer;
+        int rows;
+    };
+
+    ImageFile &file;
+    std::vector<std::unique_ptr<FrameBuffer>> buffers;
+    std::deque<FrameBuffer *> free;
+    std::deque<Band> filled;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+    bool stopping = false, failed = false;
+    double writeSeconds = 0;    // 写线程编码、写文件的总时间，只由写线程写，finish之后读
+
+    void run() {
+        for (;;) {
+            Band band;
+            {
+                std::unique_lock<std::mutex> lk(lock);
+                changed.wait(lk, [&]() { return !filled.empty() || stopping; });
+                if (filled.empty())
+                    return;
+                band = filled.front();
+                filled.pop_front();
+            }
+            auto begin = std::chrono::steady_clock::now();
+            bool ok = file.write(*band.buffer, band.rows);
+            writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            std::lock_guard<std::mutex> lk(lock);
+            failed = failed || !ok;
+            free.push_back(band.buffer);
+            changed.notify_all();
+        }
+    }
+};
+
+#endif //TCODE_IMAGE_FILE_H
@@ -0,0 +1,354 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_LIGHTMAP_H
+#define TCODE_LIGHTMAP_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "objects.h"
+#include "object_store.h"
+#include "renderer.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+const int MaxLightmapSide = 4096;      // 一张光照图每边最多的纹素数
+const int MinSphereLightmapSide = 8;   // 球的光照图经度方向最少的纹素数
+
+// 一个表面对一个光源的可见度图：每个纹素存放纹素中心看到光源的比例（0 ~ 1），着色时双线性插值。
+// 平面按两条切线方向铺成网格；球按经纬度展开，经度方向首尾相接
+struct Lightmap {
+    ObjectId surface;
+    uint32_t light;
+    Vec3 origin, axisU, axisV;  // 平面：网格的一角和两条切线；球：origin为球心
+    float texel = 0;            // 平面上纹素的边长
+    float radius = 0;           // 球的半径
+    int width = 0, height = 0;
+    AABB reach;                 // 表面（平面只算网格范围）和光源的包围盒，遮挡物碰不到它就不影响这张图
+    int dirty[4] = {0, 0, 0, 0};    // 需要重新烘焙的纹素 [dirty[0], dirty[2]) x [dirty[1], dirty[3])
+    std::vector<float> visibility;
+
+    void markAll() { dirty[0] = dirty[1] = 0, dirty[2] = width, dirty[3] = height; }
+
+    void mark(const int rect[4]) {
+        if (rect[0] >= rect[2] || rect[1] >= rect[3])
+            return;
+        if (dirty[0] >= dirty[2] || dirty[1] >= dirty[3]) {
+            std::copy(rect, rect + 4, dirty);
+            return;
+        }
+        dirty[0] = std::min(dirty[0], rect[0]), dirty[1] = std::min(dirty[1], rect[1]);
+        dirty[2] = std::max(dirty[2], rect[2]), dirty[3] = std::max(dirty[3], rect[3]);
+    }
+
+    int dirtyCount() const { return std::max(dirty[2] - dirty[0], 0) * std::max(dirty[3] - dirty[1], 0); }
+
+    // 第(i, j)个纹素的中心
+    Vec3 position(int i, int j) const {
+        if (GetObjectType(surface) == PLANE)
+            return origin + axisU * ((float(i) + 0.5f) * texel) + axisV * ((float(j) + 0.5f) * texel);
+        float phi = (float(i) + 0.5f) / float(width) * 2 * float(M_PI) - float(M_PI);
+        float theta = (float(j) + 0.5f) / float(height) * float(M_PI);
+        return origin + Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)) * radius;
+    }
+};
+
+// 平面和球的光照可见度缓存。光源和大部分物体不动时，着色点直接插值可见度，不再发阴影光线。
+// update在场景变化之后调用，只重新烘焙受影响的图：光源移动或改变大小、表面本身移动的图整张重新烘焙；
+// 有物体移动时，它移动前后的包围盒碰到reach的球的图整张重新烘焙，平面的图只重新烘焙包围盒的影子落在的那部分纹素。
+// 平面、光源、物体的个数或者阴影设置变了时全部重建。
+// 没有包围盒的其他物体（GENERIC）看不出是否移动，当作不动
+class Lightmaps {
+public:
+    struct Stats {
+        size_t maps = 0, texels = 0;    // 图的个数和纹素总数
+        size_t baked = 0;               // 上次update重新烘焙的纹素数
+        double bakeMs = 0;              // 上次update的耗时
+    };
+
+    // visibility(纹素中心, 光源)返回该点看到光源的比例；按纹素中心计算，结果与线程数无关。返回重新烘焙的纹素数
+    template<class VisibilityFn>
+    size_t update(const Scene &scene, const RenderSettings &settings, ThreadPool &pool, VisibilityFn visibility) {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<AABB> bounds = OccluderBounds(scene.objects);
+        if (!sameSetup(scene, settings, bounds)) {
+            create(scene, settings);
+        } else {
+            std::vector<AABB> moved;        // 移动的物体移动前后的范围
+            for (size_t i = 0; i < bounds.size(); i++) {
+                if (!SameBox(bounds[i], occluders[i])) {
+                    AABB box = occluders[i];
+                    box.grow(bounds[i]);
+                    moved.push_back(box);
+                }
+            }
+            for (Lightmap &map: maps) {
+                const Light &light = *scene.lights[map.light];
+                bool changed = light.position != lights[map.light].position || light.r != lights[map.light].r;
+                if (GetObjectType(map.surface) == SPHERE) {
+                    const Sphere &sphere = scene.objects.spheres[GetObjectIndex(map.surface)];
+                    changed = changed || sphere.getCenter() != map.origin || sphere.getRadius() != map.radius;
+                }
+                if (changed) {
+                    place(map, scene);
+                    map.markAll();
+                    continue;
+                }
+                bool plane = GetObjectType(map.surface) == PLANE;
+                for (size_t k = 0; k < moved.size() && map.dirtyCount() < int(map.visibility.size()); k++) {
+                    if (!moved[k].overlaps(map.reach))
+                        continue;
+                    int rect[4] = {0, 0, map.width, map.height};
+                    if (plane)
+                        Footprint(map, scene.objects.planes[GetObjectIndex(map.surface)], light, moved[k], rect);
+                    map.mark(rect);
+                }
+            }
+        }
+        occluders = bounds;
+        lights.clear();
+        for (const Light *light: scene.lights)
+            lights.push_back(*light);
+
+        // 按行分给各线程
+        std::vector<std::pair<uint32_t, int>> rows;
+        for (uint32_t m = 0; m < maps.size(); m++) {
+            maps[m].visibility.resize(size_t(maps[m].width) * maps[m].height);
+            for (int j = maps[m].dirty[1]; j < maps[m].dirty[3] && maps[m].dirtyCount() > 0; j++)
+                rows.push_back({m, j});
+        }
+        pool.parallelFor(int(rows.size()), [&](int task, int) {
+            Lightmap &map = maps[rows[task].first];
+            const Light &light = *scene.lights[map.light];
+            int j = rows[task].second;
+            for (int i = map.dirty[0]; i < map.dirty[2]; i++)
+                map.visibility[size_t(j) * map.width + i] = visibility(map.position(i, j), light);
+        });
+        stats.maps = maps.size();
+        stats.texels = stats.baked = 0;
+        for (Lightmap &map: maps) {
+            stats.texels += map.visibility.size();
+            stats.baked += size_t(map.dirtyCount());
+            map.dirty[0] = map.dirty[1] = map.dirty[2] = map.dirty[3] = 0;
+        }
+        stats.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return stats.baked;
+    }
+
+    // 查询id表面上position处看到第light个光源的比例；没有这个表面的图或者点在平面的网格以外时返回false
+    bool lookup(ObjectId id, size_t light, const Vec3 &position, float &visibility) const {
+        size_t m;
+        if (GetObjectType(id) == PLANE)
+            m = size_t(GetObjectIndex(id)) * lightCount + light;
+        else if (GetObjectType(id) == SPHERE)
+            m = (planeCount + GetObjectIndex(id)) * lightCount + light;
+        else
+            return false;
+        if (m >= maps.size())
+            return false;
+        const Lightmap &map = maps[m];
+        float u, v;
+        bool wrap = GetObjectType(id) == SPHERE;
+        if (wrap) {
+            Vec3 d = Normalize(position - map.origin);
+            u = (atan2f(d[2], d[0]) + float(M_PI)) / (2 * float(M_PI)) * float(map.width);
+            v = acosf(std::min(std::max(d[1], -1.0f), 1.0f)) / float(M_PI) * float(map.height);
+        } else {
+            Vec3 p = position - map.origin;
+            u = Dot(p, map.axisU) / map.texel;
+            v = Dot(p, map.axisV) / map.texel;
+            if (!(u >= 0 && v >= 0 && u <= float(map.width) && v <= float(map.height)))
+                return false;
+        }
+        // 纹素中心在(i + 0.5, j + 0.5)，相邻四个纹素双线性插值
+        u -= 0.5f, v -= 0.5f;
+        float fu = floorf(u), fv = floorf(v);
+        float su = u - fu, sv = v - fv;
+        int i0 = int(fu), j0 = int(fv);
+        int i1 = i0 + 1, j1 = j0 + 1;
+        if (wrap) {
+            i0 = (i0 % map.width + map.width) % map.width;
+            i1 = i1 % map.width;
+        } else {
+            i0 = std::min(std::max(i0, 0), map.width - 1);
+            i1 = std::min(std::max(i1, 0), map.width - 1);
+        }
+        j0 = std::min(std::max(j0, 0), map.height - 1);
+        j1 = std::min(std::max(j1, 0), map.height - 1);
+        const float *row0 = &map.visibility[size_t(j0) * map.width], *row1 = &map.visibility[size_t(j1) * map.width];
+        float top = row0[i0] + (row0[i1] - row0[i0]) * su;
+        float bottom = row1[i0] + (row1[i1] - row1[i0]) * su;
+        visibility = top + (bottom - top) * sv;
+        return true;
+    }
+
+    const Stats &getStats() const { return stats; }
+
+private:
+    std::vector<Lightmap> maps;         // 先是各平面，再是各球；每个表面按光源的顺序各一张
+    size_t planeCount = 0, lightCount = 0;
+    bool built = false;
+    RenderSettings baked;               // 烘焙时的阴影设置
+    std::vector<Plane> planes;          // 烘焙时各平面、光源和有界物体的状态，用来判断哪些变了
+    std::vector<Light> lights;
+    std::vector<AABB> occluders;
+    AABB extent;                        // 建图时场景的范围，平面的网格只铺这么大
+    Stats stats;
+
+    static bool SameBox(const AABB &a, const AABB &b) { return a.min == b.min && a.max == b.max; }
+
+    // 球、网格和其他有界物体的包围盒，依次排列
+    static std::vector<AABB> OccluderBounds(const ObjectStore &objects) {
+        std::vector<AABB> bounds;
+        bounds.reserve(objects.spheres.size() + objects.meshes.size() + objects.others.size());
+        for (const Sphere &sphere: objects.spheres)
+            bounds.push_back(Bounds(sphere));
+        for (const TriangleMesh &mesh: objects.meshes)
+            bounds.push_back(Bounds(mesh));
+        for (const MyObject *object: objects.others)
+            bounds.push_back(Bounds(*object));
+        return bounds;
+    }
+
+    template<class Object>
+    static AABB Bounds(const Object &object) {
+        AABB box;
+        if (!object.bounds(box))
+            box = AABB();
+        return box;
+    }
+
+    // box中的物体在平面的图上挡住光源的纹素范围：从光源正方形的四个角把box的八个角投影到平面上，取外接矩形再放宽一个纹素。
+    // box整个在光源背对平面的一侧或者在平面后面时挡不住任何纹素；投影会延伸到无穷远（box跨过这些分界）时rect保持整张图
+    static void Footprint(const Lightmap &map, const Plane &plane, const Light &light, const AABB &box, int rect[4]) {
+        const Vec3 &n = plane.getNormal();
+        float h = light.r / 2;
+        float u0 = INFINITY, u1 = -INFINITY, v0 = INFINITY, v1 = -INFINITY;
+        int before = 0, behind = 0, between = 0;
+        for (int a = 0; a < 4; a++) {
+            Vec3 l = light.position + Vec3(a & 1 ? h : -h, 0, a & 2 ? h : -h);
+            float toPlane = Dot(n, plane.getPoint() - l);
+            if (toPlane == 0)
+                return;
+            for (int k = 0; k < 8; k++) {
+                Vec3 corner((k & 1 ? box.max : box.min)[0], (k & 2 ? box.max : box.min)[1],
+                            (k & 4 ? box.max : box.min)[2]);
+                float s = Dot(n, corner - l) / toPlane;     // 角点在光源到平面之间的位置，0是光源，1是平面
+                if (s <= 0) {
+                    before++;
+                } else if (s >= 1) {
+                    behind++;
+                } else {
+                    between++;
+                    Vec3 p = l + (corner - l) / s - map.origin;
+                    u0 = std::min(u0, Dot(p, map.axisU)), u1 = std::max(u1, Dot(p, map.axisU));
+                    v0 = std::min(v0, Dot(p, map.axisV)), v1 = std::max(v1, Dot(p, map.axisV));
+                }
+            }
+        }
+        if (before == 32 || behind == 32) {
+            rect[0] = rect[1] = rect[2] = rect[3] = 0;
+            return;
+        }
+        if (between != 32)
+            return;
+        rect[0] = std::max(int(floorf(u0 / map.texel)) - 1, 0);
+        rect[1] = std::max(int(floorf(v0 / map.texel)) - 1, 0);
+        rect[2] = std::min(int(ceilf(u1 / map.texel)) + 1, map.width);
+        rect[3] = std::min(int(ceilf(v1 / map.texel)) + 1, map.height);
+    }
+
+    static AABB LightBounds(const Light &light) {        // 与calLightIntensity中的正方形光源相同
+        float h = light.r / 2;
+        AABB box;
+        box.grow(light.position - Vec3(h, 0, h));
+        box.grow(light.position + Vec3(h, 0, h));
+        return box;
+    }
+
+    bool sameSetup(const Scene &scene, const RenderSettings &settings, const std::vector<AABB> &bounds) const {
+        if (!built || bounds.size() != occluders.size() || scene.lights.size() != lights.size() ||
+            scene.objects.planes.size() != planes.size() || settings.lightmapTexels != baked.lightmapTexels ||
+            settings.adaptiveShadows != baked.adaptiveShadows || settings.shadowSamples != baked.shadowSamples ||
+            settings.initialShadowSamples != baked.initialShadowSamples)
+            return false;
+        for (size_t i = 0; i < planes.size(); i++) {
+            const Plane &a = scene.objects.planes[i], &b = planes[i];
+            if (a.getPoint() != b.getPoint() || a.getNormal() != b.getNormal())
+                return false;
+        }
+        return true;
+    }
+
+    // 重新建所有的图：平面的网格铺满场景的范围（物体、光源、平面上的点和相机），之后物体移动也不再改变
+    void create(const Scene &scene, const RenderSettings &settings) {
+        built = true;
+        baked = settings;
+        planes = scene.objects.planes;
+        planeCount = planes.size();
+        lightCount = scene.lights.size();
+        extent = AABB();
+        for (const AABB &box: OccluderBounds(scene.objects))
+            extent.grow(box);
+        for (const Light *light: scene.lights)
+            extent.grow(LightBounds(*light));
+        for (const Plane &plane: planes)
+            extent.grow(plane.getPoint());
+        extent.grow(scene.camera);
+        maps.assign((planeCount + scene.objects.spheres.size()) * lightCount, Lightmap());
+        for (size_t m = 0; m < maps.size(); m++) {
+            size_t surface = m / lightCount;
+            Lightmap &map = maps[m];
+            map.surface = surface < planeCount ? MakeObjectId(PLANE, uint32_t(surface))
+                                               : MakeObjectId(SPHERE, uint32_t(surface - planeCount));
+            map.light = uint32_t(m % lightCount);
+            place(map, scene);
+            map.markAll();
+        }
+    }
+
+    // 按表面和光源当前的位置确定图的网格和reach
+    void place(Lightmap &map, const Scene &scene) const {
+        float density = baked.lightmapTexels;
+        uint32_t index = GetObjectIndex(map.surface);
+        if (GetObjectType(map.surface) == PLANE) {
+            const Plane &plane = scene.objects.planes[index];
+            Vec3 n = plane.getNormal();        // 构造时已归一化
+            Vec3 axis = fabsf(n[0]) < 0.5f ? Vec3(1, 0, 0) : fabsf(n[1]) < 0.5f ? Vec3(0, 1, 0) : Vec3(0, 0, 1);
+            map.axisU = Normalize(Cross(n, axis));
+            map.axisV = Cross(n, map.axisU);
+            float u0 = INFINITY, u1 = -INFINITY, v0 = INFINITY, v1 = -INFINITY;
+            for (int k = 0; k < 8; k++) {
+                Vec3 corner((k & 1 ? extent.max : extent.min)[0], (k & 2 ? extent.max : extent.min)[1],
+                            (k & 4 ? extent.max : extent.min)[2]);
+                Vec3 p = corner - plane.getPoint();
+                u0 = std::min(u0, Dot(p, map.axisU)), u1 = std::max(u1, Dot(p, map.axisU));
+                v0 = std::min(v0, Dot(p, map.axisV)), v1 = std::max(v1, Dot(p, map.axisV));
+            }
+            float side = std::max(u1 - u0, v1 - v0);
+            map.texel = std::max(1 / density, side / MaxLightmapSide);
+            map.width = std::max(int(ceilf((u1 - u0) / map.texel)), 1);
+            map.height = std::max(int(ceilf((v1 - v0) / map.texel)), 1);
+            map.origin = plane.getPoint() + map.axisU * u0 + map.axisV * v0;
+            map.reach = AABB();
+            for (int k = 0; k < 4; k++)
+                map.reach.grow(map.origin + map.axisU * (k & 1 ? map.texel * float(map.width) : 0.0f) +
+                               map.axisV * (k & 2 ? map.texel * float(map.height) : 0.0f));
+        } else {
+            const Sphere &sphere = scene.objects.spheres[index];
+            map.origin = sphere.getCenter();
+            map.radius = sphere.getRadius();
+            float around = 2 * float(M_PI) * map.radius * density;
+            map.width = std::min(std::max(int(ceilf(around)), MinSphereLightmapSide), MaxLightmapSide);
+            map.height = std::max(map.width / 2, 1);
+            map.reach = Bounds(sphere);
+        }
+        map.reach.grow(LightBounds(*scene.lights[map.light]));
+    }
+};
+
+#endif //TCODE_LIGHTMAP_H
@@ -0,0 +1,254 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_LIGHTS_H
+#define TCODE_LIGHTS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "objects.h"
+
+const int piece = 10;
+const int LightLeafSize = 4;       // 光源BVH每个叶子最多的光源数
+const int MaxLightSamples = 64;    // 每个着色点最多抽几个光源（RenderSettings::lightSamples）
+
+struct Light {            // 定义光源
+    // Vec3 direction; // 方向
+    Vec3 lightIntensity;            // 光照强度
+    Vec3 position; // 位置(中心)
+    Vec3 dLightIntensity;
+    float r; // 半长(正方形)
+    Light(const Vec3 &_lightIntensity, const Vec3 &_position, float _r) {
+        lightIntensity = _lightIntensity;
+        position = _position;
+        r = _r;
+        dLightIntensity = lightIntensity / (piece*piece);
+    }
+
+    // 光线所在的直线穿过光源所在的水平面时，交点在光源范围内并且离起点比tMax近
+    bool hitBy(const Ray &ray, float tMax) const {
+        float x = (position[1]-ray.start[1])/ray.dir[1]*ray.dir[0]+ray.start[0];
+        float z = (position[1]-ray.start[1])/ray.dir[1]*ray.dir[2]+ray.start[2];
+        if(fabs(x-position[0])<r && fabs(z-position[2])<r) {
+            float dis = sqrt((x-ray.start[0])*(x-ray.start[0])
+                    +(position[1]-ray.start[1])*(position[1]-ray.start[1])
+                    +(z-ray.start[2])*(z-ray.start[2]));
+            return dis < tMax;
+        }
+        return false;
+    }
+
+    AABB bounds() const {        // hitBy可能命中的范围
+        AABB box;
+        box.grow(position - Vec3(r, 0, r));
+        box.grow(position + Vec3(r, 0, r));
+        return box;
+    }
+
+    float power() const { return std::max((lightIntensity[0] + lightIntensity[1] + lightIntensity[2]) / 3, 0.0f); }
+};
+
+// 光源的BVH，结点记录包围盒、光源的总功率和子树中最小的光源下标。两个用途：
+// 找光线碰到的光源（与逐个测试的结果相同：下标最小的那个），以及按估计的贡献为着色点抽取光源。
+// 光源数不变时移动光源只需refit
+class LightBVH {
+public:
+    struct Node {
+        AABB box;
+        float power;
+        int minIndex;
+        int offset;     // 叶子：光源在order中的起始位置；内部结点：右子结点的下标（左子结点紧跟在后面）
+        int count;      // 叶子中的光源数，0表示内部结点
+    };
+
+    // lights在BVH的整个生命周期内不能增删
+    void build(const std::vector<Light *> &_lights) {
+        lights = &_lights;
+        nodes.clear();
+        order.resize(lights->size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = uint32_t(i);
+        if (!order.empty())
+            split(0, int(order.size()));
+        refit();
+    }
+
+    // 光源移动之后自底向上更新包围盒和功率，不改变树的结构，不分配内存
+    void refit() {
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node &node = nodes[i];
+            node.box = AABB();
+            if (node.count == 0) {
+                const Node &left = nodes[i + 1], &right = nodes[node.offset];
+                node.box.grow(left.box);
+                node.box.grow(right.box);
+                node.power = left.power + right.power;
+                node.minIndex = std::min(left.minIndex, right.minIndex);
+                continue;
+            }
+            node.power = 0;
+            node.minIndex = int(lights->size());
+            for (int j = node.offset; j < node.offset + node.count; j++) {
+                const Light &light = *(*lights)[order[j]];
+                node.box.grow(light.bounds());
+                node.power += light.power();
+                node.minIndex = std::min(node.minIndex, int(order[j]));
+            }
+            // hitBy有舍入误差，包围盒稍微放大一点，剔除只会保守
+            Vec3 pad = (Max(node.box.max, -node.box.min) + Vec3(1)) * 1e-4f;
+            node.box.min = node.box.min - pad;
+            node.box.max = node.box.max + pad;
+        }
+    }
+
+    // 光线碰到的光源：在所有hitBy为真的光源中取下标最小的，返回-1表示没有
+    int intersect(const Ray &ray, float tMax) const {
+        if (nodes.empty())
+            return -1;
+        // 交点可以在起点后面，距离按绝对值比较，所以两个方向都要搜
+        float limit = tMax * 1.001f + 1e-3f;
+        Vec3 invDir(1 / ray.dir[0], 1 / ray.dir[1], 1 / ray.dir[2]);
+        int best = int(lights->size());
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (node.minIndex >= best || !overlaps(node.box, ray, invDir, limit))
+                continue;
+            if (node.count == 0) {
+                stack[top++] = node.offset;
+                stack[top++] = int(&node - nodes.data()) + 1;        // 下标小的光源多在左边，先搜
+                continue;
+            }
+            for (int j = node.offset; j < node.offset + node.count; j++) {
+                int index = int(order[j]);
+                if (index < best && (*lights)[index]->hitBy(ray, tMax))
+                    best = index;
+            }
+        }
+        return best < int(lights->size()) ? best : -1;
+    }
+
+    // 按估计的贡献为法线是normal的着色点抽一个光源：从根出发，每个内部结点按两个子结点的重要度随机走一边，
+    // 到叶子后再按其中各光源的重要度选一个。u是[0, 1)的随机数，pdf为选中返回的光源的概率。
+    // 走到的结点或叶子里的光源贡献都为0时返回-1（结点的重要度只是上界，叶子里的光源可能全在背面，
+    // 所以换一个u可能就能抽到光源），这时这次抽样的贡献为0
+    int sample(const Vec3 &position, const Vec3 &normal, float u, float &pdf) const {
+        if (nodes.empty())
+            return -1;
+        pdf = 1;
+        const Node *node = &nodes[0];
+        while (node->count == 0) {
+            const Node &left = node[1], &right = nodes[node->offset];
+            float wl = importance(left, position, normal), wr = importance(right, position, normal);
+            if (!(wl + wr > 0))
+                return -1;
+            float p = wl / (wl + wr);
+            if (u < p) {
+                u = std::min(u / p, 0x1.fffffep-1f);
+                pdf *= p;
+                node = &left;
+            } else {
+                u = std::min((u - p) / (1 - p), 0x1.fffffep-1f);
+                pdf *= 1 - p;
+                node = &right;
+            }
+        }
+        float weights[LightLeafSize];
+        float sum = 0;
+        for (int j = 0; j < node->count; j++) {
+            weights[j] = importance(*(*lights)[order[node->offset + j]], position, normal);
+            sum += weights[j];
+        }
+        if (!(sum > 0))
+            return -1;
+        float target = u * sum;
+        int chosen = -1;
+        for (int j = 0; j < node->count; j++) {        // 舍入误差让target越界时取最后一个重要度不为0的光源
+            if (weights[j] > 0) {
+                chosen = j;
+                if (target < weights[j])
+                    break;
+                target -= weights[j];
+            }
+        }
+        pdf *= weights[chosen] / sum;
+        return int(order[node->offset + chosen]);
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+private:
+    const std::vector<Light *> *lights = nullptr;
+    std::vector<Node> nodes;          // 前序排列，子结点的下标总比父结点大
+    std::vector<uint32_t> order;      // 按叶子顺序排列的光源下标
+
+    // 按光源中心在最长轴上的中位数对半分，返回结点下标
+    int split(int begin, int end) {
+        int index = int(nodes.size());
+        nodes.push_back(Node());
+        if (end - begin <= LightLeafSize) {
+            nodes[index].offset = begin;
+            nodes[index].count = end - begin;
+            return index;
+        }
+        AABB centers;
+        for (int j = begin; j < end; j++)
+            centers.grow((*lights)[order[j]]->position);
+        Vec3 extent = centers.max - centers.min;
+        int axis = extent[0] >= extent[1] && extent[0] >= extent[2] ? 0 : extent[1] >= extent[2] ? 1 : 2;
+        int mid = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+            float pa = (*lights)[a]->position[axis], pb = (*lights)[b]->position[axis];
+            return pa < pb || (pa == pb && a < b);
+        });
+        split(begin, mid);
+        int right = split(mid, end);
+        nodes[index].offset = right;
+        nodes[index].count = 0;
+        return index;
+    }
+
+    // 这里的光照没有距离衰减（calLightIntensity），重要度就是功率乘上cos的上界：
+    // 从着色点看包住结点的球是一个圆锥，法线与圆锥内方向夹角的cos最大值
+    static float importance(const Node &node, const Vec3 &position, const Vec3 &normal) {
+        Vec3 d = node.box.center() - position;
+        float distance = sqrtf(LengthSquared(d));
+        float radius = sqrtf(LengthSquared(node.box.max - node.box.min)) * 0.5f;
+        if (distance <= radius)         // 着色点在球里，各个方向都可能有光源
+            return node.power;
+        float cosTheta = Dot(normal, d) / distance;
+        float sinTheta = sqrtf(std::max(1 - cosTheta * cosTheta, 0.0f));
+        float sinCone = radius / distance, cosCone = sqrtf(1 - sinCone * sinCone);
+        if (cosTheta >= cosCone)        // 法线在圆锥里
+            return node.power;
+        float cosBound = cosTheta * cosCone + sinTheta * sinCone;        // cos(theta - cone)
+        return cosBound > 0 ? node.power * cosBound : 0;
+    }
+
+    static float importance(const Light &light, const Vec3 &position, const Vec3 &normal) {
+        float cosTheta = Dot(normal, Normalize(light.position - position));        // 与着色时相同
+        return cosTheta > 0 ? light.power() * cosTheta : 0;
+    }
+
+    // 直线在参数(-limit, limit)内是否穿过盒子
+    static bool overlaps(const AABB &box, const Ray &ray, const Vec3 &invDir, float limit) {
+        float t0 = -limit, t1 = limit;
+        for (int i = 0; i < 3; i++) {
+            float tA = (box.min[i] - ray.start[i]) * invDir[i];
+            float tB = (box.max[i] - ray.start[i]) * invDir[i];
+            if (tA > tB)
+                std::swap(tA, tB);
+            t0 = tA > t0 ? tA : t0;        // 写成比较形式，遇到NaN时保持原值
+            t1 = tB < t1 ? tB : t1;
+            if (t0 > t1)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif //TCODE_LIGHTS_H
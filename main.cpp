@@ -1,352 +1,413 @@
 #include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <gl/glew.h>
 #include <gl/freeglut.h>
-#include <fstream>
 #include <cassert>
 #include <cmath>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#define TCODE_COUNT_ALLOCATIONS
+#include "alloc_counter.h"
+#include "animation.h"
+#include "camera.h"
 #include "my_math.h"
 #include "objects.h"
+#include "preview.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "tracer.h"
 
 #define Window_Width 1024
 #define Window_Height 768
 
 using namespace std;
 
-GLuint VAO, VBO, IBO;
-vector<float> vertices;
-Vector3f Camera;
-const Vector3f zero = {0, 0, 0};
-const Vector3f one = {1, 1, 1};
-Vector3f image[Window_Width * Window_Height];
-
-const int piece = 10;
-struct Light {            // 定义光源
-    // Vector3f direction; // 方向
-    Vector3f lightIntensity;            // 光照强度
-    Vector3f position; // 位置(中心)
-    Vector3f dLightIntensity;
-    float r; // 半长(正方形)
-    Light(Vector3f _lightIntensity, Vector3f _position, float _r) {
-        CopyVector3(lightIntensity, _lightIntensity);
-        CopyVector3(position, _position);
-        r = _r;
-        DivVector3andFloat(dLightIntensity, lightIntensity, piece*piece);
-    }
+GLuint VAO, VBO, PBO, FrameTexture;
+FrameBuffer frame(Window_Width, Window_Height);  // 渲染线程写，显示时读
+uint64_t shownVersion = 0;                       // 已经显示的帧缓冲版本
+const unsigned RefreshInterval = 33;             // 检查帧缓冲的间隔（毫秒）
+thread renderThread;
+atomic<bool> renderCancel(false);               // 退出程序时让渲染线程停下
+atomic<bool> fullCancel(false);                 // 相机移动时取消正在画的完整图像
+RenderSettings settings;
+const char *scenePath = nullptr;                 // 场景文件，没有指定时使用initScene中的场景
+const char *profilePath = nullptr;               // 开销统计的JSON报告，nullptr表示不统计
+const char *heatmapPath = nullptr;               // 逐像素开销的热力图
+HeatmapMetric heatmapMetric = HeatmapTests;
+const char *animationPath = nullptr;             // 动画文件，指定时依次渲染整个序列
+const char *sequenceOutput = nullptr;            // 序列每帧的输出文件名，printf格式，如frame%04d.ppm
+Animation animation;
+Lightmaps lightmaps;                             // --lightmaps时烘焙的光照可见度缓存，只由渲染线程使用
+
+struct ViewState {        // 用户控制的视角，输入回调（显示线程）写，渲染线程读，由viewLock保护
+    Vec3 position;
+    float yaw = 0, pitch = 0;
+    uint64_t version = 0;                        // 每次移动加一
+    chrono::steady_clock::time_point lastInput;  // 最后一次移动的时间
 };
-
-vector<Light *> lights;
-Vector3f AmbientLight;
-vector<MyObject *> orbs;
-
-const char *pVSFileName = "shader.vs";
-const char *pFSFileName = "shader.fs";
-
-
-bool ReadFile(const char *pFileName, string &outFile) {
-    ifstream f(pFileName);
-
-    bool ret = false;
-
-    if (f.is_open()) {
-        string line;
-        while (getline(f, line)) {
-            outFile.append(line);
-            outFile.append("\n");
-        }
-        f.close();
-        ret = true;
-    } else {
-        fprintf(stderr, "%s:%d: unable to open file `%s`\n", __FILE__, __LINE__, pFileName);
-    }
-    return ret;
+mutex viewLock;
+condition_variable viewChanged;
+ViewState view;
+PreviewBudget preview(16);                       // 移动时预览一帧的时间预算（毫秒）
+const chrono::milliseconds SettleTime(200);      // 停止移动多久之后开始画完整的图像
+const float MoveStep = 0.05f;                    // 每次按键移动的距离
+const float TurnStep = 2;                        // 每次按键转动的角度（度）
+const float MouseTurn = 0.25f;                   // 拖动鼠标每像素转动的角度（度）
+
+Scene scene;
+
+// 整幅图像是一张纹理，用一个铺满窗口的矩形画出来
+const char *pVSText = R"(#version 330 core
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 texCoord;
+out vec2 uv;
+void main() {
+    uv = texCoord;
+    gl_Position = vec4(position, 0.0, 1.0);
 }
+)";
+const char *pFSText = R"(#version 330 core
+in vec2 uv;
+out vec4 color;
+uniform sampler2D frame;
+void main() {
+    color = texture(frame, uv);
+}
+)";
 
 
 void Render() {
 
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // 位置
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    // 颜色
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *) (3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glDrawArrays(GL_POINTS, 0, vertices.size() / 6);
-    glDisableVertexAttribArray(0);
+    glBindVertexArray(VAO);
+    glBindTexture(GL_TEXTURE_2D, FrameTexture);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glutSwapBuffers();
 }
 
-void calLightIntensity(Vector3f position, Light light, Vector3f res) //计算该光源的每一个光照元能否照射到他
-{
-    for (int i = 0; i < piece; i++) {
-        for (int j = 0; j < piece; j++) {
-            Vector3f start, dir, temp = {-light.r / 2 + light.r / piece * i, 0, -light.r / 2 + light.r / piece * j};
-            AddVector3(start, light.position, temp);
-            SubVector3(dir, position, start);
-            Ray shadowRay(start, dir);
-            bool flag = true;
-            for (MyObject *orb: orbs) {
-                Hit hit = orb->intersect(shadowRay);
-                if (hit.t > 0 && (hit.position[0] - position[0]) * (hit.position[0] - start[0]) < 0) {
-                    flag = false;
-                }
-            }
-            if (flag) {
-                AddVector3(res, res, light.dLightIntensity);
-            }
-        }
-    }
-
-}
-
-static void trace(Ray ray, int depth, Vector3f ret) {
-    if (depth > 5) { // 到达最大递归层数
-        CopyVector3(ret, AmbientLight);
-        return;
-    }
-    Hit nearHit = *new Hit();
-    nearHit.t = INFINITY;
-    MyObject *nearOrb = nullptr;
-    for (auto i: orbs) { // 确定最近的交点
-        Hit hit = i->intersect(ray);
-        if (hit.t > 0 && hit.t < nearHit.t) {
-            nearHit = hit;
-            nearOrb = i;
-        }
-    }
-    for (Light* l:lights) { // 与光源相交，返回光源亮度
-        float x = (l->position[1]-ray.start[1])/ray.dir[1]*ray.dir[0]+ray.start[0];
-        float z = (l->position[1]-ray.start[1])/ray.dir[1]*ray.dir[2]+ray.start[2];
-        if(fabs(x-l->position[0])<l->r && fabs(z-l->position[2])<l->r) {
-            float dis = sqrt((x-ray.start[0])*(x-ray.start[0])
-                    +(l->position[1]-ray.start[1])*(l->position[1]-ray.start[1])
-                    +(z-ray.start[2])*(z-ray.start[2]));
-            if(dis < nearHit.t) {
-                CopyVector3(ret, l->lightIntensity);
-                return;
-            }
-        }
-    }
-    if (nearOrb != nullptr) { // 与物体相交
-        if (nearHit.material->type == ROUGH) {
-            Vector3f outRadiance;
-            MultiplyVector3ByElement(outRadiance, nearHit.material->ka, AmbientLight); // 初始化返回光线（利用环境光）
-            for (Light *light: lights) { // fixed 改成有限面光源
-                Vector3f temp;
-                MultiplyVector3andFloat(temp, nearHit.normal, epsilon);
-                AddVector3(temp, nearHit.position, temp);
-                Vector3f direction;
-                SubVector3(direction, light->position, nearHit.position); // direction = position->light
-                Vector3f nowLightIntensity = {0, 0, 0};
-//                if(fabs(nearHit.position[1]-1)<epsilon) {
-//                    printf("%f,%f,%f\n",nearHit.position[0], nearHit.position[1], nearHit.position[2]);
-//                }
-//                if (fabs(nearHit.position[0] + 0.72) < 100*epsilon &&
-//                        fabs(nearHit.position[1] + 1) < 100*epsilon &&
-//                        fabs(nearHit.position[2] + -0.86) < 100*epsilon) { // 被蓝色球遮挡
-//                    printf("%f,%f,%f\n",nearHit.position[0], nearHit.position[1], nearHit.position[2]);
-//                }
-                calLightIntensity(nearHit.position, *light, nowLightIntensity);
-//                if(fabs(nearHit.position[1]-1)<epsilon) {
-//                    printf("%f,%f,%f\n",nowLightIntensity[0], nowLightIntensity[1], nowLightIntensity[2]);
-//                }
-                NormalizeVector3(direction);
-//                printf("%f,%f,%f\n",nowLightIntensity[0], nowLightIntensity[1], nowLightIntensity[2]);
-//                printf("%f,%f,%f\n",nearHit.normal[0], nearHit.normal[1], nearHit.normal[2]);
-//                printf("%f,%f,%f\n",direction[0], direction[1], direction[2]);
-                float cosTheta = DotVector3(nearHit.normal, direction);
-//                printf("%f\n",cosTheta);
-//                if (fabs(nearHit.position[0] + 0.72) < epsilon &&
-//                    (nearHit.position[1] + 1) < epsilon &&
-//                    (nearHit.position[2] + -0.86) < epsilon) { // 被蓝色球遮挡
-//                    printf("%f\n", cosTheta);
-//                }
-                if (cosTheta > 0)    // 如果cos小于0（钝角），说明光照到的是物体背面，相机看不到
-                {
-                    if (!(nowLightIntensity[0] == 0 && nowLightIntensity[1] == 0 &&
-                          nowLightIntensity[2] == 0))    // 有亮度
-                    {
-                        MultiplyVector3ByElement(temp, nowLightIntensity, nearHit.material->kd);
-                        MultiplyVector3andFloat(temp, temp, cosTheta);
-                        AddVector3(outRadiance, outRadiance, temp); // 漫反射成分
-//                        printf("%f,%f,%f\n",outRadiance[0], outRadiance[1], outRadiance[2]);
-                        //outRadiance = outRadiance + light->lightIntensity * nearHit.material->kd * cosTheta;
-                        SubVector3(temp, zero, ray.dir);
-                        Vector3f halfway;
-                        AddVector3(halfway, temp, direction);
-                        NormalizeVector3(halfway);
-                        //Vector3f halfway = normalize(-ray.dir + light->direction);
-                        float cosDelta = DotVector3(nearHit.normal, halfway);
-//                        printf("%f\n", cosDelta);
-//                        if(fabs(nearHit.position[1]-1)<epsilon) {
-//                            printf("%f\n", cosDelta);
-//                        }
-                        if (cosDelta > 0) { // 镜面反射成分
-                            MultiplyVector3ByElement(temp, light->dLightIntensity, nearHit.material->ks);
-                            MultiplyVector3andFloat(temp, temp, powf(cosDelta, nearHit.material->shininess));
-                            AddVector3(outRadiance, outRadiance, temp);
-//                             outRadiance = outRadiance + light->lightIntensity * nearHit.material->ks * powf(cosDelta, nearHit.material->shininess);
-                        }
-                    }
-                }
-//                if (fabs(nearHit.position[2]+1) < epsilon) { // 后墙
-//                    printf("%f,%f,%f\n",outRadiance[0], outRadiance[1], outRadiance[2]);
-//                }
-//                if(fabs(nearHit.position[1]-1)<epsilon) { // 打到顶端
-//                    printf("%f,%f,%f\n",outRadiance[0], outRadiance[1], outRadiance[2]);
-//                }
-//                printf("%f,%f,%f\n",outRadiance[0], outRadiance[1], outRadiance[2]);
-                CopyVector3(ret, outRadiance);
-            }
-//            printf("return\n");
-            return;
-        } else {
-            Vector3f temp;
-            float cosa = -DotVector3(ray.dir, nearHit.normal);        // 镜面反射（继续追踪）
-            Vector3f one = {1, 1, 1};
-            Vector3f F;
-            SubVector3(temp, one, nearHit.material->F0);
-            MultiplyVector3andFloat(temp, temp, pow(1 - cosa, 5));
-            AddVector3(F, nearHit.material->F0, temp);
-            //F = nearHit.material->F0 + (one - nearHit.material->F0) * pow(1 - cosa, 5);
-            Vector3f reflectedDir;
-            MultiplyVector3andFloat(temp, nearHit.normal, DotVector3(nearHit.normal, ray.dir) * 2.0f);
-            SubVector3(reflectedDir, ray.dir, temp);
-            //Vector3f reflectedDir = ray.dir - nearHit.normal * DotVector3(nearHit.normal, ray.dir) * 2.0f;		// 反射光线R = v + 2Ncosa
-            MultiplyVector3andFloat(temp, nearHit.normal, epsilon);
-            AddVector3(temp, nearHit.position, temp);
-            trace(Ray(temp, reflectedDir), depth + 1, ret);
-            Vector3f outRadiance;
-            MultiplyVector3ByElement(outRadiance, ret, F);
-
-            if (nearHit.material->type == REFRACTIVE)     // 对于透明物体，计算折射（继续追踪）
-            {
-                float disc = 1 - (1 - cosa * cosa) / nearHit.material->ior / nearHit.material->ior;
-                if (disc >= 0) {
-                    Vector3f refractedDir;
-                    Vector3f temp2;
-                    MultiplyVector3andFloat(temp, ray.dir, 1.0 / nearHit.material->ior);
-                    MultiplyVector3andFloat(temp2, nearHit.normal, cosa / nearHit.material->ior - sqrt(disc));
-                    AddVector3(refractedDir, temp, temp2);
-                    //refractedDir = ray.dir / nearHit.material->ior + nearHit.normal * (cosa / nearHit.material->ior - sqrt(disc));
-                    MultiplyVector3andFloat(temp, nearHit.normal, epsilon);
-                    SubVector3(temp, nearHit.position, temp);
-                    trace(Ray(temp, refractedDir), depth + 1, ret);
-                    SubVector3(temp, one, F);
-                    MultiplyVector3ByElement(temp, ret, temp);
-                    AddVector3(outRadiance, outRadiance, temp);
-                    //outRadiance = outRadiance + trace(Ray(nearHit.position - nearHit.normal * epsilon, refractedDir), depth + 1, ret) * (one - F);
-                }
-            }
-            CopyVector3(ret, outRadiance);
-            return;
-        }
-    } else {
-        CopyVector3(ret, AmbientLight);
-    }
-}
-
-static void initScene() {
+static bool initScene() {
     // 相机位置
-    Vector3f temp, t1, t2;
+    Vec3 temp, t1, t2;
     temp[0] = 0, temp[1] = 0, temp[2] = 4 - epsilon;
-    CopyVector3(Camera, temp);
+    scene.camera = temp;
     // 环境光
     temp[0] = 0.4, temp[1] = 0.4, temp[2] = 0.4;
-    CopyVector3(AmbientLight, temp);
+    scene.ambientLight = temp;
     // 光源
     temp[0] = 0.3, temp[1] = 1 - 0.05, temp[2] = -0.3; // 位置
     t1[0] = 1.5, t1[1] = 1.5, t1[2] = 1.5; // 光照强度
-    lights.push_back(new Light(t1, temp, 0.2));
+    scene.addLight(t1, temp, 0.2);
     temp[0] = -0.2, temp[1] = 1 - 0.05, temp[2] = 0.4; // 位置
     t1[0] = 2, t1[1] = 2, t1[2] = 2; // 光照强度
-    lights.push_back(new Light(t1, temp, 0.3));
+    scene.addLight(t1, temp, 0.3);
     // 物体
     t2[0] = 0.2, t2[1] = 0.2, t2[2] = 0.2;
     temp[0] = 0.3, temp[1] = 0.2, temp[2] = 0.1;
-    Material *yellowRough = new RoughMaterial(temp, t2, 10);
+    Material *yellowRough = scene.create<RoughMaterial>(temp, t2, 10);
     temp[0] = 0.1, temp[1] = 0.2, temp[2] = 0.3;
-    Material *blueRough = new RoughMaterial(temp, t2, 10);
+    Material *blueRough = scene.create<RoughMaterial>(temp, t2, 10);
     temp[0] = 3, temp[1] = 0, temp[2] = 0.2;
-    Material *pinkRough = new RoughMaterial(temp, t2, 10);
+    Material *pinkRough = scene.create<RoughMaterial>(temp, t2, 10);
     temp[0] = 0.03, temp[1] = 0.03, temp[2] = 0.03;
-    Material *blackRough = new RoughMaterial(temp, t2, 10);
+    Material *blackRough = scene.create<RoughMaterial>(temp, t2, 10);
     temp[0] = 0.8, temp[1] = 0.8, temp[2] = 0.8;
-    Material *whiteRough = new RoughMaterial(temp, t2, 10);
+    Material *whiteRough = scene.create<RoughMaterial>(temp, t2, 10);
     temp[0] = 0.3, temp[1] = 0, temp[2] = 0;
-    Material *redRough = new RoughMaterial(temp, t2, 10);
+    Material *redRough = scene.create<RoughMaterial>(temp, t2, 10);
     // 构建上下左右前后面
 //    t1[0] = 0, t1[1] = 0, t1[2] = 5, t2[0] = 0, t2[1] = 0, t2[2] = -1;
-//    orbs.push_back(new Plane(t1, t2, blackRough));
+//    scene.add(Plane(t1, t2, blackRough));
     t1[0] = 0, t1[1] = 0, t1[2] = -1, t2[0] = 0, t2[1] = 0, t2[2] = 1;
-    orbs.push_back(new Plane(t1, t2, yellowRough));
+    scene.add(Plane(t1, t2, yellowRough));
     t1[0] = 0, t1[1] = 1, t1[2] = 0, t2[0] = 0, t2[1] = -1, t2[2] = 0;
-    orbs.push_back(new Plane(t1, t2, blueRough));
+    scene.add(Plane(t1, t2, blueRough));
     t1[0] = 0, t1[1] = -1, t1[2] = 0, t2[0] = 0, t2[1] = 1, t2[2] = 0;
-    orbs.push_back(new Plane(t1, t2, blueRough));
+    scene.add(Plane(t1, t2, blueRough));
     t1[0] = 1, t1[1] = 0, t1[2] = 0, t2[0] = -1, t2[1] = 0, t2[2] = 0;
-    orbs.push_back(new Plane(t1, t2, pinkRough));
+    scene.add(Plane(t1, t2, pinkRough));
     t1[0] = -1, t1[1] = 0, t1[2] = 0, t2[0] = 1, t2[1] = 0, t2[2] = 0;
-    orbs.push_back(new Plane(t1, t2, pinkRough));
+    scene.add(Plane(t1, t2, pinkRough));
     t1[0] = 0.5, t1[1] = -0.7, t1[2] = 0.5;
-    orbs.push_back(new Sphere(t1, 0.3, yellowRough));
+    scene.add(Sphere(t1, 0.3, yellowRough));
     t1[0] = -0.6, t1[1] = -0.4, t1[2] = 0.6;
-    orbs.push_back(new Sphere(t1, 0.3, blueRough));
+    scene.add(Sphere(t1, 0.3, blueRough));
     t1[0] = -0, t1[1] = -0.3, t1[2] = 0.6;
-    orbs.push_back(new Sphere(t1, 0.2, redRough));
+    scene.add(Sphere(t1, 0.2, redRough));
     t1[0] = -0.4, t1[1] = -0.75, t1[2] = 0.3;
-    orbs.push_back(new Sphere(t1, 0.2, pinkRough));
+    scene.add(Sphere(t1, 0.2, pinkRough));
     t1[0] = -0.65, t1[1] = 0.3, t1[2] = 0, temp[0] = 0.14, temp[1] = 0.16, temp[2] = 0.13, t2[0] = 4.1, t2[1] = 2.3, t2[2] = 3.1;
-    orbs.push_back(new Sphere(t1, 0.2,
-                              new ReflectiveMaterial(temp, t2)));
+    Material *reflective = scene.create<ReflectiveMaterial>(temp, t2);
+    scene.add(Sphere(t1, 0.2, reflective));
     t1[0] = 0, t1[1] = -0.6, t1[2] = 1;
-    orbs.push_back(new Sphere(t1, 0.1,
-                              new ReflectiveMaterial(temp, t2)));
+    scene.add(Sphere(t1, 0.1, reflective));
+
+    return scene.build();
 }
 
-static void CreateVertexBuffer() {
-    Vector3f *pixel = image;
-    float invWidth = 1 / float(Window_Width), invHeight = 1 / float(Window_Height); //计算屏占比
-    float fov = 40, aspectratio = Window_Width / float(Window_Height); // 设定视场角（视野范围） 和 纵横比
-    float angle = tan(M_PI * 0.5 * fov / 180.0); // 把视场角转化为普通的角度
-
-    // 光线追踪开始，逐像素点进行光线追踪
-    for (unsigned y = 0; y < Window_Height; ++y) {
-        for (unsigned x = 0; x < Window_Width; ++x, ++pixel) {
-            //进行坐标系的转换
-            float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
-            float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
-            Vector3f raydir = {xx, yy, -1}; //确定出射光方向向量
-            NormalizeVector3(raydir);
-            Vector3f color;
-            Ray ray(Camera, raydir);
-            trace(ray, 0, color);
-            CopyVector3(*pixel, color);
+static void PrintSceneInfo() {
+    const BVH::Stats &stats = scene.bvh.getStats();
+    printf("BVH: %d nodes, %d leaves, depth %d, built in %.3f ms; %zu planes, %zu other unbounded objects; %s sphere kernel\n",
+           stats.nodeCount, stats.leafCount, stats.depth, stats.buildMs, scene.objects.planes.size(), scene.unbounded.size(),
+           scene.bvh.kernelName());
+}
+
+// 开启了--lightmaps时烘焙光照图，或者在场景变化之后只更新受影响的图；没有开启时返回nullptr
+static const Lightmaps *UpdateLightmaps(RenderContext &context) {
+    if (!settings.lightmaps)
+        return nullptr;
+    BakeLightmaps(lightmaps, Tracer(scene, settings), context.pool);
+    return &lightmaps;
+}
+
+// 渐进地渲染整幅完整质量的图像，每画完一块就写进帧缓冲，显示线程定时检查并刷新。相机移动时中途取消，返回false
+static bool RenderFull(RenderContext &context, const Lightmaps *maps) {
+    Tracer tracer(scene, settings, maps);
+    auto begin = chrono::steady_clock::now();
+    RenderStats stats;
+    TraceProfile profile;
+    bool profiling = profilePath != nullptr || heatmapPath != nullptr;
+    bool finished = RenderFrame(context, tracer, frame, fullCancel, stats, [&](int pass, int stride) {
+        if (pass == 0 && stride > 1)
+            printf("First pass (1/%d resolution): %.1f ms\n", stride,
+                   chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count());
+    }, profiling ? &profile : nullptr);
+    if (!finished)
+        return false;
+    printf("Render: %.3f s, %u threads, %zu tiles, %zu passes, %.2f M shadow rays, %llu heap allocations while tracing\n",
+           stats.seconds, stats.threads, stats.tiles, stats.passes, stats.shadowRays * 1e-6,
+           (unsigned long long) stats.tracingAllocations);
+    if (settings.aaMaxSamples > 1)
+        printf("Antialiasing: %zu pixels (%.1f%%), %.2f extra samples per pixel on average\n", stats.aaPixels,
+               100.0 * stats.aaPixels / (Window_Width * Window_Height),
+               double(stats.aaSamples) / (Window_Width * Window_Height));
+    if (stats.tracingAllocations != 0)        // 不用assert：默认按Release编译，NDEBUG会把它去掉
+        fprintf(stderr, "render: %llu heap allocations while tracing (expected none)\n",
+                (unsigned long long) stats.tracingAllocations);
+    if (profiling) {
+        TraceCounters total = profile.total();
+        printf("Profile: %.2f M rays (%.2f M primary, %.2f M secondary, %.2f M shadow), %.2f M intersection tests\n",
+               total.rays() * 1e-6, total.counts[PrimaryRays] * 1e-6, total.counts[SecondaryRays] * 1e-6,
+               total.counts[ShadowRays] * 1e-6, total.tests() * 1e-6);
+        if (profilePath != nullptr)
+            profile.writeJSON(profilePath);
+        if (heatmapPath != nullptr)
+            profile.writeHeatmap(heatmapPath, heatmapMetric);
+    }
+    return true;
+}
+
+static bool Moving(const ViewState &v) { return chrono::steady_clock::now() - v.lastInput < SettleTime; }
+
+// 渲染线程：相机不动时渐进地画完整的图像；用户移动相机时改画预览（低分辨率、少量阴影光线，按时间预算自动调整），
+// 停下SettleTime之后再画完整的。线程池等渲染资源一直复用
+static void RenderLoop() {
+    RenderContext context(settings, Window_Width, Window_Height);
+    vector<Pass> fullPasses = context.passes;
+    const Lightmaps *maps = UpdateLightmaps(context);    // 交互时场景不变，只在开始时烘焙一次
+    if (maps != nullptr) {
+        const Lightmaps::Stats &bake = maps->getStats();
+        printf("Lightmaps: %zu maps, %.2f M texels (%.1f MB), baked in %.1f ms\n", bake.maps, bake.texels * 1e-6,
+               bake.texels * sizeof(float) / double(1 << 20), bake.bakeMs);
+    }
+    uint64_t rendered = UINT64_MAX;     // 帧缓冲里是哪个视角
+    bool complete = false;              // 帧缓冲里是不是完整的图像
+    int previewFrames = 0;
+    double previewMs = 0;
+    while (!renderCancel) {
+        ViewState v;
+        {
+            unique_lock<mutex> lk(viewLock);
+            while (!renderCancel && view.version == rendered && (complete || Moving(view))) {
+                if (complete)
+                    viewChanged.wait(lk);
+                else
+                    viewChanged.wait_until(lk, view.lastInput + SettleTime);
+            }
+            if (renderCancel)
+                break;
+            v = view;
+            fullCancel = false;     // 之后的移动会再把它置为true
+        }
+        scene.camera = v.position;
+        scene.cameraYaw = v.yaw;
+        scene.cameraPitch = v.pitch;
+        rendered = v.version;
+        if (Moving(v)) {
+            context.passes.assign(1, preview.pass());
+            Tracer tracer(scene, preview.settings(settings), maps);
+            RenderStats stats;
+            if (!RenderFrame(context, tracer, frame, renderCancel, stats, [](int, int) {}))
+                break;
+            previewMs = stats.seconds * 1e3;
+            preview.update(previewMs);
+            previewFrames++;
+            complete = false;
+            continue;
         }
+        if (previewFrames > 0) {
+            printf("Preview: %d frames, last %.1f ms (budget %.0f ms), now 1/%d resolution, %d shadow samples\n",
+                   previewFrames, previewMs, preview.getBudgetMs(), preview.stride(), preview.shadowSamples());
+            previewFrames = 0;
+        }
+        context.passes = fullPasses;
+        complete = RenderFull(context, maps);
     }
+}
 
-    for (unsigned int i = 0; i < Window_Height; i++) {
-        for (unsigned int j = 0; j < Window_Width; j++) {
-            //坐标转换为屏幕像素的坐标
-            auto a = -2 * (float(j) / Window_Width) + 1;
-            auto b = -2 * (float(i) / Window_Height) + 1;
-            vertices.push_back(a);
-            vertices.push_back(b);
-            vertices.push_back(0);
-            //设置坐标的颜色值
-            vertices.push_back(min(image[i * Window_Width + j][0], float(1)));
-            vertices.push_back(min(image[i * Window_Width + j][1], float(1)));
-            vertices.push_back(min(image[i * Window_Width + j][2], float(1)));
+// 渲染整个动画序列：线程池、分块等渲染资源和场景的内存一直复用，帧之间只移动物体、refit BVH
+static void RenderSequence() {
+    RenderContext context(settings, Window_Width, Window_Height);
+    Tracer tracer(scene, settings, settings.lightmaps ? &lightmaps : nullptr);
+    double renderSeconds = 0, updateSeconds = 0, bakeMs = 0;
+    size_t bakedTexels = 0;
+    int rebuilds = 0;
+    char path[1024];
+    for (int i = 0; i < animation.frames && !renderCancel; i++) {
+        auto begin = chrono::steady_clock::now();
+        animation.apply(scene, float(i));
+        bool rebuilt;
+        if (!scene.update(RefitRebuildRatio, &rebuilt)) {
+            fprintf(stderr, "Frame %d: the animation left an invalid object in the scene\n", i);
+            return;
+        }
+        if (rebuilt) {
+            rebuilds++;
+            printf("Frame %d: BVH quality degraded, rebuilt in %.3f ms\n", i, scene.bvh.getStats().buildMs);
+        }
+        updateSeconds += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        if (UpdateLightmaps(context) != nullptr) {  // 只重新烘焙移动的物体和光源影响到的图
+            bakeMs += lightmaps.getStats().bakeMs;
+            bakedTexels += lightmaps.getStats().baked;
+        }
+        RenderStats stats;
+        if (!RenderFrame(context, tracer, frame, renderCancel, stats, [](int, int) {}))
+            return;
+        renderSeconds += stats.seconds;
+        if (stats.tracingAllocations != 0)
+            fprintf(stderr, "Frame %d: %llu heap allocations while tracing (expected none)\n", i,
+                    (unsigned long long) stats.tracingAllocations);
+        if (sequenceOutput != nullptr) {
+            snprintf(path, sizeof(path), sequenceOutput, i);
+            if (!frame.writePPM(path))
+                return;
         }
     }
+    printf("Sequence: %d frames, %.1f ms/frame rendering, %.3f ms/frame moving objects and updating the BVH, %d rebuilds\n",
+           animation.frames, renderSeconds * 1e3 / animation.frames, updateSeconds * 1e3 / animation.frames, rebuilds);
+    if (settings.lightmaps)
+        printf("Lightmaps: %.1f ms/frame updating, %.1f%% of the texels rebaked per frame\n", bakeMs / animation.frames,
+               100.0 * bakedTexels / animation.frames / max(lightmaps.getStats().texels, size_t(1)));
+}
+
+static void StopRendering() {
+    {
+        lock_guard<mutex> lk(viewLock);
+        renderCancel = true;
+        fullCancel = true;
+    }
+    viewChanged.notify_all();
+    if (renderThread.joinable())
+        renderThread.join();
+}
+
+static void StartRendering() {
+    view.position = scene.camera;
+    view.yaw = scene.cameraYaw;
+    view.pitch = scene.cameraPitch;
+    renderThread = thread(animationPath != nullptr ? RenderSequence : RenderLoop);
+    atexit(StopRendering); // freeglut关窗口时直接exit，先让渲染线程停下，再析构场景
+}
+
+// 铺满窗口的矩形和存放图像的纹理。纹理第0行是图像第0行，显示在窗口顶部；
+// 图像第0列显示在窗口右边，与原来逐像素画点时的方向一致
+static void CreateVertexBuffer() {
+    const float quad[] = {
+            // 位置        纹理坐标
+            -1, -1, 1, 1,
+            1, -1, 0, 1,
+            -1, 1, 1, 0,
+            1, 1, 0, 0,
+    };
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * 4, &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) (2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glGenTextures(1, &FrameTexture);
+    glBindTexture(GL_TEXTURE_2D, FrameTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Window_Width, Window_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    // 上传用的像素缓冲，glTexSubImage2D从这里异步复制到纹理
+    glGenBuffers(1, &PBO);
+}
+
+struct DirtySpan {        // 一行方块中连续的几个写过的方块
+    int x0, y0, x1, y1;
+};
+
+// 把帧缓冲中写过的方块经像素缓冲上传到纹理，同一行中相邻的方块合并成一次上传
+static void UploadFrame() {
+    static vector<DirtySpan> spans;
+    spans.clear();
+    const int block = FrameBuffer::DirtyBlock;
+    for (int by = 0; by < frame.getBlocksY(); by++) {
+        for (int bx = 0; bx < frame.getBlocksX(); bx++) {
+            if (!frame.takeDirty(bx, by))
+                continue;
+            int x0 = bx * block, y0 = by * block;
+            int x1 = min(x0 + block, Window_Width), y1 = min(y0 + block, Window_Height);
+            if (!spans.empty() && spans.back().y0 == y0 && spans.back().x1 == x0)
+                spans.back().x1 = x1;
+            else
+                spans.push_back({x0, y0, x1, y1});
+        }
+    }
+    if (spans.empty())
+        return;
+    size_t stride = size_t(Window_Width) * 4;
+    size_t bytes = stride * Window_Height;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW); // 换一块新的存储，不用等上一次上传完成
+    auto *pixels = (uint8_t *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (pixels != nullptr) {
+        for (const DirtySpan &s: spans)
+            frame.toRGBA8(s.x0, s.y0, s.x1, s.y1, pixels + s.y0 * stride + size_t(s.x0) * 4, stride);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, FrameTexture);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, Window_Width);
+        for (const DirtySpan &s: spans) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, s.x0, s.y0, s.x1 - s.x0, s.y1 - s.y0, GL_RGBA, GL_UNSIGNED_BYTE,
+                            (void *) (s.y0 * stride + size_t(s.x0) * 4));
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// 定时检查帧缓冲，有新画好的块时才上传并重画
+static void Refresh(int) {
+    uint64_t version = frame.version();
+    if (version != shownVersion) {
+        shownVersion = version;
+        UploadFrame();
+        glutPostRedisplay();
+    }
+    glutTimerFunc(RefreshInterval, Refresh, 0);
 }
 
 
@@ -390,19 +451,9 @@ static void CompilerShaders() {
         exit(1);
     }
 
-    //the buffer of shader texts
-    string vs, fs;
-    //read the text of shader texts to buffer
-    if (!ReadFile(pVSFileName, vs)) {
-        exit(1);
-    }
-    if (!ReadFile(pFSFileName, fs)) {
-        exit(1);
-    }
-
     //add vertex shader and fragment shader
-    AddShader(ShaderProgram, vs.c_str(), GL_VERTEX_SHADER);
-    AddShader(ShaderProgram, fs.c_str(), GL_FRAGMENT_SHADER);
+    AddShader(ShaderProgram, pVSText, GL_VERTEX_SHADER);
+    AddShader(ShaderProgram, pFSText, GL_FRAGMENT_SHADER);
 
     //Link the shader program, and check the error
     GLint Success = 0;
@@ -426,20 +477,158 @@ static void CompilerShaders() {
 
     //use program
     glUseProgram(ShaderProgram);
+    glUniform1i(glGetUniformLocation(ShaderProgram, "frame"), 0);
 //    gWorldLocation = glGetUniformLocation(ShaderProgram, "gWVP");
 //    assert(gWorldLocation != 0xFFFFFFFF);
 
 }
 
+// 移动相机：right、up、ahead是相机坐标系中的位移，yaw、pitch是转动的角度。取消正在画的完整图像并叫醒渲染线程。
+// 窗口里图像左右是反的（见CreateVertexBuffer），水平方向的移动和转动都按屏幕上看到的方向取反
+static void MoveCamera(float right, float up, float ahead, float yaw, float pitch) {
+    if (animationPath != nullptr)       // 渲染动画序列时相机由关键帧决定
+        return;
+    {
+        lock_guard<mutex> lk(viewLock);
+        view.position += Camera::Move(view.yaw, -right, up, ahead);
+        view.yaw -= yaw;
+        view.pitch = Camera::ClampPitch(view.pitch + pitch);
+        view.version++;
+        view.lastInput = chrono::steady_clock::now();
+        fullCancel = true;
+    }
+    viewChanged.notify_all();
+}
+
+// W/S前后、A/D左右、Q/E上下移动
+static void Keyboard(unsigned char key, int, int) {
+    switch (key) {
+        case 'w': case 'W': MoveCamera(0, 0, MoveStep, 0, 0); break;
+        case 's': case 'S': MoveCamera(0, 0, -MoveStep, 0, 0); break;
+        case 'a': case 'A': MoveCamera(-MoveStep, 0, 0, 0, 0); break;
+        case 'd': case 'D': MoveCamera(MoveStep, 0, 0, 0, 0); break;
+        case 'q': case 'Q': MoveCamera(0, -MoveStep, 0, 0, 0); break;
+        case 'e': case 'E': MoveCamera(0, MoveStep, 0, 0, 0); break;
+        default: break;
+    }
+}
+
+// 方向键转动视角
+static void SpecialKeys(int key, int, int) {
+    switch (key) {
+        case GLUT_KEY_LEFT: MoveCamera(0, 0, 0, TurnStep, 0); break;
+        case GLUT_KEY_RIGHT: MoveCamera(0, 0, 0, -TurnStep, 0); break;
+        case GLUT_KEY_UP: MoveCamera(0, 0, 0, 0, TurnStep); break;
+        case GLUT_KEY_DOWN: MoveCamera(0, 0, 0, 0, -TurnStep); break;
+        default: break;
+    }
+}
+
+int dragX = -1, dragY = -1;     // 按住左键拖动时上一次的鼠标位置
+
+static void MouseButton(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON)
+        return;
+    dragX = state == GLUT_DOWN ? x : -1;
+    dragY = y;
+}
+
+// 按住左键拖动鼠标转动视角，画面跟着鼠标走
+static void MouseDrag(int x, int y) {
+    if (dragX < 0)
+        return;
+    MoveCamera(0, 0, 0, float(x - dragX) * MouseTurn, float(y - dragY) * MouseTurn);
+    dragX = x, dragY = y;
+}
+
 static void InitializeGlutCallbacks() {
     glutDisplayFunc(Render);
-    glutIdleFunc(Render); // 全局闲置回调
-//    glutPassiveMotionFunc(Mouse);
-//    glutSpecialFunc(Keyboard);
+    glutTimerFunc(RefreshInterval, Refresh, 0); // 不再在闲置时一直重画，有新像素时才重画
+    glutKeyboardFunc(Keyboard);
+    glutSpecialFunc(SpecialKeys);
+    glutMouseFunc(MouseButton);
+    glutMotionFunc(MouseDrag);
+}
+
+// 解析glutInit处理之后剩下的命令行参数：--scene 场景文件，--threads N，--tile N，--simd 1|4|8|16（球求交核的宽度，默认按CPU选择），
+// --no-packets（主光线逐条求交），--recursive（反射/折射光线递归追踪，不用波前队列），
+// --fixed-shadows（面光源用固定的10x10网格），--shadow-samples N（每个光源最多的阴影光线数），
+// --initial-shadow-samples N（每个光源先发出的阴影光线数），--coarse N（渐进渲染第一遍的像素间隔，1表示一遍画完），
+// --profile 报告.json（统计光线数、求交测试数和每块的耗时），--heatmap 图.ppm（逐像素开销的热力图），
+// --heatmap-metric rays|tests（热力图显示光线数还是求交测试数，默认tests），
+// --animation 动画文件（依次渲染整个序列，格式见animation.h），--sequence-output frame%04d.ppm（每帧写成PPM文件），
+// --preview-budget 毫秒（移动相机时预览一帧的时间预算，默认16），
+// --aa N（抗锯齿时边缘像素最多的采样数，默认16，1表示关闭），--aa-contrast x（与相邻像素的颜色差超过x才加采样，默认0.1），
+// --aa-error x（标准误差低于x时停止，默认0.01），--aa-budget x（每块平均每像素最多加几个采样，默认2），
+// --lightmaps（烘焙平面和球的光照可见度，着色时不发阴影光线），--lightmap-res N（光照图每单位长度的纹素数，默认64），
+// --light-samples N（光源多于N个时每个着色点按贡献抽N个光源，默认4，0表示总是计算全部光源）
+static bool ParseArguments(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-packets") == 0) {
+            settings.packets = false;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            settings.wavefront = false;
+        } else if (strcmp(argv[i], "--fixed-shadows") == 0) {
+            settings.adaptiveShadows = false;
+        } else if (strcmp(argv[i], "--lightmaps") == 0) {
+            settings.lightmaps = true;
+        } else if (i + 1 == argc) {
+            break;
+        } else if (strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "-t") == 0) {
+            settings.threads = unsigned(max(atoi(argv[++i]), 0));
+        } else if (strcmp(argv[i], "--tile") == 0) {
+            settings.tileSize = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            ActiveSphereKernel() = FindSphereKernel(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--scene") == 0) {
+            scenePath = argv[++i];
+        } else if (strcmp(argv[i], "--coarse") == 0) {
+            settings.coarseStride = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--shadow-samples") == 0) {
+            settings.shadowSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--initial-shadow-samples") == 0) {
+            settings.initialShadowSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--lightmap-res") == 0) {
+            settings.lightmapTexels = max(float(atof(argv[++i])), 1.0f);
+        } else if (strcmp(argv[i], "--light-samples") == 0) {
+            settings.lightSamples = min(max(atoi(argv[++i]), 0), MaxLightSamples);
+        } else if (strcmp(argv[i], "--aa") == 0) {
+            settings.aaMaxSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--aa-contrast") == 0) {
+            settings.aaContrast = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--aa-error") == 0) {
+            settings.aaError = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--aa-budget") == 0) {
+            settings.aaBudget = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profilePath = argv[++i];
+        } else if (strcmp(argv[i], "--preview-budget") == 0) {
+            preview = PreviewBudget(max(atof(argv[++i]), 1.0));
+        } else if (strcmp(argv[i], "--animation") == 0) {
+            animationPath = argv[++i];
+        } else if (strcmp(argv[i], "--sequence-output") == 0) {
+            sequenceOutput = argv[++i];
+        } else if (strcmp(argv[i], "--heatmap") == 0) {
+            heatmapPath = argv[++i];
+        } else if (strcmp(argv[i], "--heatmap-metric") == 0) {
+            const char *metric = argv[++i];
+            if (strcmp(metric, "rays") == 0) {
+                heatmapMetric = HeatmapRays;
+            } else if (strcmp(metric, "tests") == 0) {
+                heatmapMetric = HeatmapTests;
+            } else {
+                fprintf(stderr, "unknown heatmap metric '%s' (expected rays or tests)\n", metric);
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 int main(int argc, char **argv) {
     glutInit(&argc, argv);
+    if (!ParseArguments(argc, argv))
+        return 1;
 
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(1024, 768);
@@ -461,10 +650,20 @@ int main(int argc, char **argv) {
 
     CompilerShaders();
 
-    initScene();
+    if (scenePath == nullptr) {
+        if (!initScene())
+            return 1;
+    } else if (!LoadScene(scenePath, scene)) {
+        return 1;
+    }
+    PrintSceneInfo();
+    if (animationPath != nullptr && !LoadAnimation(animationPath, scene, animation))
+        return 1;
 
     CreateVertexBuffer();
 
+    StartRendering();
+
     glutMainLoop();
 
     return 0;
@@ -0,0 +1,91 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_MAPPED_FILE_H
+#define TCODE_MAPPED_FILE_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 把整个文件只读地映射进内存，内容按需由系统从磁盘读入，不需要先读到自己的缓冲区里
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() { close(); }
+
+    bool open(const char *path) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            bytes = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);      // 映射视图自己持有引用
+        }
+        CloseHandle(file);
+        if (bytes == nullptr)
+            return false;
+        length = size_t(fileSize.QuadPart);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);                   // 映射建立后不再需要文件描述符
+        if (p == MAP_FAILED)
+            return false;
+        bytes = static_cast<const char *>(p);
+        length = size_t(st.st_size);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (bytes == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        munmap(const_cast<char *>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char *data() const { return bytes; }
+
+    size_t size() const { return length; }
+
+    bool isOpen() const { return bytes != nullptr; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+};
+
+#endif //TCODE_MAPPED_FILE_H
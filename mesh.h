@@ -0,0 +1,262 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_MESH_H
+#define TCODE_MESH_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "objects.h"
+#include "bvh_builder.h"
+#include "counters.h"
+
+// 三角形求交预先算好的两条边（Möller–Trumbore算法），e1 = v1 - v0，e2 = v2 - v0
+struct MeshEdges {
+    float e1[3], e2[3];
+};
+
+// 索引三角形网格：顶点只存一份（每个顶点3个float），三角形是3个32位下标，另外为每个三角形存两条边。
+// 网格自带一棵BVH（叶子最多LeafSize个三角形），三角形按叶子顺序存放，不需要额外的下标数组。
+// 在场景的BVH里整个网格只是一个有界物体，光线进入网格的包围盒后再遍历网格自己的树
+class TriangleMesh final : public MyObject {
+public:
+    static const int LeafSize = 4;
+
+    explicit TriangleMesh(Material *_material) { material = _material; }
+
+    // 三角形只按下标引用顶点，复制后视图会指向原来的数组，所以只允许移动
+    TriangleMesh(const TriangleMesh &) = delete;
+    TriangleMesh &operator=(const TriangleMesh &) = delete;
+    TriangleMesh(TriangleMesh &&) = default;
+    TriangleMesh &operator=(TriangleMesh &&) = default;
+
+    // 以下三个函数在build之前调用
+    uint32_t addVertex(const Vec3 &v) {
+        vertexStorage.push_back(v[0]);
+        vertexStorage.push_back(v[1]);
+        vertexStorage.push_back(v[2]);
+        return uint32_t(vertexStorage.size() / 3 - 1);
+    }
+
+    void addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+        indexStorage.push_back(a);
+        indexStorage.push_back(b);
+        indexStorage.push_back(c);
+    }
+
+    void transform(float scale, const Vec3 &offset) {        // 先缩放再平移
+        for (size_t i = 0; i < vertexStorage.size(); i++)
+            vertexStorage[i] = vertexStorage[i] * scale + offset[i % 3];
+    }
+
+    size_t addedVertexCount() const { return vertexStorage.size() / 3; }
+
+    // 建网格的BVH，三角形按叶子顺序重排并算好边；之后不能再增加顶点和三角形
+    void build() {
+        size_t n = indexStorage.size() / 3;
+        std::vector<BVHBuilder::PrimRef> refs(n);
+        for (size_t i = 0; i < n; i++) {
+            for (int k = 0; k < 3; k++)
+                refs[i].box.grow(vertexAt(vertexStorage.data(), indexStorage[i * 3 + k]));
+            refs[i].centroid = refs[i].box.center();
+            refs[i].index = int(i);
+        }
+        BVHBuilder::Build(refs, LeafSize, nodeStorage, stats);
+        std::vector<uint32_t> ordered(indexStorage.size());
+        edgeStorage.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t *src = &indexStorage[size_t(refs[i].index) * 3];
+            ordered[i * 3] = src[0];
+            ordered[i * 3 + 1] = src[1];
+            ordered[i * 3 + 2] = src[2];
+            Vec3 v0 = vertexAt(vertexStorage.data(), src[0]);
+            Vec3 e1 = vertexAt(vertexStorage.data(), src[1]) - v0;
+            Vec3 e2 = vertexAt(vertexStorage.data(), src[2]) - v0;
+            edgeStorage[i] = {{e1[0], e1[1], e1[2]}, {e2[0], e2[1], e2[2]}};
+        }
+        indexStorage.swap(ordered);
+        vertexStorage.shrink_to_fit();        // 逐个添加时vector按倍数增长，这里还回多余的容量
+        nodeStorage.shrink_to_fit();
+        vertices = ArrayView<float>(vertexStorage);
+        indices = ArrayView<uint32_t>(indexStorage);
+        edges = ArrayView<MeshEdges>(edgeStorage);
+        nodes = ArrayView<BVHNode>(nodeStorage);
+    }
+
+    // 直接使用外部（比如场景缓存文件）已经按build的格式排好的数组，不复制也不重建
+    void adopt(ArrayView<float> _vertices, ArrayView<uint32_t> _indices, ArrayView<MeshEdges> _edges,
+               ArrayView<BVHNode> _nodes, const BVHStats &_stats) {
+        vertexStorage.clear();
+        indexStorage.clear();
+        edgeStorage.clear();
+        nodeStorage.clear();
+        vertices = _vertices;
+        indices = _indices;
+        edges = _edges;
+        nodes = _nodes;
+        stats = _stats;
+        stats.buildMs = 0;
+    }
+
+    ArrayView<float> getVertices() const { return vertices; }
+
+    ArrayView<uint32_t> getIndices() const { return indices; }
+
+    ArrayView<MeshEdges> getEdges() const { return edges; }
+
+    ArrayView<BVHNode> getNodes() const { return nodes; }
+
+    const BVHStats &getStats() const { return stats; }
+
+    size_t vertexCount() const { return vertices.size() / 3; }
+
+    size_t triangleCount() const { return edges.size(); }
+
+    size_t memoryBytes() const {
+        return vertices.size() * sizeof(float) + indices.size() * sizeof(uint32_t) +
+               edges.size() * sizeof(MeshEdges) + nodes.size() * sizeof(BVHNode);
+    }
+
+    bool bounds(AABB &box) const override {
+        if (nodes.empty())
+            return false;
+        box = nodes[0].box;
+        return true;
+    }
+
+    Hit intersect(const Ray &ray) const override { return intersect(ray, INFINITY); }
+
+    // 只找比tMax近的交点，场景的BVH传入当前最近距离，网格内部可以剪掉更多结点
+    Hit intersect(const Ray &ray, float tMax) const {
+        Hit hit;
+        int nearest = -1;
+        float t = tMax;
+        if (nodes.empty())
+            return hit;
+        Vec3 invDir = Vec3(1.0f) / ray.dir;
+        struct Entry {
+            int node;
+            float tNear;
+        } stack[BVHMaxDepth + 2];
+        int top = 0;
+        ScopedCount nodeTests(NodeTests), triangleTests(TriangleTests);
+        nodeTests.n = 1;
+        float tRoot;
+        if (!nodes[0].box.intersect(ray.start, invDir, t, tRoot))
+            return hit;
+        stack[top++] = {0, tRoot};
+        while (top > 0) {
+            Entry e = stack[--top];
+            if (e.tNear >= t)
+                continue;
+            const BVHNode &node = nodes[e.node];
+            if (node.count > 0) {
+                triangleTests.n += node.count;
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    float ti;
+                    if (intersectTriangle(i, ray, 0, t, ti)) {
+                        t = ti;
+                        nearest = i;
+                    }
+                }
+                continue;
+            }
+            nodeTests.n += 2;
+            Entry left{e.node + 1, 0}, right{node.offset, 0};
+            bool hitLeft = nodes[left.node].box.intersect(ray.start, invDir, t, left.tNear);
+            bool hitRight = nodes[right.node].box.intersect(ray.start, invDir, t, right.tNear);
+            if (hitLeft && hitRight) {
+                if (left.tNear > right.tNear)
+                    std::swap(left, right);
+                stack[top++] = right;
+                stack[top++] = left;
+            } else if (hitLeft) {
+                stack[top++] = left;
+            } else if (hitRight) {
+                stack[top++] = right;
+            }
+        }
+        if (nearest < 0)
+            return hit;
+        // 没有顶点法线，用面法线，朝向光线来的一侧
+        const MeshEdges &edge = edges[nearest];
+        Vec3 normal = Normalize(Cross(Vec3(edge.e1[0], edge.e1[1], edge.e1[2]),
+                                      Vec3(edge.e2[0], edge.e2[1], edge.e2[2])));
+        if (Dot(normal, ray.dir) > 0)
+            normal = -normal;
+        hit.t = t;
+        hit.position = ray.start + ray.dir * t;
+        hit.normal = normal;
+        hit.material = material;
+        return hit;
+    }
+
+    bool occluded(const Ray &ray, float tMin, float tMax) const override {
+        if (nodes.empty())
+            return false;
+        Vec3 invDir = Vec3(1.0f) / ray.dir;
+        int stack[BVHMaxDepth + 2];
+        int top = 0;
+        stack[top++] = 0;
+        ScopedCount nodeTests(NodeTests), triangleTests(TriangleTests);
+        while (top > 0) {
+            int index = stack[--top];
+            const BVHNode &node = nodes[index];
+            float tNear;
+            nodeTests.n++;
+            if (!node.box.intersect(ray.start, invDir, tMax, tNear))
+                continue;
+            if (node.count > 0) {
+                triangleTests.n += node.count;
+                for (int i = node.offset; i < node.offset + node.count; i++) {
+                    float t;
+                    if (intersectTriangle(i, ray, tMin, tMax, t))
+                        return true;
+                }
+                continue;
+            }
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+        }
+        return false;
+    }
+
+private:
+    std::vector<float> vertexStorage;      // build建的数据；adopt时为空
+    std::vector<uint32_t> indexStorage;
+    std::vector<MeshEdges> edgeStorage;
+    std::vector<BVHNode> nodeStorage;
+    ArrayView<float> vertices;             // 求交用的数组，指向上面的vector或外部内存
+    ArrayView<uint32_t> indices;           // 按叶子顺序，每个三角形3个
+    ArrayView<MeshEdges> edges;            // 与三角形同序
+    ArrayView<BVHNode> nodes;
+    BVHStats stats;
+
+    static Vec3 vertexAt(const float *v, uint32_t i) { return Vec3(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]); }
+
+    // Möller–Trumbore：交点在(tMin, tMax)内时返回true，t为交点距离
+    bool intersectTriangle(int i, const Ray &ray, float tMin, float tMax, float &t) const {
+        const MeshEdges &edge = edges[i];
+        Vec3 e1(edge.e1[0], edge.e1[1], edge.e1[2]);
+        Vec3 e2(edge.e2[0], edge.e2[1], edge.e2[2]);
+        Vec3 p = Cross(ray.dir, e2);
+        float det = Dot(e1, p);
+        if (det == 0)        // 光线与三角形平行（或三角形退化）
+            return false;
+        float invDet = 1.0f / det;
+        Vec3 s = ray.start - vertexAt(vertices.data(), indices[size_t(i) * 3]);
+        float u = Dot(s, p) * invDet;
+        if (u < 0 || u > 1)
+            return false;
+        Vec3 q = Cross(s, e1);
+        float v = Dot(ray.dir, q) * invDet;
+        if (v < 0 || u + v > 1)
+            return false;
+        t = Dot(e2, q) * invDet;
+        return t > tMin && t < tMax;
+    }
+};
+
+#endif //TCODE_MESH_H
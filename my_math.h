@@ -8,6 +8,7 @@
 #include <cmath>
 #include <cstring>
 #include <vector>
+#include "vec3.h"
 
 #define PI (3.14159265358979323846)
 #define PI_DIV_180 (0.017453292519943296)
@@ -0,0 +1,100 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_OBJ_H
+#define TCODE_OBJ_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+// 读一行（不含换行符），行再长也完整读入；文件结束返回false
+inline bool ReadLine(FILE *file, std::string &line) {
+    line.clear();
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), file) != nullptr) {
+        size_t len = strlen(buf);
+        if (len > 0 && buf[len - 1] == '\n') {
+            line.append(buf, len - 1);
+            return true;
+        }
+        line.append(buf, len);
+    }
+    return !line.empty();
+}
+
+// 解析面里的一个顶点引用（a、a/b、a/b/c、a//c），只取位置下标；负数表示从当前最后一个顶点倒数
+inline bool ParseFaceVertex(const char *&p, size_t vertexCount, uint32_t &index) {
+    char *end;
+    long i = strtol(p, &end, 10);
+    if (end == p)
+        return false;
+    p = end;
+    while (*p != 0 && *p != ' ' && *p != '\t' && *p != '\r')        // 跳过纹理坐标和法线下标
+        p++;
+    if (i < 0)
+        i += long(vertexCount) + 1;
+    if (i < 1 || size_t(i) > vertexCount)
+        return false;
+    index = uint32_t(i - 1);
+    return true;
+}
+
+// 流式读取OBJ文件里的顶点（v）和面（f），逐行处理，不把整个文件读进内存。多边形按扇形拆成三角形，
+// 纹理坐标、法线、分组和材质等其他内容忽略。顶点和三角形追加到mesh中，之后由调用者build
+inline bool LoadOBJ(const char *path, TriangleMesh &mesh) {
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "%s: unable to open OBJ file\n", path);
+        return false;
+    }
+    size_t base = mesh.addedVertexCount();        // 文件中的下标相对于本文件的第一个顶点
+    std::string line;
+    std::vector<uint32_t> face;
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && ReadLine(file, line)) {
+        lineNumber++;
+        const char *p = line.c_str();
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            char *end;
+            float v[3];
+            p += 2;
+            for (int k = 0; k < 3 && ok; k++) {
+                v[k] = strtof(p, &end);
+                ok = end != p;
+                p = end;
+            }
+            if (ok)
+                mesh.addVertex(Vec3(v[0], v[1], v[2]));
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            face.clear();
+            p += 2;
+            size_t vertexCount = mesh.addedVertexCount() - base;
+            while (ok) {
+                while (*p == ' ' || *p == '\t' || *p == '\r')
+                    p++;
+                if (*p == 0)
+                    break;
+                uint32_t index = 0;
+                ok = ParseFaceVertex(p, vertexCount, index);
+                face.push_back(uint32_t(base) + index);
+            }
+            ok = ok && face.size() >= 3;
+            for (size_t k = 2; ok && k < face.size(); k++)
+                mesh.addTriangle(face[0], face[k - 1], face[k]);
+        }
+        if (!ok)
+            fprintf(stderr, "%s:%d: malformed line\n", path, lineNumber);
+    }
+    fclose(file);
+    return ok;
+}
+
+#endif //TCODE_OBJ_H
@@ -0,0 +1,155 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_OBJECT_STORE_H
+#define TCODE_OBJECT_STORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include "objects.h"
+#include "counters.h"
+#include "mesh.h"
+
+enum ObjectType {
+    SPHERE, PLANE, GENERIC, MESH
+};
+
+// 物体编号：高4位是类型，低28位是该类型数组中的下标
+typedef uint32_t ObjectId;
+const ObjectId NoObject = 0xffffffffu;
+
+inline ObjectId MakeObjectId(ObjectType type, uint32_t index) {
+    return (uint32_t(type) << 28) | index;
+}
+
+inline ObjectType GetObjectType(ObjectId id) { return ObjectType(id >> 28); }
+
+inline uint32_t GetObjectIndex(ObjectId id) { return id & 0x0fffffffu; }
+
+// 按类型分开存放的物体：每种物体在自己的连续数组里，按编号的类型静态分派，求交不经过虚函数表。
+// 其他MyObject子类放在others里，仍然通过虚函数访问
+struct ObjectStore {
+    std::vector<Sphere> spheres;
+    std::vector<Plane> planes;
+    std::vector<TriangleMesh> meshes;
+    std::vector<MyObject *> others;
+    std::vector<PlaneGeometry> compiledPlanes;     // 与planes同序的求交常量，compile时生成
+
+    // 检查球和平面的参数，并把平面的求交常量连续存进compiledPlanes。物体增删之后、求交之前调用（Scene::build），
+    // 有不合法的物体（半径不是正数、法线为0、坐标不是有限数）时报错并返回false
+    bool compile() {
+        bool ok = true;
+        for (uint32_t i = 0; i < spheres.size(); i++) {
+            if (!spheres[i].valid()) {
+                fprintf(stderr, "scene: sphere %u has an invalid center or radius\n", i);
+                ok = false;
+            }
+        }
+        compiledPlanes.clear();
+        compiledPlanes.reserve(planes.size());
+        for (uint32_t i = 0; i < planes.size(); i++) {
+            if (!planes[i].valid()) {
+                fprintf(stderr, "scene: plane %u has an invalid point or normal\n", i);
+                ok = false;
+            }
+            compiledPlanes.push_back(planes[i].getGeometry());
+        }
+        return ok;
+    }
+
+    ObjectId add(const Sphere &sphere) {
+        spheres.push_back(sphere);
+        return MakeObjectId(SPHERE, uint32_t(spheres.size() - 1));
+    }
+
+    ObjectId add(const Plane &plane) {
+        planes.push_back(plane);
+        return MakeObjectId(PLANE, uint32_t(planes.size() - 1));
+    }
+
+    ObjectId add(TriangleMesh &&mesh) {
+        meshes.push_back(std::move(mesh));
+        return MakeObjectId(MESH, uint32_t(meshes.size() - 1));
+    }
+
+    ObjectId add(MyObject *object) {
+        others.push_back(object);
+        return MakeObjectId(GENERIC, uint32_t(others.size() - 1));
+    }
+
+    size_t size() const { return spheres.size() + planes.size() + meshes.size() + others.size(); }
+
+    bool bounds(ObjectId id, AABB &box) const {
+        uint32_t i = GetObjectIndex(id);
+        switch (GetObjectType(id)) {
+            case SPHERE:
+                return spheres[i].bounds(box);
+            case PLANE:
+                return planes[i].bounds(box);
+            case MESH:
+                return meshes[i].bounds(box);
+            default:
+                return others[i]->bounds(box);
+        }
+    }
+
+    // tMax是调用者已知的最近距离，网格用它剪枝，其他物体忽略
+    Hit intersect(ObjectId id, const Ray &ray, float tMax = INFINITY) const {
+        uint32_t i = GetObjectIndex(id);
+        switch (GetObjectType(id)) {
+            case SPHERE:
+                Count(SphereTests);
+                return spheres[i].intersect(ray);
+            case PLANE:
+                Count(PlaneTests);
+                return planes[i].intersect(ray);
+            case MESH:
+                return meshes[i].intersect(ray, tMax);
+            default:
+                Count(OtherTests);
+                return others[i]->intersect(ray);
+        }
+    }
+
+    bool occluded(ObjectId id, const Ray &ray, float tMin, float tMax) const {
+        uint32_t i = GetObjectIndex(id);
+        switch (GetObjectType(id)) {
+            case SPHERE:
+                Count(SphereTests);
+                return spheres[i].occluded(ray, tMin, tMax);
+            case PLANE:
+                Count(PlaneTests);
+                return planes[i].occluded(ray, tMin, tMax);
+            case MESH:
+                return meshes[i].occluded(ray, tMin, tMax);
+            default:
+                Count(OtherTests);
+                return others[i]->occluded(ray, tMin, tMax);
+        }
+    }
+
+    void occludePacket(ObjectId id, ShadowPacket &packet, int lanes) const {
+        uint32_t i = GetObjectIndex(id);
+        switch (GetObjectType(id)) {
+            case SPHERE:
+                Count(SphereTests, lanes);
+                spheres[i].occludePacket(packet, lanes);
+                break;
+            case PLANE:
+                Count(PlaneTests, lanes);
+                planes[i].occludePacket(packet, lanes);
+                break;
+            case MESH:
+                meshes[i].occludePacket(packet, lanes);
+                break;
+            default:
+                Count(OtherTests, lanes);
+                others[i]->occludePacket(packet, lanes);
+        }
+    }
+};
+
+#endif //TCODE_OBJECT_STORE_H
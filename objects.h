@@ -5,6 +5,7 @@
 #ifndef TCODE_OBJECTS_H
 #define TCODE_OBJECTS_H
 
+#include <algorithm>
 #include "my_math.h"
 
 enum MaterialType {
@@ -12,9 +13,9 @@ enum MaterialType {
 };
 
 struct Material {
-    Vector3f ka, kd, ks;    // 环境光照，漫反射，镜面反射系数，用于phong模型计算 0.1 1.0 0.5
+    Vec3 ka, kd, ks;    // 环境光照，漫反射，镜面反射系数，用于phong模型计算 0.1 1.0 0.5
     float shininess;    // 表面平整程度，用于镜面反射计算
-    Vector3f F0;            // 垂直入射时，反射光的占比：[(n-1)^2+k^2]/[(n+1)^2+k^2]
+    Vec3 F0;            // 垂直入射时，反射光的占比：[(n-1)^2+k^2]/[(n+1)^2+k^2]
     float ior;            // 折射率
     MaterialType type;
 
@@ -23,11 +24,11 @@ struct Material {
 
 struct RoughMaterial :Material
 {
-    RoughMaterial(const Vector3f _kd, const Vector3f _ks, float _shininess) : Material(ROUGH)
+    RoughMaterial(const Vec3 &_kd, const Vec3 &_ks, float _shininess) : Material(ROUGH)
     {
-        MultiplyVector3andFloat(ka, _kd, M_PI);
-        CopyVector3(kd, _kd);
-        CopyVector3(ks, _ks);
+        ka = _kd * M_PI;
+        kd = _kd;
+        ks = _ks;
         shininess = _shininess;
     }
 };
@@ -35,148 +36,369 @@ struct RoughMaterial :Material
 struct ReflectiveMaterial :Material
 {
     // n: 折射率；kappa：消光系数
-    ReflectiveMaterial(Vector3f n, Vector3f kappa) :Material(REFLECTIVE)
+    ReflectiveMaterial(const Vec3 &n, const Vec3 &kappa) :Material(REFLECTIVE)
     {
-        Vector3f one{1, 1, 1};
-        Vector3f nSubOne, nAddOne, kappa2, div1, div2;
-        SubVector3(nSubOne, n, one);
-        MultiplyVector3ByElement(nSubOne, nSubOne, nSubOne); // nSubOne = (n - one) * (n - one)
-        AddVector3(nAddOne, n, one);
-        MultiplyVector3ByElement(nAddOne, nAddOne, nAddOne); // nAddOne = (n + one) * (n + one)
-        MultiplyVector3ByElement(kappa2, kappa, kappa); // kappa2 = kappa*kappa
-        AddVector3(div1, nSubOne, kappa2);
-        AddVector3(div2, nAddOne, kappa2);
-        DivVector3ByElement(F0, div1, div2);
-        //F0 = ((n - one) * (n - one) + kappa * kappa) / ((n + one) * (n + one) + kappa * kappa); Fresnel公式
+        const Vec3 one(1, 1, 1);
+        F0 = ((n - one) * (n - one) + kappa * kappa) / ((n + one) * (n + one) + kappa * kappa); // Fresnel公式
     }
 };
 
 struct RefractiveMaterial :Material
 {
     // n，折射率；一个物体透明，光显然不会在其内部消逝，因此第二项忽略
-    RefractiveMaterial(Vector3f n) :Material(REFRACTIVE)
+    RefractiveMaterial(const Vec3 &n) :Material(REFRACTIVE)
     {
-        Vector3f one{1, 1, 1};
-        Vector3f nSubOne, nAddOne;
-        SubVector3(nSubOne, n, one);
-        MultiplyVector3ByElement(nSubOne, nSubOne, nSubOne);
-        AddVector3(nAddOne, n, one);
-        MultiplyVector3ByElement(nAddOne, nAddOne, nAddOne);
-        DivVector3ByElement(F0, nSubOne, nAddOne);
-        //  F0 = ((n - one) * (n - one)) / ((n + one) * (n + one));
+        const Vec3 one(1, 1, 1);
+        F0 = ((n - one) * (n - one)) / ((n + one) * (n + one));
         ior = (n[0]+n[1]+n[2])/3;		// 该物体的折射率取单色光或取均值都可以
     }
 };
 
 struct Ray        // 光照
 {
-    Vector3f start, dir;                // 起点，方向
-    Ray(Vector3f _start, Vector3f _dir) {
-        CopyVector3(start, _start);
-        CopyVector3(dir, _dir);        // 方向 归一化
-        NormalizeVector3(dir);
-    }
+    Vec3 start, dir;                // 起点，方向
+    Ray() {}
+    Ray(const Vec3 &_start, const Vec3 &_dir) : start(_start), dir(Normalize(_dir)) {}        // 方向 归一化
 };
 
 struct Hit        // 光线和物体表面交点
 {
     float t;                    // 交点距光线起点距离，当t大于0时表示相交，默认取-1表示无交点
-    Vector3f position, normal;        // 交点坐标，法线
+    Vec3 position, normal;        // 交点坐标，法线
     Material *material;            // 交点处表面的材质
     Hit() { t = -1; }
 };
 
 
+const int ShadowPacketMax = 128;                  // 一个阴影光线束最多的光线数，是最宽SIMD宽度的整数倍
+
+// 从同一点出发的一组阴影光线，按SoA存放方便SIMD逐通道处理。被挡住的光线把tMax置为负无穷，之后不会再有交点
+struct ShadowPacket {
+    Vec3 origin;
+    float tMin = epsilon;
+    int count = 0;
+    alignas(64) float dx[ShadowPacketMax];
+    alignas(64) float dy[ShadowPacketMax];
+    alignas(64) float dz[ShadowPacketMax];
+    alignas(64) float tMax[ShadowPacketMax];
+
+    void reset(const Vec3 &_origin) {
+        origin = _origin;
+        count = 0;
+    }
+
+    // 增加一条射向target的光线，返回false表示已满
+    bool add(const Vec3 &target) {
+        if (count == ShadowPacketMax)
+            return false;
+        Vec3 dir = target - origin;
+        float dist = Length(dir);
+        dx[count] = dir[0] / dist;
+        dy[count] = dir[1] / dist;
+        dz[count] = dir[2] / dist;
+        tMax[count] = dist - epsilon;
+        count++;
+        return true;
+    }
+
+    // 一次增加targets的前n条（不超过8条）光线，返回false表示放不下
+    bool add(const Vec3x8 &targets, int n) {
+        if (count + n > ShadowPacketMax)
+            return false;
+        Vec3x8 dir = targets - origin;
+        Float8 dist = Length(dir);
+        (dir / dist).store(dx + count, dy + count, dz + count, n);
+        for (int i = 0; i < n; i++)
+            tMax[count + i] = dist[i] - epsilon;
+        count += n;
+        return true;
+    }
+
+    // 补齐到SIMD宽度的整数倍，补上的通道一开始就是被挡住的状态
+    int paddedCount() {
+        int n = (count + 15) & ~15;
+        for (int i = count; i < n; i++) {
+            dx[i] = dy[i] = dz[i] = 0;
+            tMax[i] = -INFINITY;
+        }
+        return n;
+    }
+
+    bool blocked(int i) const { return tMax[i] == -INFINITY; }
+
+    void block(int i) { tMax[i] = -INFINITY; }
+
+    int visibleCount() const {
+        int n = 0;
+        for (int i = 0; i < count; i++)
+            n += blocked(i) ? 0 : 1;
+        return n;
+    }
+
+    Ray ray(int i) const {
+        return Ray(origin, Vec3(dx[i], dy[i], dz[i]));
+    }
+};
+
+struct AABB        // 轴对齐包围盒
+{
+    Vec3 min = Vec3(INFINITY), max = Vec3(-INFINITY);
+
+    void grow(const Vec3 &p) {
+        min = Min(min, p);
+        max = Max(max, p);
+    }
+
+    void grow(const AABB &box) {        // 按分量合并，空盒不会改变结果
+        min = Min(min, box.min);
+        max = Max(max, box.max);
+    }
+
+    Vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    bool overlaps(const AABB &box) const {        // 两个盒子有公共部分（含边界），空盒与任何盒子都不重叠
+        return min[0] <= box.max[0] && box.min[0] <= max[0] && min[1] <= box.max[1] && box.min[1] <= max[1] &&
+               min[2] <= box.max[2] && box.min[2] <= max[2];
+    }
+
+    float area() const {        // 表面积，空盒返回0
+        Vec3 d = max - min;
+        if (d[0] < 0 || d[1] < 0 || d[2] < 0)
+            return 0;
+        return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+
+    // slab法求光线与盒子的相交区间，invDir为方向的倒数；相交且区间与(0, tMax)重叠时返回true，tNear为进入距离
+    bool intersect(const Vec3 &start, const Vec3 &invDir, float tMax, float &tNear) const {
+        float t0 = 0, t1 = tMax;
+        for (int i = 0; i < 3; i++) {
+            float tA = (min[i] - start[i]) * invDir[i];
+            float tB = (max[i] - start[i]) * invDir[i];
+            if (tA > tB)
+                std::swap(tA, tB);
+            t0 = tA > t0 ? tA : t0;        // 写成比较形式，遇到NaN时保持原值
+            t1 = tB < t1 ? tB : t1;
+            if (t0 > t1)
+                return false;
+        }
+        tNear = t0;
+        return true;
+    }
+};
+
 class MyObject            // 定义一个基类(接口)，可交
 {
 public:
-    virtual Hit intersect(const Ray &ray) = 0;        // 需要根据表面类型实现
+    virtual Hit intersect(const Ray &ray) const = 0;        // 需要根据表面类型实现
+    virtual bool bounds(AABB &) const { return false; }        // 有界物体给出包围盒，无限大的物体返回false
+
+    // 遮挡查询：光线在(tMin, tMax)内是否与物体相交，不需要求交点信息。默认借用intersect，子类可以给出更快的实现
+    virtual bool occluded(const Ray &ray, float tMin, float tMax) const {
+        Hit hit = intersect(ray);
+        return hit.t > tMin && hit.t < tMax;
+    }
+
+    // 用本物体遮挡共起点的一组阴影光线（前lanes条），被挡住的光线标记为blocked。默认逐条调用occluded
+    virtual void occludePacket(ShadowPacket &packet, int lanes) const {
+        for (int k = 0; k < lanes; k++) {
+            if (!packet.blocked(k) && occluded(packet.ray(k), packet.tMin, packet.tMax[k]))
+                packet.block(k);
+        }
+    }
+
+    Material *getMaterial() const { return material; }
 
 protected:
     Material *material;
 };
 
-class Sphere : public MyObject        // 定义球体
+class Sphere final : public MyObject        // 定义球体
 {
-    Vector3f center;
+    Vec3 center;
     float radius;
+    float radius2, invRadius;       // r^2和1/r，构造时算好，求交和求法线时不再重算
 public:
-    Sphere(const Vector3f _center, float _radius, Material *_material) {
-        CopyVector3(center, _center);
+    Sphere(const Vec3 &_center, float _radius, Material *_material) {
+        center = _center;
         radius = _radius;
+        radius2 = _radius * _radius;
+        invRadius = 1.0f / _radius;
         material = _material;
     }
 
     ~Sphere() {}
 
-    Hit intersect(const Ray &ray) {
+    // 半径为正的有限数、球心有限时才是合法的球（见ObjectStore::compile）
+    bool valid() const {
+        return radius > 0 && std::isfinite(radius) && IsFinite(center);
+    }
+
+    bool bounds(AABB &box) const override {
+        box.min = center - Vec3(radius);
+        box.max = center + Vec3(radius);
+        return true;
+    }
+
+    Hit intersect(const Ray &ray) const override {
         Hit hit;
-        Vector3f dist;
-        SubVector3(dist, ray.start, center);            // 距离
-        float a = DotVector3(ray.dir, ray.dir);        // dot表示点乘，这里是联立光线与球面方程
-        float b = DotVector3(dist, ray.dir) * 2.0f;
-        float c = DotVector3(dist, dist) - radius * radius;
-        float delta = b * b - 4.0f * a * c;        // b^2-4ac
+        Vec3 dist = ray.start - center;            // 距离
+        float b = Dot(dist, ray.dir);        // 联立光线与球面方程；光线方向已归一化，a = 1，这里是b/2
+        float c = Dot(dist, dist) - radius2;
+        float delta = b * b - c;
         if (delta < 0)        // 无交点
             return hit;
         float sqrt_delta = sqrtf(delta);
-        float t1 = (-b + sqrt_delta) / 2.0f / a;    // 求得两个交点，t1 >= t2
-        float t2 = (-b - sqrt_delta) / 2.0f / a;
+        float t1 = -b + sqrt_delta;    // 求得两个交点，t1 >= t2
+        float t2 = -b - sqrt_delta;
         if (t1 <= 0)
             return hit;
-        hit.t = (t2 > 0) ? t2 : t1;        // 取近的那个交点
-        Vector3f hit_dist;
-        MultiplyVector3andFloat(hit_dist, ray.dir, hit.t);
-        AddVector3(hit.position, ray.start, hit_dist); // hit.position = ray.start + ray.dir * hit.t;
-        Vector3f sub_ans;
-        SubVector3(sub_ans, hit.position, center);
-        DivVector3andFloat(hit.normal, sub_ans, radius);//hit.normal = (hit.position - center) / radius;
+        return hitAt(ray, (t2 > 0) ? t2 : t1);        // 取近的那个交点
+    }
+
+    Hit hitAt(const Ray &ray, float t) const {        // 已知交点距离t时补全交点信息
+        Hit hit;
+        hit.t = t;
+        hit.position = ray.start + ray.dir * hit.t;
+        hit.normal = (hit.position - center) * invRadius;
         hit.material = material;
         return hit;
     }
 
+    const Vec3 &getCenter() const { return center; }
+
+    void setCenter(const Vec3 &_center) { center = _center; }        // 移动之后要更新场景的BVH（Scene::update）
+
+    float getRadius() const { return radius; }
+
+    float getRadius2() const { return radius2; }
+
+    bool occluded(const Ray &ray, float tMin, float tMax) const override {
+        Vec3 dist = ray.start - center;
+        float b = Dot(dist, ray.dir);        // 光线方向已归一化，a = 1，这里是b/2
+        float c = Dot(dist, dist) - radius2;
+        float delta = b * b - c;
+        if (delta < 0)
+            return false;
+        float sqrt_delta = sqrtf(delta);
+        float t = -b - sqrt_delta;
+        if (t > tMin && t < tMax)
+            return true;
+        t = -b + sqrt_delta;
+        return t > tMin && t < tMax;
+    }
 };
 
-class Plane : public MyObject {    // 点法式方程表示平面
-    Vector3f normal;        // 法线
-    Vector3f p0;            // 面上一点坐标，N(p-p0)=0
+// 平面求交用到的常量，构造时算好：单位法线n和d = n·p0，平面方程为n·p = d。法线与坐标轴平行时axis是那根轴，
+// 点乘只剩一次乘法，结果与完整的点乘逐位相同；否则axis为-1。32字节对齐，每条缓存行放两个，
+// 场景把所有平面的这部分连续存放（见ObjectStore::compile），求交时只扫这个数组
+struct alignas(32) PlaneGeometry {
+    Vec3 normal;
+    float d = 0;
+    int axis = -1;
+
+    PlaneGeometry() {}
+
+    PlaneGeometry(const Vec3 &p0, const Vec3 &_normal) {
+        normal = Normalize(_normal);
+        d = Dot(normal, p0);
+        for (int i = 0; i < 3; i++) {
+            if (fabsf(normal[i]) == 1)
+                axis = i;
+        }
+    }
+
+    bool valid() const { return IsFinite(normal) && std::isfinite(d); }        // 法线为0时归一化得到NaN
+
+    float project(const Vec3 &v) const { return axis >= 0 ? v[axis] * normal[axis] : Dot(v, normal); }
+
+    // 光线到平面的距离t，光线与平面平行时返回false
+    bool distance(const Ray &ray, float &t) const {
+        float nD = project(ray.dir);    // 射线方向与法向量点乘，为0表示平行
+        if (nD == 0)
+            return false;
+        t = (d - project(ray.start)) / nD;
+        return true;
+    }
+
+    bool occluded(const Ray &ray, float tMin, float tMax) const {
+        float t;
+        return distance(ray, t) && t > tMin && t < tMax;
+    }
+
+    void occludePacket(ShadowPacket &packet, int lanes) const {
+        float dist = d - project(packet.origin);        // 所有光线共用
+        const float *dir = axis == 0 ? packet.dx : axis == 1 ? packet.dy : packet.dz;
+        for (int k = 0; k < lanes; k += 8) {        // lanes是16的倍数
+            Float8 nD;
+            if (axis >= 0) {
+                for (int i = 0; i < 8; i++)
+                    nD[i] = dir[k + i] * normal[axis];
+            } else {
+                nD = Dot(Vec3x8::Load(packet.dx + k, packet.dy + k, packet.dz + k), normal);
+            }
+            for (int i = 0; i < 8; i++) {
+                float t = dist / nD[i];
+                if (nD[i] != 0 && t > packet.tMin && t < packet.tMax[k + i])
+                    packet.block(k + i);
+            }
+        }
+    }
+};
+
+class Plane final : public MyObject {    // 点法式方程表示平面
+    PlaneGeometry geometry;     // 单位法线和n·p0
+    Vec3 p0;            // 面上一点坐标，N(p-p0)=0
 public:
-    Plane(Vector3f _p0, Vector3f _normal, Material *_material) {
-        CopyVector3(normal, _normal);
-        NormalizeVector3(_normal);
-        CopyVector3(p0, _p0);
+    Plane(const Vec3 &_p0, const Vec3 &_normal, Material *_material) : geometry(_p0, _normal) {
+        p0 = _p0;
         material = _material;
     }
 
-    Hit intersect(const Ray &ray) {
-        Hit hit;
-        float nD = DotVector3(ray.dir, normal);    // 射线方向与法向量点乘，为0表示平行
-        if (nD == 0)
-            return hit;
+    bool valid() const { return geometry.valid() && IsFinite(p0); }
 
-        float t1 = (DotVector3(normal, p0) - DotVector3(normal, ray.start)) / nD;
-        if (t1 < 0)
-            return hit;
-        hit.t = t1;
-        Vector3f multipleRes;
-        MultiplyVector3andFloat(multipleRes, ray.dir, hit.t);
-        AddVector3(hit.position, ray.start, multipleRes); // hit.position = ray.start + ray.dir * hit.t;
-        CopyVector3(hit.normal, normal);
+    Hit intersect(const Ray &ray) const override {
+        float t1;
+        if (!geometry.distance(ray, t1) || t1 < 0)
+            return Hit();
+        return hitAt(ray, t1);
+    }
+
+    Hit hitAt(const Ray &ray, float t) const {        // 已知交点距离t时补全交点信息
+        Hit hit;
+        hit.t = t;
+        hit.position = ray.start + ray.dir * hit.t;
+        hit.normal = geometry.normal;
         hit.material = material;
         return hit;
     }
+
+    const Vec3 &getPoint() const { return p0; }
+
+    const Vec3 &getNormal() const { return geometry.normal; }
+
+    const PlaneGeometry &getGeometry() const { return geometry; }
+
+    bool occluded(const Ray &ray, float tMin, float tMax) const override {
+        return geometry.occluded(ray, tMin, tMax);
+    }
+
+    void occludePacket(ShadowPacket &packet, int lanes) const override {
+        geometry.occludePacket(packet, lanes);
+    }
 };
 
 class Cube : public MyObject {
-    Vector3f center;
+    Vec3 center;
     float a;
 public:
-    Cube(Vector3f _center, float _a) {
-        CopyVector3(center, _center);
+    Cube(const Vec3 &_center, float _a) {
+        center = _center;
         a = _a;
     }
 
-    Hit intersect(const Ray &ray) {
+    Hit intersect(const Ray &ray) const override {
         Hit hit;
         return hit;
     }
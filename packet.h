@@ -0,0 +1,69 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_PACKET_H
+#define TCODE_PACKET_H
+
+#include "my_math.h"
+#include "objects.h"
+
+// 共起点光线束的视锥：由四条棱边光线确定的四个过起点的平面（可以再加一个远平面），束中所有光线都在视锥内部
+struct Frustum {
+    Vec3 origin;
+    Vec3 normal[5];        // 指向视锥内部的平面法线，内部满足 normal·p >= d
+    float d[5];
+    int planeCount = 0;
+    Vec3 axis;             // 视锥中心方向（归一化）
+
+    // corners按顺序给出四条棱边光线的方向（绕一圈），inside是视锥内部的中心方向。
+    // 起点和四条棱边几乎共面时视锥退化，返回false，调用者应改用逐条光线
+    bool build(const Vec3 &_origin, const Vec3 corners[4], const Vec3 &inside) {
+        origin = _origin;
+        axis = Normalize(inside);
+        planeCount = 4;
+        bool valid = true;
+        for (int i = 0; i < 4; i++) {
+            normal[i] = Cross(corners[i], corners[(i + 1) % 4]);
+            float side = Dot(normal[i], axis);
+            if (side < 0) {
+                normal[i] = -normal[i];
+                side = -side;
+            }
+            if (!(side > 1e-3f * Length(normal[i])))
+                valid = false;
+            d[i] = Dot(normal[i], origin);
+        }
+        return valid;
+    }
+
+    // 增加一个远平面：光线不会越过过point、法线朝向起点一侧的平面
+    void setFar(const Vec3 &point, const Vec3 &towardOrigin) {
+        normal[4] = towardOrigin;
+        d[4] = Dot(towardOrigin, point);
+        planeCount = 5;
+    }
+
+    // 保守测试：盒子完全在某个平面外侧时返回true，束中没有光线能与它相交
+    bool outside(const AABB &box) const {
+        for (int i = 0; i < planeCount; i++) {
+            Vec3 p;        // 沿法线方向最远的顶点
+            for (int k = 0; k < 3; k++)
+                p[k] = normal[i][k] > 0 ? box.max[k] : box.min[k];
+            if (Dot(normal[i], p) < d[i])
+                return true;
+        }
+        return false;
+    }
+
+    // 盒子中心沿视锥中心方向的距离，用于由近到远排序
+    float distance(const AABB &box) const {
+        return Dot(box.center() - origin, axis);
+    }
+};
+
+const int PacketWidth = 8;                        // 光线束为8x8个像素
+const int PacketRays = PacketWidth * PacketWidth;
+const int PacketMaxLeaves = 64;                   // 视锥覆盖的叶子超过这个数就认为束已经发散
+
+#endif //TCODE_PACKET_H
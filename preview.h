@@ -0,0 +1,65 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_PREVIEW_H
+#define TCODE_PREVIEW_H
+
+#include <algorithm>
+#include <cmath>
+#include "renderer.h"
+
+const int MaxPreviewStride = 16;
+
+// 移动相机时的预览质量：每stride x stride个像素只算一个（渐进渲染第一遍的做法），面光源的阴影光线也减少。
+// 每画完一帧按耗时调整，让预览一帧的时间接近预算：时间与像素数成正比，所以步长按耗时比的平方根缩放；
+// 步长降到1还有富余时再加阴影光线
+class PreviewBudget {
+public:
+    explicit PreviewBudget(double _budgetMs) : budgetMs(_budgetMs) {}
+
+    int stride() const { return std::min(std::max(int(ceilf(scale)), 1), MaxPreviewStride); }
+
+    int shadowSamples() const { return fullShadows ? 16 : 4; }
+
+    // 预览用的设置：完整设置基础上改用自适应阴影，并减少阴影光线
+    RenderSettings settings(const RenderSettings &full) const {
+        RenderSettings preview = full;
+        preview.adaptiveShadows = true;
+        preview.shadowSamples = std::min(shadowSamples(), full.shadowSamples);
+        preview.initialShadowSamples = std::min(4, preview.shadowSamples);
+        preview.aaMaxSamples = 1;       // 预览只有一遍粗略的采样，不做抗锯齿
+        return preview;
+    }
+
+    // 预览只画一遍，步长为stride()
+    Pass pass() const {
+        Pass p;
+        p.stride = stride();
+        return p;
+    }
+
+    // 报告刚画完的一帧预览的耗时
+    void update(double frameMs) {
+        double ratio = std::max(frameMs, 0.01) / budgetMs;
+        if (fullShadows && ratio > 1) {         // 先去掉加上的阴影光线
+            fullShadows = false;
+            return;
+        }
+        if (!fullShadows && stride() == 1 && ratio < 0.5) {
+            fullShadows = true;
+            return;
+        }
+        // 平方根再开一次方（指数0.25），每帧只走一半，耗时有波动时不会来回跳
+        scale = float(std::min(std::max(scale * pow(ratio, 0.25), 1.0), double(MaxPreviewStride)));
+    }
+
+    double getBudgetMs() const { return budgetMs; }
+
+private:
+    double budgetMs;
+    float scale = 8;                // 步长的连续值，stride()取整
+    bool fullShadows = false;
+};
+
+#endif //TCODE_PREVIEW_H
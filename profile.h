@@ -0,0 +1,202 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_PROFILE_H
+#define TCODE_PROFILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "counters.h"
+#include "renderer.h"
+
+// 一块的逐像素开销（光线数和求交测试数），下标与块的颜色缓冲相同
+struct TileCost {
+    uint32_t *rays = nullptr;
+    uint32_t *tests = nullptr;
+};
+
+// 把一段计算新增的光线数和测试数记到一个像素上；cost为nullptr（没开统计）时什么也不做
+class PixelCostScope {
+public:
+    PixelCostScope(TileCost *_cost, int _pixel) : cost(_cost), pixel(_pixel) {
+        if (cost != nullptr)
+            rays = threadCounters->rays(), tests = threadCounters->tests();
+    }
+
+    ~PixelCostScope() {
+        if (cost == nullptr)
+            return;
+        cost->rays[pixel] += uint32_t(threadCounters->rays() - rays);
+        cost->tests[pixel] += uint32_t(threadCounters->tests() - tests);
+    }
+
+private:
+    TileCost *cost;
+    int pixel;
+    uint64_t rays = 0, tests = 0;
+};
+
+enum HeatmapMetric {
+    HeatmapRays, HeatmapTests
+};
+
+// 一帧的开销统计：每个线程一份计数器（互不干扰，结束后汇总），每个像素的光线数和测试数，每块的耗时。
+// 由RenderFrame填写，之后可以输出JSON报告和伪彩色的开销热力图
+class TraceProfile {
+public:
+    // 开始一帧，清空上一帧的数据
+    void begin(int _width, int _height, const std::vector<Tile> &_tiles, int tileSize, unsigned threads) {
+        width = _width, height = _height;
+        tiles = _tiles;
+        tileSeconds.assign(tiles.size(), 0);
+        pixelRays.assign(size_t(width) * height, 0);
+        pixelTests.assign(size_t(width) * height, 0);
+        workers.assign(threads, Worker());
+        for (Worker &worker: workers) {
+            worker.rays.assign(size_t(tileSize) * tileSize, 0);
+            worker.tests.assign(size_t(tileSize) * tileSize, 0);
+        }
+        seconds = 0;
+    }
+
+    TraceCounters *counters(unsigned worker) { return &workers[worker].counters; }
+
+    // 该线程画当前块时用的逐像素开销缓冲，画完由endTile合并并清零
+    TileCost *tileCost(unsigned worker) {
+        Worker &w = workers[worker];
+        w.cost.rays = w.rays.data();
+        w.cost.tests = w.tests.data();
+        return &w.cost;
+    }
+
+    // 一块画完：逐像素开销加到整帧上，记录耗时。同一遍里的块互不重叠，不需要加锁
+    void endTile(unsigned worker, size_t tileIndex, double tileTime) {
+        const Tile &tile = tiles[tileIndex];
+        Worker &w = workers[worker];
+        int tileWidth = tile.x1 - tile.x0;
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                size_t i = size_t(y - tile.y0) * tileWidth + (x - tile.x0);
+                pixelRays[size_t(y) * width + x] += w.rays[i];
+                pixelTests[size_t(y) * width + x] += w.tests[i];
+                w.rays[i] = w.tests[i] = 0;
+            }
+        }
+        tileSeconds[tileIndex] += tileTime;
+        w.counters.tiles++;
+        w.counters.tileSeconds += tileTime;
+    }
+
+    void setSeconds(double _seconds) { seconds = _seconds; }
+
+    TraceCounters total() const {
+        TraceCounters sum;
+        for (const Worker &worker: workers)
+            sum.add(worker.counters);
+        return sum;
+    }
+
+    // 输出JSON报告：各种光线和测试的总数、弹射次数直方图、每个线程的计数、逐像素开销的概况和每块的耗时
+    bool writeJSON(const char *path) const {
+        FILE *out = fopen(path, "w");
+        if (out == nullptr) {
+            fprintf(stderr, "%s: unable to write profile\n", path);
+            return false;
+        }
+        TraceCounters sum = total();
+        const uint64_t *c = sum.counts;
+        size_t pixels = pixelRays.size();
+        fprintf(out, "{\n  \"frame\": [%d, %d],\n  \"seconds\": %.6f,\n  \"threads\": %zu,\n", width, height, seconds,
+                workers.size());
+        fprintf(out, "  \"rays\": {\"primary\": %llu, \"secondary\": %llu, \"shadow\": %llu, \"total\": %llu},\n",
+                ull(c[PrimaryRays]), ull(c[SecondaryRays]), ull(c[ShadowRays]), ull(sum.rays()));
+        fprintf(out, "  \"tests\": {\"node\": %llu, \"sphere\": %llu, \"plane\": %llu, \"triangle\": %llu, "
+                     "\"other\": %llu, \"total\": %llu},\n",
+                ull(c[NodeTests]), ull(c[SphereTests]), ull(c[PlaneTests]), ull(c[TriangleTests]),
+                ull(c[OtherTests]), ull(sum.tests()));
+        fprintf(out, "  \"depth\": [");
+        for (int i = 0; i < DepthBins; i++)
+            fprintf(out, "%s%llu", i ? ", " : "", ull(sum.depth[i]));
+        fprintf(out, "],\n  \"pixels\": {\"maxRays\": %u, \"meanRays\": %.3f, \"maxTests\": %u, \"meanTests\": %.3f},\n",
+                maxOf(pixelRays), pixels ? double(sumOf(pixelRays)) / pixels : 0.0, maxOf(pixelTests),
+                pixels ? double(sumOf(pixelTests)) / pixels : 0.0);
+        fprintf(out, "  \"perThread\": [");
+        for (size_t i = 0; i < workers.size(); i++) {
+            const TraceCounters &w = workers[i].counters;
+            fprintf(out, "%s\n    {\"tiles\": %llu, \"seconds\": %.6f, \"rays\": %llu, \"tests\": %llu}", i ? "," : "",
+                    ull(w.tiles), w.tileSeconds, ull(w.rays()), ull(w.tests()));
+        }
+        double maxTile = tileSeconds.empty() ? 0 : *std::max_element(tileSeconds.begin(), tileSeconds.end());
+        fprintf(out, "\n  ],\n  \"tiles\": {\"count\": %zu, \"maxMs\": %.4f, \"list\": [", tiles.size(), maxTile * 1e3);
+        for (size_t i = 0; i < tiles.size(); i++) { // [x0, y0, x1, y1, 毫秒]
+            const Tile &t = tiles[i];
+            fprintf(out, "%s\n    [%d, %d, %d, %d, %.4f]", i ? "," : "", t.x0, t.y0, t.x1, t.y1, tileSeconds[i] * 1e3);
+        }
+        fprintf(out, "\n  ]}\n}\n");
+        bool ok = ferror(out) == 0;
+        ok = fclose(out) == 0 && ok;
+        if (!ok)
+            fprintf(stderr, "%s: unable to write profile\n", path);
+        return ok;
+    }
+
+    // 输出逐像素开销的热力图（PPM）：按对数刻度从黑、蓝、紫、红、黄到白，最亮的是开销最大的像素
+    bool writeHeatmap(const char *path, HeatmapMetric metric) const {
+        const std::vector<uint32_t> &values = metric == HeatmapRays ? pixelRays : pixelTests;
+        FILE *out = fopen(path, "wb");
+        if (out == nullptr) {
+            fprintf(stderr, "%s: unable to write heatmap\n", path);
+            return false;
+        }
+        static const float ramp[6][3] = {{0, 0, 0}, {0, 0, 1}, {0.7f, 0, 1}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}};
+        float scale = 1 / std::log1p(float(std::max(maxOf(values), 1u)));
+        std::vector<unsigned char> row(size_t(width) * 3);
+        fprintf(out, "P6\n%d %d\n255\n", width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float v = std::log1p(float(values[size_t(y) * width + x])) * scale * 5;
+                int k = std::min(int(v), 4);
+                float f = std::min(v - k, 1.0f);
+                for (int j = 0; j < 3; j++)
+                    row[x * 3 + j] = (unsigned char) (255 * (ramp[k][j] + (ramp[k + 1][j] - ramp[k][j]) * f) + 0.5f);
+            }
+            fwrite(row.data(), 1, row.size(), out);
+        }
+        bool ok = ferror(out) == 0;
+        ok = fclose(out) == 0 && ok;
+        if (!ok)
+            fprintf(stderr, "%s: unable to write heatmap\n", path);
+        return ok;
+    }
+
+private:
+    struct Worker {
+        TraceCounters counters;
+        std::vector<uint32_t> rays, tests;    // 当前块的逐像素开销
+        TileCost cost;
+    };
+
+    int width = 0, height = 0;
+    double seconds = 0;
+    std::vector<Tile> tiles;
+    std::vector<double> tileSeconds;          // 每块各遍的总耗时
+    std::vector<uint32_t> pixelRays, pixelTests;
+    std::vector<Worker> workers;
+
+    static unsigned long long ull(uint64_t v) { return (unsigned long long) v; }
+
+    static uint32_t maxOf(const std::vector<uint32_t> &v) { return v.empty() ? 0 : *std::max_element(v.begin(), v.end()); }
+
+    static uint64_t sumOf(const std::vector<uint32_t> &v) {
+        uint64_t sum = 0;
+        for (uint32_t x: v)
+            sum += x;
+        return sum;
+    }
+};
+
+#endif //TCODE_PROFILE_H
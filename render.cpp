@@ -0,0 +1,173 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+// 不需要窗口和OpenGL的命令行渲染程序：图像大小在运行时指定，分成若干行一带依次渲染，画好的带交给后台线程写进
+// PPM/PFM/PNG文件。内存里同时只有几带，与图像大小无关，16K x 16K的图也能画；写文件和光线追踪同时进行
+//   tcode_render --scene 场景文件 --size 宽x高 --output 图.png [选项]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string>
+#define TCODE_COUNT_ALLOCATIONS
+#include "alloc_counter.h"
+#include "image_file.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "simd_sphere.h"
+#include "tracer.h"
+
+using namespace std;
+
+struct CommandLine {
+    const char *scenePath = nullptr;
+    const char *output = "render.ppm";
+    int width = 1024, height = 768;
+    int bandRows = 32;          // 每带的行数，取块边长的整数倍
+    int bands = 3;              // 带缓冲的个数：一带在画，其余的在写或者等着写
+    float yaw = 0, pitch = 0;
+    RenderSettings settings;
+};
+
+// 参数：--scene 场景文件（必需），--size 宽x高（默认1024x768），--output 图.ppm|.pfm|.png（默认render.ppm，
+// PNG只用deflate的存储块、不压缩，文件约为宽x高x3字节），
+// --band N（每带的行数，默认32），--bands N（带缓冲个数，默认3），--yaw 度、--pitch 度（相机朝向），
+// --threads N，--tile N，--simd 1|4|8|16，--shadow-samples N，--initial-shadow-samples N，
+// --fixed-shadows，--no-packets，--recursive，--aa N，--aa-contrast x，--aa-error x，--aa-budget x，
+// --lightmaps，--lightmap-res N，--light-samples N（与窗口程序相同）
+static bool ParseArguments(int argc, char **argv, CommandLine &cl) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-packets") == 0) {
+            cl.settings.packets = false;
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            cl.settings.wavefront = false;
+        } else if (strcmp(argv[i], "--fixed-shadows") == 0) {
+            cl.settings.adaptiveShadows = false;
+        } else if (strcmp(argv[i], "--lightmaps") == 0) {
+            cl.settings.lightmaps = true;
+        } else if (i + 1 == argc) {
+            fprintf(stderr, "unknown or incomplete option '%s'\n", argv[i]);
+            return false;
+        } else if (strcmp(argv[i], "--scene") == 0) {
+            cl.scenePath = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 || strcmp(argv[i], "-o") == 0) {
+            cl.output = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (sscanf(argv[++i], "%dx%d", &cl.width, &cl.height) != 2 || cl.width <= 0 || cl.height <= 0) {
+                fprintf(stderr, "malformed size '%s' (expected WIDTHxHEIGHT)\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--band") == 0) {
+            cl.bandRows = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--bands") == 0) {
+            cl.bands = max(atoi(argv[++i]), 2);
+        } else if (strcmp(argv[i], "--yaw") == 0) {
+            cl.yaw = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--pitch") == 0) {
+            cl.pitch = Camera::ClampPitch(float(atof(argv[++i])));
+        } else if (strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "-t") == 0) {
+            cl.settings.threads = unsigned(max(atoi(argv[++i]), 0));
+        } else if (strcmp(argv[i], "--tile") == 0) {
+            cl.settings.tileSize = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--simd") == 0) {
+            ActiveSphereKernel() = FindSphereKernel(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--aa") == 0) {
+            cl.settings.aaMaxSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--aa-contrast") == 0) {
+            cl.settings.aaContrast = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--aa-error") == 0) {
+            cl.settings.aaError = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--aa-budget") == 0) {
+            cl.settings.aaBudget = max(float(atof(argv[++i])), 0.0f);
+        } else if (strcmp(argv[i], "--lightmap-res") == 0) {
+            cl.settings.lightmapTexels = max(float(atof(argv[++i])), 1.0f);
+        } else if (strcmp(argv[i], "--light-samples") == 0) {
+            cl.settings.lightSamples = min(max(atoi(argv[++i]), 0), MaxLightSamples);
+        } else if (strcmp(argv[i], "--shadow-samples") == 0) {
+            cl.settings.shadowSamples = max(atoi(argv[++i]), 1);
+        } else if (strcmp(argv[i], "--initial-shadow-samples") == 0) {
+            cl.settings.initialShadowSamples = max(atoi(argv[++i]), 1);
+        } else {
+            fprintf(stderr, "unknown option '%s'\n", argv[i]);
+            return false;
+        }
+    }
+    if (cl.scenePath == nullptr) {
+        fprintf(stderr, "usage: %s --scene FILE [--size WIDTHxHEIGHT] [--output IMAGE.ppm|pfm|png] [options]\n"
+                        "  (PNG output is uncompressed: stored deflate blocks, about 3 bytes per pixel)\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    CommandLine cl;
+    if (!ParseArguments(argc, argv, cl))
+        return 1;
+    ImageFormat format;
+    if (!ImageFormatFromPath(cl.output, format)) {
+        fprintf(stderr, "%s: unknown image format (expected .ppm, .pfm or .png)\n", cl.output);
+        return 1;
+    }
+    Scene scene;
+    if (!LoadScene(cl.scenePath, scene))
+        return 1;
+    scene.cameraYaw = cl.yaw;
+    scene.cameraPitch = cl.pitch;
+
+    // 一遍画完；每带是整数个块，块的分界与整幅图像一次画完时相同，结果逐像素一致
+    RenderSettings settings = cl.settings;
+    settings.coarseStride = 1;
+    int tileSize = settings.tileSize;
+    int bandRows = (min(cl.bandRows, cl.height) + tileSize - 1) / tileSize * tileSize;
+    RenderContext context(settings, cl.width, cl.height, false);
+    Lightmaps lightmaps;
+    Tracer tracer(scene, settings, settings.lightmaps ? &lightmaps : nullptr);
+    ImageFile file;
+    if (!file.open(cl.output, format, cl.width, cl.height))
+        return 1;
+    BandWriter writer(file, cl.width, bandRows, cl.bands);
+    printf("Render: %dx%d, %d-row bands, %d band buffers (%.1f MB), %u threads\n", cl.width, cl.height, bandRows,
+           cl.bands, double(cl.width) * bandRows * 3 * sizeof(float) * cl.bands / (1 << 20), context.pool.size());
+
+    auto begin = chrono::steady_clock::now();
+    if (settings.lightmaps) {
+        BakeLightmaps(lightmaps, tracer, context.pool);
+        const Lightmaps::Stats &bake = lightmaps.getStats();
+        printf("Lightmaps: %zu maps, %.2f M texels (%.1f MB), baked in %.1f ms\n", bake.maps, bake.texels * 1e-6,
+               bake.texels * sizeof(float) / double(1 << 20), bake.bakeMs);
+    }
+    atomic<bool> cancel(false);
+    double traceSeconds = 0;
+    uint64_t allocations = 0, aaSamples = 0;
+    bool ok = true;
+    for (int y0 = 0; y0 < cl.height && ok; y0 += bandRows) {
+        FrameBuffer *band = writer.acquire();
+        if (band == nullptr) {
+            ok = false;
+            break;
+        }
+        int rows = min(bandRows, cl.height - y0);
+        band->setOrigin(0, y0);
+        context.tiles = SplitTile({0, y0, cl.width, y0 + rows}, tileSize);
+        RenderStats stats;
+        RenderFrame(context, tracer, *band, cancel, stats, [](int, int) {});
+        traceSeconds += stats.seconds;
+        allocations += stats.tracingAllocations;
+        aaSamples += stats.aaSamples;
+        writer.submit(band, rows);
+    }
+    ok = writer.finish() && ok;
+    ok = file.close() && ok;
+    if (!ok)
+        return 1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    printf("Done: %.3f s (tracing %.3f s, writing %.3f s in the background), %.2f antialiasing samples per pixel, "
+           "%llu heap allocations while tracing, wrote %s\n", seconds, traceSeconds, writer.getWriteSeconds(),
+           double(aaSamples) / (double(cl.width) * cl.height), (unsigned long long) allocations, cl.output);
+    return 0;
+}
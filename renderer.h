@@ -0,0 +1,278 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_RENDERER_H
+#define TCODE_RENDERER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "my_math.h"
+#include "thread_pool.h"
+
+const int MaxShadowGridSide = 16; // 面光源每个方向上最多的分层数
+
+struct RenderSettings {        // 渲染设置
+    unsigned threads = 0;      // 线程数，0表示使用全部硬件线程
+    int tileSize = 16;         // 块边长（像素）
+    bool packets = true;       // 主光线按8x8光线束求交
+    bool wavefront = true;     // 反射/折射光线按弹射次数成批追踪（波前），否则递归
+    bool adaptiveShadows = true;   // 面光源自适应分层采样，否则用固定的网格
+    int shadowSamples = 100;       // 每个光源最多的阴影光线数（半影中的点）
+    int initialShadowSamples = 16; // 每个光源先发出的阴影光线数，结果不一致时才加到shadowSamples
+    int lightSamples = 4;          // 光源多于此数时每个着色点按估计的贡献抽这么多个光源（光源BVH），0表示总是全部计算
+    int coarseStride = 8;      // 渐进渲染第一遍每隔几个像素算一个，之后每遍减半；1表示一遍画完
+    int aaMaxSamples = 16;     // 抗锯齿：边缘像素最多的采样数（包括像素中心那一个），1表示不做抗锯齿
+    float aaContrast = 0.1f;   // 与相邻像素的颜色差（显示值，0 ~ 1）超过它的像素才加采样，负数表示所有像素
+    float aaError = 0.01f;     // 像素颜色的标准误差低于它时不再加采样，0表示一直加到aaMaxSamples
+    float aaBudget = 2;        // 每块平均每像素最多加几个采样，限制一帧抗锯齿的总开销
+    bool lightmaps = false;    // 预先烘焙平面和球对各光源的可见度（lightmap.h），着色时插值，不发阴影光线
+    float lightmapTexels = 64; // 光照图每单位长度的纹素数
+};
+
+struct Tile {                  // 图像中的一块 [x0, x1) x [y0, y1)
+    int x0, y0, x1, y1;
+};
+
+// 把16位整数的各位隔开一位，用于计算Morton码
+inline uint32_t SpreadBits16(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+inline uint32_t MortonCode2(uint32_t x, uint32_t y) {
+    return SpreadBits16(x) | (SpreadBits16(y) << 1);
+}
+
+// 把图像切成tileSize大小的块，并按Morton(Z字形)顺序排列，相邻的块在空间上也相邻
+inline std::vector<Tile> MakeTiles(int width, int height, int tileSize) {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    std::vector<std::pair<uint32_t, Tile>> keyed;
+    keyed.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile t{tx * tileSize, ty * tileSize,
+                   std::min((tx + 1) * tileSize, width), std::min((ty + 1) * tileSize, height)};
+            keyed.push_back({MortonCode2(tx, ty), t});
+        }
+    }
+    std::sort(keyed.begin(), keyed.end(),
+              [](const std::pair<uint32_t, Tile> &a, const std::pair<uint32_t, Tile> &b) { return a.first < b.first; });
+    std::vector<Tile> tiles;
+    tiles.reserve(keyed.size());
+    for (auto &k: keyed)
+        tiles.push_back(k.second);
+    return tiles;
+}
+
+// 把图像中的一块再切成tileSize大小的小块并按Morton顺序排列，块的左上角是tileSize的整数倍时，
+// 切出的小块与整幅图像MakeTiles切出的块相同
+inline std::vector<Tile> SplitTile(const Tile &tile, int tileSize) {
+    std::vector<Tile> tiles = MakeTiles(tile.x1 - tile.x0, tile.y1 - tile.y0, tileSize);
+    for (Tile &t: tiles)
+        t.x0 += tile.x0, t.x1 += tile.x0, t.y0 += tile.y0, t.y1 += tile.y0;
+    return tiles;
+}
+
+// 渐进渲染的帧缓冲：渲染线程写、显示线程读。每个像素同一时间只有一个工作线程写，颜色用relaxed原子量存取，
+// 不加锁。图像按DirtyBlock x DirtyBlock的方块记录哪里写过，显示线程只上传写过的方块；
+// 每画完一块version加一，显示线程看到version变化再去读。
+// 也可以只存放一幅更大的图像中左上角为(originX, originY)的一部分（分带渲染），坐标仍按整幅图像计
+class FrameBuffer {
+public:
+    static const int DirtyBlock = 16;
+
+    FrameBuffer(int _width, int _height, int _originX = 0, int _originY = 0)
+            : width(_width), height(_height), originX(_originX), originY(_originY),
+              blocksX((_width + DirtyBlock - 1) / DirtyBlock),
+              blocksY((_height + DirtyBlock - 1) / DirtyBlock),
+              pixels(new std::atomic<float>[size_t(_width) * _height * 3]),
+              dirty(new std::atomic<bool>[size_t(blocksX) * blocksY]) {
+        clear();
+    }
+
+    void clear() {
+        for (size_t i = 0; i < size_t(width) * height * 3; i++)
+            pixels[i].store(0, std::memory_order_relaxed);
+        markDirty(originX, originY, originX + width, originY + height);
+        publish();
+    }
+
+    // 改为存放大图像中左上角为(x, y)的部分，原来的内容作废
+    void setOrigin(int x, int y) { originX = x, originY = y; }
+
+    void set(int x, int y, const float *rgb) {
+        std::atomic<float> *p = &pixels[(size_t(y - originY) * width + (x - originX)) * 3];
+        for (int c = 0; c < 3; c++)
+            p[c].store(rgb[c], std::memory_order_relaxed);
+    }
+
+    float get(int x, int y, int c) const {
+        return pixels[(size_t(y - originY) * width + (x - originX)) * 3 + c].load(std::memory_order_relaxed);
+    }
+
+    // 标记[x0, x1) x [y0, y1)已经写完，之前写入的颜色对取走这些标记的线程可见
+    void markDirty(int x0, int y0, int x1, int y1) {
+        x0 -= originX, x1 -= originX, y0 -= originY, y1 -= originY;
+        for (int by = y0 / DirtyBlock; by <= (y1 - 1) / DirtyBlock; by++) {
+            for (int bx = x0 / DirtyBlock; bx <= (x1 - 1) / DirtyBlock; bx++)
+                dirty[size_t(by) * blocksX + bx].store(true, std::memory_order_release);
+        }
+    }
+
+    // 取走方块(bx, by)（相对于originX, originY）的标记，返回它在上次取走之后是否写过
+    bool takeDirty(int bx, int by) {
+        return dirty[size_t(by) * blocksX + bx].exchange(false, std::memory_order_acquire);
+    }
+
+    // 把[x0, x1) x [y0, y1)转换成8位RGBA（颜色截断到[0, 1]），dst指向(x0, y0)，每行相隔stride字节
+    void toRGBA8(int x0, int y0, int x1, int y1, uint8_t *dst, size_t stride) const {
+        for (int y = y0; y < y1; y++, dst += stride) {
+            uint8_t *p = dst;
+            for (int x = x0; x < x1; x++, p += 4) {
+                for (int c = 0; c < 3; c++)
+                    p[c] = uint8_t(std::min(std::max(get(x, y, c), 0.0f), 1.0f) * 255 + 0.5f);
+                p[3] = 255;
+            }
+        }
+    }
+
+    // 把整幅图像写成PPM（P6）文件，第0行在最上面
+    bool writePPM(const char *path) const {
+        FILE *out = fopen(path, "wb");
+        if (out == nullptr) {
+            fprintf(stderr, "%s: unable to write image\n", path);
+            return false;
+        }
+        std::vector<uint8_t> rgba(size_t(width) * 4), rgb(size_t(width) * 3);
+        fprintf(out, "P6\n%d %d\n255\n", width, height);
+        for (int y = 0; y < height; y++) {
+            toRGBA8(originX, originY + y, originX + width, originY + y + 1, rgba.data(), rgba.size());
+            for (int x = 0; x < width; x++)
+                rgb[x * 3] = rgba[x * 4], rgb[x * 3 + 1] = rgba[x * 4 + 1], rgb[x * 3 + 2] = rgba[x * 4 + 2];
+            fwrite(rgb.data(), 1, rgb.size(), out);
+        }
+        bool ok = ferror(out) == 0;
+        ok = fclose(out) == 0 && ok;
+        if (!ok)
+            fprintf(stderr, "%s: unable to write image\n", path);
+        return ok;
+    }
+
+    // 写完一批像素后调用，显示线程据此判断有没有新内容
+    void publish() { published.fetch_add(1, std::memory_order_release); }
+
+    uint64_t version() const { return published.load(std::memory_order_acquire); }
+
+    int getWidth() const { return width; }
+
+    int getHeight() const { return height; }
+
+    int getOriginX() const { return originX; }
+
+    int getOriginY() const { return originY; }
+
+    int getBlocksX() const { return blocksX; }
+
+    int getBlocksY() const { return blocksY; }
+
+private:
+    int width, height;
+    int originX, originY;
+    int blocksX, blocksY;
+    std::unique_ptr<std::atomic<float>[]> pixels;
+    std::unique_ptr<std::atomic<bool>[]> dirty;
+    std::atomic<uint64_t> published{0};
+};
+
+// 渐进渲染的一遍：块内坐标是stride整数倍的像素各算一个采样，并把颜色填满它右下方stride x stride的方块。
+// 前一遍（步长previous）已经算过的像素跳过，所以几遍下来每个像素只算一次，最后一遍（stride为1）后与一次画完相同
+struct Pass {
+    int stride = 1;
+    int previous = 0;      // 前一遍的步长，0表示这是第一遍
+
+    bool samples(int lx, int ly) const {
+        if (lx % stride != 0 || ly % stride != 0)
+            return false;
+        return previous == 0 || lx % previous != 0 || ly % previous != 0;
+    }
+};
+
+// 从coarseStride开始每遍步长减半，直到1
+inline std::vector<Pass> MakePasses(int coarseStride) {
+    std::vector<Pass> passes;
+    int previous = 0;
+    for (int stride = std::max(coarseStride, 1);; stride /= 2) {
+        passes.push_back({stride, previous});
+        previous = stride;
+        if (stride == 1)
+            break;
+    }
+    return passes;
+}
+
+// 抗锯齿时一个要加采样的像素的累计值
+struct AAPixel {
+    int pixel;                 // 块内下标
+    float contrast;
+    int count;                 // 已有的采样数（包括像素中心）
+    bool done;
+    float sum[3], sumSq[3];    // 显示值（截断到[0, 1]）的和与平方和，用来估计误差
+    float weighted[3], weight; // 按1 / (1 + 最大分量)加权的颜色和，很亮的采样不会盖过其他采样
+};
+
+// 每个工作线程私有的状态，先把一块画在这里再整体写回图像，线程之间不共享可写数据
+struct TileContext {
+    std::vector<float> color;  // 块内像素颜色，每像素3个float
+    std::vector<AAPixel> aaPixels;     // 抗锯齿时要加采样的像素
+    std::vector<float> aaColor;        // 一批抗锯齿采样的颜色，每个采样3个float
+    std::vector<int> aaOwner;          // 每个采样属于aaPixels中的哪个像素
+};
+
+// 多线程分块渲染一遍。shadeTile(tile, pass, color, worker)计算块内pass.samples选中的像素的颜色，
+// color按行存放、每像素3个float，必须只读共享数据，worker是执行这一块的线程编号（0 ~ pool.size()-1），可以用来访问线程私有的数据。
+// shadeTile返回false表示渲染已取消，这一块不写回。每画完一块就写进帧缓冲并发布。每个像素的结果只取决于它自己的坐标，因此输出与线程数、调度顺序无关
+// contexts是每个线程的块缓冲（至少pool.size()个），连续渲染多帧时由调用者保留，不用每遍重新分配
+template<class ShadeTileFn>
+void RenderTiles(ThreadPool &pool, const std::vector<Tile> &tiles, const Pass &pass, FrameBuffer &frame,
+                 std::vector<TileContext> &contexts, ShadeTileFn shadeTile) {
+    pool.parallelFor(int(tiles.size()), [&](int index, int worker) {
+        const Tile &tile = tiles[index];
+        TileContext &ctx = contexts[worker];
+        int tileWidth = tile.x1 - tile.x0;
+        ctx.color.resize(size_t(tileWidth) * (tile.y1 - tile.y0) * 3);
+        if (!shadeTile(tile, pass, ctx.color.data(), unsigned(worker)))
+            return;
+        for (int y = tile.y0; y < tile.y1; y += pass.stride) {
+            for (int x = tile.x0; x < tile.x1; x += pass.stride) {
+                if (!pass.samples(x - tile.x0, y - tile.y0))
+                    continue;
+                const float *c = &ctx.color[(size_t(y - tile.y0) * tileWidth + (x - tile.x0)) * 3];
+                for (int fy = y; fy < std::min(y + pass.stride, tile.y1); fy++) {
+                    for (int fx = x; fx < std::min(x + pass.stride, tile.x1); fx++)
+                        frame.set(fx, fy, c);
+                }
+            }
+        }
+        frame.markDirty(tile.x0, tile.y0, tile.x1, tile.y1);
+        frame.publish();
+    });
+}
+
+template<class ShadeTileFn>
+void RenderTiles(ThreadPool &pool, const std::vector<Tile> &tiles, const Pass &pass, FrameBuffer &frame,
+                 ShadeTileFn shadeTile) {
+    std::vector<TileContext> contexts(pool.size());
+    RenderTiles(pool, tiles, pass, frame, contexts, shadeTile);
+}
+
+#endif //TCODE_RENDERER_H
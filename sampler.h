@@ -0,0 +1,59 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_SAMPLER_H
+#define TCODE_SAMPLER_H
+
+#include <cstdint>
+#include <cstring>
+
+// 把32位整数打散（lowbias32），用来生成随机数种子
+inline uint32_t HashUint32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t HashCombine(uint32_t seed, uint32_t v) {
+    return HashUint32(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+inline uint32_t HashFloat(uint32_t seed, float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return HashCombine(seed, bits);
+}
+
+// 很小的伪随机数发生器（PCG32）。种子由着色点等确定的量算出，同一个点每次得到相同的序列，
+// 渲染结果与线程数和像素的计算顺序无关
+class Random {
+public:
+    explicit Random(uint32_t seed) : state(0) {
+        nextUint();
+        state += seed;
+        nextUint();
+    }
+
+    uint32_t nextUint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t shifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (shifted >> rot) | (shifted << ((32 - rot) & 31));
+    }
+
+    // [0, 1)中的均匀随机数
+    float nextFloat() { return float(nextUint() >> 8) * (1.0f / 16777216.0f); }
+
+    // [0, n)中的随机整数
+    int nextInt(int n) { return int((uint64_t(nextUint()) * uint32_t(n)) >> 32); }
+
+private:
+    uint64_t state;
+};
+
+#endif //TCODE_SAMPLER_H
@@ -0,0 +1,212 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_SCENE_H
+#define TCODE_SCENE_H
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include "my_math.h"
+#include "arena.h"
+#include "objects.h"
+#include "lights.h"
+#include "object_store.h"
+#include "bvh.h"
+#include "mapped_file.h"
+
+const float RefitRebuildRatio = 1.5f;   // refit之后BVH的代价超过建树时的这么多倍就重建
+
+struct Scene {            // 场景：相机、光照和物体
+    Arena arena;                       // 材质、光源和其他物体的内存，随场景一起释放
+    Vec3 camera;
+    float cameraYaw = 0, cameraPitch = 0;  // 相机朝向（度），见camera.h
+    Vec3 ambientLight;             // 环境光
+    std::vector<Light *> lights;       // 指向arena中的光源
+    LightBVH lightTree;                // 光源的BVH：求交和按贡献抽样，compile时建
+    ObjectStore objects;               // 场景中的全部物体，按类型分开存放
+    std::vector<ObjectId> unbounded;   // 平面以外的无限大物体，不进BVH，每条光线都要测试
+    MappedFile compiled;               // 从场景缓存文件加载时BVH直接使用其中的数组，比BVH后释放
+    BVH bvh;                           // 有界物体（球、网格）的BVH
+
+    // 在场景的arena中创建对象（材质等），返回的指针在场景销毁前一直有效
+    template<class T, class... Args>
+    T *create(Args &&... args) { return arena.make<T>(std::forward<Args>(args)...); }
+
+    Light *addLight(const Vec3 &lightIntensity, const Vec3 &position, float r) {
+        lights.push_back(create<Light>(lightIntensity, position, r));
+        return lights.back();
+    }
+
+    ObjectId add(const Sphere &sphere) { return objects.add(sphere); }
+
+    ObjectId add(const Plane &plane) { return objects.add(plane); }
+
+    ObjectId add(TriangleMesh &&mesh) { return objects.add(std::move(mesh)); }
+
+    // 其他类型的物体，通过虚函数求交；object由调用者管理，通常用create在arena中创建
+    ObjectId add(MyObject *object) { return objects.add(object); }
+
+    // 编译：检查物体参数、生成平面的求交数组，并建光源的BVH。有不合法的物体时返回false
+    bool compile() {
+        bool ok = objects.compile();
+        lightTree.build(lights);
+        return ok;
+    }
+
+    // 物体或光源增删、移动之后调用：编译，重新划分有界/无界物体并重建BVH。有不合法的物体时返回false
+    bool build() {
+        bool ok = compile();
+        std::vector<ObjectId> bounded;
+        unbounded.clear();
+        for (uint32_t i = 0; i < objects.spheres.size(); i++)
+            bounded.push_back(MakeObjectId(SPHERE, i));
+        for (uint32_t i = 0; i < objects.meshes.size(); i++) {
+            AABB box;
+            if (objects.meshes[i].bounds(box))        // 空网格不会有交点，直接略过
+                bounded.push_back(MakeObjectId(MESH, i));
+        }
+        for (uint32_t i = 0; i < objects.others.size(); i++) {
+            AABB box;
+            if (objects.others[i]->bounds(box))
+                bounded.push_back(MakeObjectId(GENERIC, i));
+            else
+                unbounded.push_back(MakeObjectId(GENERIC, i));
+        }
+        bvh.build(objects, bounded);
+        return ok;
+    }
+
+    // 物体或光源移动之后调用（个数不变）：光源的BVH只refit；物体的BVH只更新包围盒，
+    // 树的SAH代价超过建树时的maxCostRatio倍时才重建，rebuilt不为nullptr时记下是否重建了。
+    // 球或光源移动到了不合法的位置（坐标不是有限数，refit得到的代价是NaN，不会触发重建）或者重建时发现不合法的物体时
+    // 返回false，前一种情况不更新BVH
+    bool update(float maxCostRatio = RefitRebuildRatio, bool *rebuilt = nullptr) {
+        if (rebuilt != nullptr)
+            *rebuilt = false;
+        bool ok = true;
+        for (uint32_t i = 0; i < objects.spheres.size(); i++) {
+            if (!objects.spheres[i].valid()) {
+                fprintf(stderr, "scene: sphere %u has an invalid center or radius\n", i);
+                ok = false;
+            }
+        }
+        for (size_t i = 0; i < lights.size(); i++) {
+            if (!IsFinite(lights[i]->position)) {
+                fprintf(stderr, "scene: light %zu has an invalid position\n", i);
+                ok = false;
+            }
+        }
+        if (!ok)
+            return false;
+        lightTree.refit();
+        bool rebuild = bvh.refit() > maxCostRatio;
+        if (rebuilt != nullptr)
+            *rebuilt = rebuild;
+        return !rebuild || build();
+    }
+
+    // 最近交点查询，nearHit.t需要预先设为搜索上限（通常是INFINITY）
+    bool intersect(const Ray &ray, Hit &nearHit, ObjectId &nearId) const {
+        bool found = intersectUnbounded(ray, nearHit, nearId); // 先测平面，得到较近的上限可以让BVH剪掉更多结点
+        if (bvh.intersect(ray, nearHit, nearId))
+            found = true;
+        return found;
+    }
+
+    // 共起点光线束的最近交点查询：整束光线只遍历一次BVH，每条光线只测试视锥内的叶子；
+    // 视锥覆盖的叶子太多（光线束发散）时退回逐条光线遍历。nearHits[i].t需要预先设好上限
+    void intersectPacket(const Frustum &frustum, const Ray *rays, int count, Hit *nearHits, ObjectId *nearIds) const {
+        int leaves[PacketMaxLeaves];
+        int leafCount;
+        bool coherent = bvh.collectLeaves(frustum, leaves, PacketMaxLeaves, leafCount);
+        for (int i = 0; i < count; i++) {
+            if (!coherent) {
+                intersect(rays[i], nearHits[i], nearIds[i]);
+                continue;
+            }
+            intersectUnbounded(rays[i], nearHits[i], nearIds[i]);
+            bvh.intersectLeaves(rays[i], leaves, leafCount, nearHits[i], nearIds[i]);
+        }
+    }
+
+    // 遮挡查询：(tMin, tMax)内有任何物体就返回true，不计算交点信息。
+    // lastOccluder是调用者保存的上一次遮挡物，先测试它（相邻的阴影光线通常被同一个物体挡住），找到新遮挡物时更新
+    bool occluded(const Ray &ray, float tMin, float tMax, ObjectId &lastOccluder) const {
+        if (lastOccluder != NoObject && objects.occluded(lastOccluder, ray, tMin, tMax))
+            return true;
+        const std::vector<PlaneGeometry> &planes = objects.compiledPlanes;
+        for (uint32_t i = 0; i < planes.size(); i++) {
+            ObjectId id = MakeObjectId(PLANE, i);
+            if (id != lastOccluder && planes[i].occluded(ray, tMin, tMax)) {
+                Count(PlaneTests, i + 1);
+                lastOccluder = id;
+                return true;
+            }
+        }
+        Count(PlaneTests, planes.size());
+        for (ObjectId id: unbounded) {
+            if (id != lastOccluder && objects.occluded(id, ray, tMin, tMax)) {
+                lastOccluder = id;
+                return true;
+            }
+        }
+        return bvh.occluded(ray, tMin, tMax, lastOccluder);
+    }
+
+    // 阴影光线束的遮挡查询，返回没有被挡住的光线数。frustum包住所有光线时整束只遍历一次BVH，
+    // 每个球用SIMD一次测试多条光线；没有视锥或者视锥覆盖的叶子太多时逐条光线查询
+    int occludePacket(ShadowPacket &packet, const Frustum *frustum, ObjectId &lastOccluder) const {
+        int lanes = packet.paddedCount();
+        int leaves[PacketMaxLeaves];
+        int leafCount;
+        if (frustum == nullptr || !bvh.collectLeaves(*frustum, leaves, PacketMaxLeaves, leafCount)) {
+            for (int k = 0; k < packet.count; k++) {
+                if (occluded(packet.ray(k), packet.tMin, packet.tMax[k], lastOccluder))
+                    packet.block(k);
+            }
+            return packet.visibleCount();
+        }
+        for (const PlaneGeometry &plane: objects.compiledPlanes)
+            plane.occludePacket(packet, lanes);
+        Count(PlaneTests, objects.compiledPlanes.size() * lanes);
+        for (ObjectId id: unbounded)
+            objects.occludePacket(id, packet, lanes);
+        bvh.occludePacket(leaves, leafCount, packet, lanes);
+        return packet.visibleCount();
+    }
+
+private:
+    // 平面在编译好的连续数组里只求距离，最后只为最近的平面补全交点信息；其他无界物体按编号分派
+    bool intersectUnbounded(const Ray &ray, Hit &nearHit, ObjectId &nearId) const {
+        bool found = false;
+        const std::vector<PlaneGeometry> &planes = objects.compiledPlanes;
+        Count(PlaneTests, planes.size());
+        float nearT = nearHit.t;
+        int nearPlane = -1;
+        for (uint32_t i = 0; i < planes.size(); i++) {
+            float t;
+            if (planes[i].distance(ray, t) && t > 0 && t < nearT) {
+                nearT = t;
+                nearPlane = int(i);
+            }
+        }
+        if (nearPlane >= 0) {
+            nearHit = objects.planes[nearPlane].hitAt(ray, nearT);
+            nearId = MakeObjectId(PLANE, uint32_t(nearPlane));
+            found = true;
+        }
+        for (ObjectId id: unbounded) {
+            Hit hit = objects.intersect(id, ray);
+            if (hit.t > 0 && hit.t < nearHit.t) {
+                nearHit = hit;
+                nearId = id;
+                found = true;
+            }
+        }
+        return found;
+    }
+};
+
+#endif //TCODE_SCENE_H
@@ -0,0 +1,642 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_SCENE_FILE_H
+#define TCODE_SCENE_FILE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "scene.h"
+#include "mapped_file.h"
+#include "obj.h"
+
+// 文本场景文件，每行一条，#之后是注释：
+//   camera x y z                                   相机位置
+//   ambient r g b                                  环境光
+//   light r g b  x y z  r                          正方形面光源：强度、中心、大小（即Light::r）
+//   material name rough  kd.r kd.g kd.b  ks.r ks.g ks.b  shininess
+//   material name reflective  n.r n.g n.b  kappa.r kappa.g kappa.b
+//   material name refractive  n.r n.g n.b
+//   sphere x y z  radius  material
+//   plane  x y z  nx ny nz  material                面上一点和法线
+//   mesh   file.obj  material  [scale [tx ty tz]]   三角形网格，相对路径从场景文件所在目录算起，先缩放再平移
+// 材质先定义后使用。第一次读文本文件时把解析结果和建好的BVH（包括网格自己的BVH）写成二进制缓存（同名加.bin），
+// 之后文本文件和引用的OBJ文件都没有变化时直接映射缓存文件，不再解析和建树
+
+// 一行中的单词和数字
+class SceneLine {
+public:
+    explicit SceneLine(const char *_p) : p(_p) {}
+
+    bool word(std::string &out) {
+        skipSpace();
+        const char *begin = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#')
+            p++;
+        out.assign(begin, p);
+        return p != begin;
+    }
+
+    bool number(float &out) {
+        skipSpace();
+        char *end;
+        out = strtof(p, &end);
+        if (end == p)
+            return false;
+        p = end;
+        return true;
+    }
+
+    bool vec(Vec3 &out) {
+        float x, y, z;
+        if (!number(x) || !number(y) || !number(z))
+            return false;
+        out = Vec3(x, y, z);
+        return true;
+    }
+
+    // 后面只剩空白或注释
+    bool end() {
+        skipSpace();
+        return *p == '\0' || *p == '\r' || *p == '#';
+    }
+
+private:
+    const char *p;
+
+    void skipSpace() {
+        while (*p == ' ' || *p == '\t')
+            p++;
+    }
+};
+
+inline bool ReadWholeFile(const char *path, std::string &out) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size > 0 ? size_t(size) : 0);
+    bool ok = size >= 0 && fread(&out[0], 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+// 场景文件中引用的其他文件：绝对路径原样返回，相对路径接在场景文件所在的目录后面
+inline std::string ResolveScenePath(const char *scenePath, const std::string &file) {
+    if (file.empty() || file[0] == '/' || file[0] == '\\' || (file.size() > 1 && file[1] == ':'))
+        return file;
+    std::string dir(scenePath);
+    size_t slash = dir.find_last_of("/\\");
+    if (slash == std::string::npos)
+        return file;
+    return dir.substr(0, slash + 1) + file;
+}
+
+// 解析文本场景文件，把其中的内容加进scene（网格建好自己的BVH，场景的BVH不建）。出错时输出文件名和行号，返回false。
+// meshPaths不为空时依次记下每个网格的OBJ文件路径
+inline bool LoadSceneText(const char *path, Scene &scene, std::vector<std::string> *meshPaths = nullptr) {
+    std::string text;
+    if (!ReadWholeFile(path, text)) {
+        fprintf(stderr, "%s: unable to read scene file\n", path);
+        return false;
+    }
+    std::unordered_map<std::string, Material *> materials;
+    std::string keyword, name, type;
+    int lineNumber = 0;
+    text.push_back('\n');
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = text.find('\n', begin);
+        text[end] = '\0';      // 逐行就地解析
+        SceneLine line(&text[begin]);
+        begin = end + 1;
+        lineNumber++;
+        if (!line.word(keyword))
+            continue;
+        bool ok = true;
+        Vec3 a, b;
+        float f = 0;
+        if (keyword == "camera") {
+            ok = line.vec(scene.camera);
+        } else if (keyword == "ambient") {
+            ok = line.vec(scene.ambientLight);
+        } else if (keyword == "light") {
+            ok = line.vec(a) && line.vec(b) && line.number(f);
+            if (ok)
+                scene.addLight(a, b, f);
+        } else if (keyword == "material") {
+            ok = line.word(name) && line.word(type);
+            Material *material = nullptr;
+            if (ok && type == "rough") {
+                ok = line.vec(a) && line.vec(b) && line.number(f);
+                if (ok)
+                    material = scene.create<RoughMaterial>(a, b, f);
+            } else if (ok && type == "reflective") {
+                ok = line.vec(a) && line.vec(b);
+                if (ok)
+                    material = scene.create<ReflectiveMaterial>(a, b);
+            } else if (ok && type == "refractive") {
+                ok = line.vec(a);
+                if (ok)
+                    material = scene.create<RefractiveMaterial>(a);
+            } else if (ok) {
+                fprintf(stderr, "%s:%d: unknown material type `%s`\n", path, lineNumber, type.c_str());
+                return false;
+            }
+            if (ok)
+                materials[name] = material;
+        } else if (keyword == "sphere" || keyword == "plane") {
+            bool sphere = keyword == "sphere";
+            ok = line.vec(a) && (sphere ? line.number(f) : line.vec(b)) && line.word(name);
+            if (ok) {
+                auto it = materials.find(name);
+                if (it == materials.end()) {
+                    fprintf(stderr, "%s:%d: undefined material `%s`\n", path, lineNumber, name.c_str());
+                    return false;
+                }
+                if (sphere) {
+                    Sphere object(a, f, it->second);
+                    if (!object.valid()) {
+                        fprintf(stderr, "%s:%d: sphere radius must be positive and finite\n", path, lineNumber);
+                        return false;
+                    }
+                    scene.add(object);
+                } else {
+                    Plane object(a, b, it->second);
+                    if (!object.valid()) {
+                        fprintf(stderr, "%s:%d: plane normal must be non-zero and finite\n", path, lineNumber);
+                        return false;
+                    }
+                    scene.add(object);
+                }
+            }
+        } else if (keyword == "mesh") {
+            float scale = 1;
+            Vec3 offset(0, 0, 0);
+            ok = line.word(type) && line.word(name);
+            if (ok && !line.end())
+                ok = line.number(scale) && (line.end() || line.vec(offset));
+            if (ok) {
+                auto it = materials.find(name);
+                if (it == materials.end()) {
+                    fprintf(stderr, "%s:%d: undefined material `%s`\n", path, lineNumber, name.c_str());
+                    return false;
+                }
+                std::string objPath = ResolveScenePath(path, type);
+                TriangleMesh mesh(it->second);
+                if (!LoadOBJ(objPath.c_str(), mesh)) {
+                    fprintf(stderr, "%s:%d: unable to load mesh `%s`\n", path, lineNumber, objPath.c_str());
+                    return false;
+                }
+                mesh.transform(scale, offset);
+                mesh.build();
+                scene.add(std::move(mesh));
+                if (meshPaths != nullptr)
+                    meshPaths->push_back(objPath);
+            }
+        } else {
+            fprintf(stderr, "%s:%d: unknown keyword `%s`\n", path, lineNumber, keyword.c_str());
+            return false;
+        }
+        if (!ok || !line.end()) {
+            fprintf(stderr, "%s:%d: malformed `%s` line\n", path, lineNumber, keyword.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// 二进制场景缓存。各数组按64字节对齐存放，映射进内存后BVH的结点、物体编号和球SoA直接使用，
+// 球、平面、材质和光源按记录重新创建（只是逐个复制，不需要解析）。网格的顶点、下标、边和BVH也直接使用映射的内存
+const uint32_t SceneCacheVersion = 2;
+
+struct SceneCacheHeader {
+    char magic[8];              // "TCSCENE"
+    uint32_t version;
+    uint32_t nodeSize;          // sizeof(BVH::Node)，结构体布局不同的程序生成的缓存不能用
+    uint64_t sourceSize;        // 生成缓存时文本场景文件的大小和修改时间
+    int64_t sourceTime;
+    float camera[3], ambient[3];
+    uint32_t lightCount, materialCount, sphereCount, planeCount;
+    uint32_t nodeCount, primCount, leafCount, depth;
+    uint32_t meshCount, pathBytes;
+    uint64_t lightOffset, materialOffset, sphereOffset, planeOffset, nodeOffset, primOffset, sphereDataOffset;
+    uint64_t meshOffset, pathOffset;
+};
+
+struct LightRecord {
+    float intensity[3], position[3], r;
+};
+
+struct MaterialRecord {
+    uint32_t type;
+    float ka[3], kd[3], ks[3], shininess, F0[3], ior;
+};
+
+struct SphereRecord {
+    float center[3], radius;
+    uint32_t material;
+};
+
+struct PlaneRecord {
+    float point[3], normal[3];
+    uint32_t material;
+};
+
+struct MeshRecord {
+    uint64_t vertexOffset, indexOffset, edgeOffset, nodeOffset;
+    uint64_t sourceSize;        // OBJ文件的大小和修改时间
+    int64_t sourceTime;
+    uint32_t pathStart, pathLength;        // OBJ文件路径在路径表中的位置
+    uint32_t material, vertexCount, triangleCount, nodeCount, leafCount, depth;
+};
+
+inline void StoreVec3(float out[3], const Vec3 &v) {
+    out[0] = v[0], out[1] = v[1], out[2] = v[2];
+}
+
+inline Vec3 LoadVec3(const float in[3]) { return Vec3(in[0], in[1], in[2]); }
+
+// 文本场景文件的大小和修改时间，用来判断缓存是否过期
+inline bool SceneSourceStamp(const char *path, uint64_t &size, int64_t &time) {
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+    size = uint64_t(st.st_size);
+    time = int64_t(st.st_mtime);
+    return true;
+}
+
+// 顺序写文件，每段数据从64字节对齐的位置开始
+class CacheWriter {
+public:
+    explicit CacheWriter(FILE *_f) : f(_f) {}
+
+    uint64_t append(const void *data, size_t bytes) {
+        static const char zeros[64] = {0};
+        size_t pad = size_t((64 - offset % 64) % 64);
+        if (pad > 0)
+            write(zeros, pad);
+        uint64_t at = offset;
+        write(data, bytes);
+        return at;
+    }
+
+    void write(const void *data, size_t bytes) {
+        if (bytes > 0 && fwrite(data, 1, bytes, f) != bytes)
+            ok = false;
+        offset += bytes;
+    }
+
+    bool good() const { return ok; }
+
+private:
+    FILE *f;
+    uint64_t offset = 0;
+    bool ok = true;
+};
+
+// 把建好BVH的场景写成缓存文件。只支持球、平面和网格，场景里有其他物体时返回false。
+// meshPaths是各网格的OBJ文件路径（与scene.objects.meshes同序），用来判断缓存是否过期
+inline bool SaveSceneCache(const char *path, const Scene &scene, uint64_t sourceSize, int64_t sourceTime,
+                           const std::vector<std::string> &meshPaths) {
+    if (!scene.objects.others.empty() || meshPaths.size() != scene.objects.meshes.size())
+        return false;
+    SceneCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "TCSCENE", 8);
+    header.version = SceneCacheVersion;
+    header.nodeSize = sizeof(BVH::Node);
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    StoreVec3(header.camera, scene.camera);
+    StoreVec3(header.ambient, scene.ambientLight);
+
+    std::vector<LightRecord> lights;
+    for (const Light *light: scene.lights) {
+        LightRecord r;
+        StoreVec3(r.intensity, light->lightIntensity);
+        StoreVec3(r.position, light->position);
+        r.r = light->r;
+        lights.push_back(r);
+    }
+    std::unordered_map<const Material *, uint32_t> materialIndex;
+    std::vector<MaterialRecord> materials;
+    auto indexOf = [&](const Material *m) {
+        auto it = materialIndex.find(m);
+        if (it != materialIndex.end())
+            return it->second;
+        MaterialRecord r;
+        r.type = uint32_t(m->type);
+        StoreVec3(r.ka, m->ka);
+        StoreVec3(r.kd, m->kd);
+        StoreVec3(r.ks, m->ks);
+        r.shininess = m->shininess;
+        StoreVec3(r.F0, m->F0);
+        r.ior = m->ior;
+        materials.push_back(r);
+        return materialIndex[m] = uint32_t(materials.size() - 1);
+    };
+    std::vector<SphereRecord> spheres;
+    for (const Sphere &s: scene.objects.spheres) {
+        SphereRecord r;
+        StoreVec3(r.center, s.getCenter());
+        r.radius = s.getRadius();
+        r.material = indexOf(s.getMaterial());
+        spheres.push_back(r);
+    }
+    std::vector<PlaneRecord> planes;
+    for (const Plane &p: scene.objects.planes) {
+        PlaneRecord r;
+        StoreVec3(r.point, p.getPoint());
+        StoreVec3(r.normal, p.getNormal());
+        r.material = indexOf(p.getMaterial());
+        planes.push_back(r);
+    }
+    std::vector<MeshRecord> meshes;
+    std::string pathTable;
+    for (size_t i = 0; i < meshPaths.size(); i++) {
+        const TriangleMesh &mesh = scene.objects.meshes[i];
+        MeshRecord r;
+        memset(&r, 0, sizeof(r));
+        if (!SceneSourceStamp(meshPaths[i].c_str(), r.sourceSize, r.sourceTime))
+            return false;
+        r.pathStart = uint32_t(pathTable.size());
+        r.pathLength = uint32_t(meshPaths[i].size());
+        pathTable += meshPaths[i];
+        r.material = indexOf(mesh.getMaterial());
+        r.vertexCount = uint32_t(mesh.vertexCount());
+        r.triangleCount = uint32_t(mesh.triangleCount());
+        r.nodeCount = uint32_t(mesh.getNodes().size());
+        r.leafCount = uint32_t(mesh.getStats().leafCount);
+        r.depth = uint32_t(mesh.getStats().depth);
+        meshes.push_back(r);
+    }
+    ArrayView<BVH::Node> nodes = scene.bvh.getNodes();
+    ArrayView<ObjectId> prims = scene.bvh.getPrims();
+    const SphereSoA &soa = scene.bvh.getSpheres();
+    size_t stride = SphereSoA::stride(int(prims.size()));
+    std::vector<float> sphereData(stride * 4);
+    const AlignedFloats *arrays[4] = {&soa.cx, &soa.cy, &soa.cz, &soa.r2};
+    for (int k = 0; k < 4; k++) {
+        for (size_t i = 0; i < stride; i++) {
+            bool inside = i < prims.size() + SphereSoA::Padding;
+            sphereData[k * stride + i] = inside ? arrays[k]->data()[i] : (k == 3 ? -INFINITY : 0.0f);
+        }
+    }
+    header.lightCount = uint32_t(lights.size());
+    header.materialCount = uint32_t(materials.size());
+    header.sphereCount = uint32_t(spheres.size());
+    header.planeCount = uint32_t(planes.size());
+    header.nodeCount = uint32_t(nodes.size());
+    header.primCount = uint32_t(prims.size());
+    header.leafCount = uint32_t(scene.bvh.getStats().leafCount);
+    header.depth = uint32_t(scene.bvh.getStats().depth);
+    header.meshCount = uint32_t(meshes.size());
+    header.pathBytes = uint32_t(pathTable.size());
+
+    // 先写到临时文件，写完再改名，中途失败不会留下不完整的缓存
+    std::string temp = std::string(path) + ".tmp";
+    FILE *f = fopen(temp.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    CacheWriter writer(f);
+    writer.write(&header, sizeof(header));
+    header.lightOffset = writer.append(lights.data(), lights.size() * sizeof(LightRecord));
+    header.materialOffset = writer.append(materials.data(), materials.size() * sizeof(MaterialRecord));
+    header.sphereOffset = writer.append(spheres.data(), spheres.size() * sizeof(SphereRecord));
+    header.planeOffset = writer.append(planes.data(), planes.size() * sizeof(PlaneRecord));
+    header.nodeOffset = writer.append(nodes.data(), nodes.size() * sizeof(BVH::Node));
+    header.primOffset = writer.append(prims.data(), prims.size() * sizeof(ObjectId));
+    header.sphereDataOffset = writer.append(sphereData.data(), sphereData.size() * sizeof(float));
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const TriangleMesh &mesh = scene.objects.meshes[i];
+        meshes[i].vertexOffset = writer.append(mesh.getVertices().data(), mesh.getVertices().size() * sizeof(float));
+        meshes[i].indexOffset = writer.append(mesh.getIndices().data(), mesh.getIndices().size() * sizeof(uint32_t));
+        meshes[i].edgeOffset = writer.append(mesh.getEdges().data(), mesh.getEdges().size() * sizeof(MeshEdges));
+        meshes[i].nodeOffset = writer.append(mesh.getNodes().data(), mesh.getNodes().size() * sizeof(BVHNode));
+    }
+    header.meshOffset = writer.append(meshes.data(), meshes.size() * sizeof(MeshRecord));
+    header.pathOffset = writer.append(pathTable.data(), pathTable.size());
+    bool ok = writer.good() && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        remove(path);
+        ok = rename(temp.c_str(), path) == 0;
+    }
+    if (!ok)
+        remove(temp.c_str());
+    return ok;
+}
+
+// 检查缓存里的BVH结点：内部结点的两个孩子下标都比自己大且不越界，叶子的范围落在[0, itemCount)内，
+// 深度不超过遍历栈能容纳的BVHMaxDepth。孩子下标总比父结点大，顺着扫一遍就能算出每个结点的深度
+inline bool ValidCacheNodes(const BVHNode *nodes, uint32_t nodeCount, uint32_t itemCount) {
+    std::vector<uint8_t> depth(nodeCount, 0);
+    for (uint32_t i = 0; i < nodeCount; i++) {
+        const BVHNode &node = nodes[i];
+        if (node.count > 0) {
+            if (node.offset < 0 || int64_t(node.offset) + node.count > int64_t(itemCount))
+                return false;
+            continue;
+        }
+        if (node.count < 0 || i + 1 >= nodeCount || node.offset <= int64_t(i) + 1 ||
+            uint32_t(node.offset) >= nodeCount || depth[i] >= BVHMaxDepth)
+            return false;
+        uint8_t d = uint8_t(depth[i] + 1);
+        depth[i + 1] = std::max(depth[i + 1], d);
+        depth[node.offset] = std::max(depth[node.offset], d);
+    }
+    return true;
+}
+
+// 映射缓存文件并用它填充空的scene，BVH直接使用映射的内存（映射由scene.compiled持有）。
+// 文件不存在、格式不对或者与文本文件、OBJ文件的大小、修改时间不一致时返回false，scene保持不变。
+// checkSources为false时不检查源文件（分布式渲染的worker收到的场景，本机没有文本文件和OBJ文件）
+inline bool LoadSceneCache(const char *path, Scene &scene, uint64_t sourceSize, int64_t sourceTime,
+                           bool checkSources = true) {
+    MappedFile &file = scene.compiled;
+    if (!file.open(path))
+        return false;
+    const char *base = file.data();
+    SceneCacheHeader header;
+    bool ok = file.size() >= sizeof(header);
+    if (ok) {
+        memcpy(&header, base, sizeof(header));
+        ok = memcmp(header.magic, "TCSCENE", 8) == 0 && header.version == SceneCacheVersion &&
+             header.nodeSize == sizeof(BVH::Node) &&
+             (!checkSources || (header.sourceSize == sourceSize && header.sourceTime == sourceTime));
+    }
+    // 每段数据都必须完整地落在文件里
+    auto inside = [&](uint64_t offset, uint64_t count, size_t size) {
+        return offset % 64 == 0 && offset <= file.size() && count * size <= file.size() - offset;
+    };
+    size_t stride = SphereSoA::stride(int(header.primCount));
+    ok = ok && inside(header.lightOffset, header.lightCount, sizeof(LightRecord)) &&
+         inside(header.materialOffset, header.materialCount, sizeof(MaterialRecord)) &&
+         inside(header.sphereOffset, header.sphereCount, sizeof(SphereRecord)) &&
+         inside(header.planeOffset, header.planeCount, sizeof(PlaneRecord)) &&
+         inside(header.nodeOffset, header.nodeCount, sizeof(BVH::Node)) &&
+         inside(header.primOffset, header.primCount, sizeof(ObjectId)) &&
+         inside(header.sphereDataOffset, stride * 4, sizeof(float)) &&
+         inside(header.meshOffset, header.meshCount, sizeof(MeshRecord)) &&
+         inside(header.pathOffset, header.pathBytes, 1);
+    auto *meshRecords = reinterpret_cast<const MeshRecord *>(base + header.meshOffset);
+    for (uint32_t i = 0; ok && i < header.meshCount; i++) {
+        const MeshRecord &r = meshRecords[i];
+        uint64_t size;
+        int64_t time;
+        std::string objPath(base + header.pathOffset + std::min(r.pathStart, header.pathBytes),
+                            std::min(r.pathLength, header.pathBytes - std::min(r.pathStart, header.pathBytes)));
+        ok = r.material < header.materialCount && inside(r.vertexOffset, uint64_t(r.vertexCount) * 3, sizeof(float)) &&
+             inside(r.indexOffset, uint64_t(r.triangleCount) * 3, sizeof(uint32_t)) &&
+             inside(r.edgeOffset, r.triangleCount, sizeof(MeshEdges)) &&
+             inside(r.nodeOffset, r.nodeCount, sizeof(BVHNode)) &&
+             (!checkSources ||
+              (SceneSourceStamp(objPath.c_str(), size, time) && size == r.sourceSize && time == r.sourceTime));
+        // 顶点下标和网格BVH的下标也要检查，worker不检查源文件，损坏的缓存不能让求交越界
+        auto *indices = reinterpret_cast<const uint32_t *>(base + r.indexOffset);
+        for (uint64_t j = 0; ok && j < uint64_t(r.triangleCount) * 3; j++)
+            ok = indices[j] < r.vertexCount;
+        ok = ok && ValidCacheNodes(reinterpret_cast<const BVHNode *>(base + r.nodeOffset), r.nodeCount,
+                                   r.triangleCount);
+    }
+    ok = ok && ValidCacheNodes(reinterpret_cast<const BVHNode *>(base + header.nodeOffset), header.nodeCount,
+                               header.primCount);
+    auto *primRecords = reinterpret_cast<const ObjectId *>(base + header.primOffset);
+    for (uint32_t i = 0; ok && i < header.primCount; i++) {        // 缓存里只有球、平面和网格
+        uint32_t index = GetObjectIndex(primRecords[i]);
+        switch (GetObjectType(primRecords[i])) {
+            case SPHERE:
+                ok = index < header.sphereCount;
+                break;
+            case PLANE:
+                ok = index < header.planeCount;
+                break;
+            case MESH:
+                ok = index < header.meshCount;
+                break;
+            default:
+                ok = false;
+        }
+    }
+    auto *materialRecords = reinterpret_cast<const MaterialRecord *>(base + header.materialOffset);
+    auto *sphereRecords = reinterpret_cast<const SphereRecord *>(base + header.sphereOffset);
+    auto *planeRecords = reinterpret_cast<const PlaneRecord *>(base + header.planeOffset);
+    // 不合法的球和平面（缓存损坏）当作缓存无效，回到文本解析，由解析器报出是哪一行
+    for (uint32_t i = 0; ok && i < header.sphereCount; i++) {
+        const SphereRecord &r = sphereRecords[i];
+        ok = r.material < header.materialCount && Sphere(LoadVec3(r.center), r.radius, nullptr).valid();
+    }
+    for (uint32_t i = 0; ok && i < header.planeCount; i++) {
+        const PlaneRecord &r = planeRecords[i];
+        ok = r.material < header.materialCount && Plane(LoadVec3(r.point), LoadVec3(r.normal), nullptr).valid();
+    }
+    if (!ok) {
+        file.close();
+        return false;
+    }
+
+    scene.camera = LoadVec3(header.camera);
+    scene.ambientLight = LoadVec3(header.ambient);
+    auto *lightRecords = reinterpret_cast<const LightRecord *>(base + header.lightOffset);
+    for (uint32_t i = 0; i < header.lightCount; i++) {
+        const LightRecord &r = lightRecords[i];
+        scene.addLight(LoadVec3(r.intensity), LoadVec3(r.position), r.r);
+    }
+    std::vector<Material *> materials(header.materialCount);
+    for (uint32_t i = 0; i < header.materialCount; i++) {
+        const MaterialRecord &r = materialRecords[i];
+        Material m{MaterialType(r.type)};
+        m.ka = LoadVec3(r.ka);
+        m.kd = LoadVec3(r.kd);
+        m.ks = LoadVec3(r.ks);
+        m.shininess = r.shininess;
+        m.F0 = LoadVec3(r.F0);
+        m.ior = r.ior;
+        materials[i] = scene.create<Material>(m);
+    }
+    scene.objects.spheres.reserve(header.sphereCount);
+    for (uint32_t i = 0; i < header.sphereCount; i++) {
+        const SphereRecord &r = sphereRecords[i];
+        scene.add(Sphere(LoadVec3(r.center), r.radius, materials[r.material]));
+    }
+    scene.objects.planes.reserve(header.planeCount);
+    for (uint32_t i = 0; i < header.planeCount; i++) {
+        const PlaneRecord &r = planeRecords[i];
+        scene.add(Plane(LoadVec3(r.point), LoadVec3(r.normal), materials[r.material]));
+    }
+    scene.objects.meshes.reserve(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        const MeshRecord &r = meshRecords[i];
+        BVHStats meshStats;
+        meshStats.nodeCount = int(r.nodeCount);
+        meshStats.leafCount = int(r.leafCount);
+        meshStats.depth = int(r.depth);
+        TriangleMesh mesh(materials[r.material]);
+        mesh.adopt(ArrayView<float>(reinterpret_cast<const float *>(base + r.vertexOffset), size_t(r.vertexCount) * 3),
+                   ArrayView<uint32_t>(reinterpret_cast<const uint32_t *>(base + r.indexOffset),
+                                       size_t(r.triangleCount) * 3),
+                   ArrayView<MeshEdges>(reinterpret_cast<const MeshEdges *>(base + r.edgeOffset), r.triangleCount),
+                   ArrayView<BVHNode>(reinterpret_cast<const BVHNode *>(base + r.nodeOffset), r.nodeCount), meshStats);
+        scene.add(std::move(mesh));
+    }
+    scene.compile();        // 记录在上面检查过，不会失败
+    scene.unbounded.clear();
+    BVH::Stats stats;
+    stats.nodeCount = int(header.nodeCount);
+    stats.leafCount = int(header.leafCount);
+    stats.depth = int(header.depth);
+    scene.bvh.adopt(scene.objects,
+                    ArrayView<BVH::Node>(reinterpret_cast<const BVH::Node *>(base + header.nodeOffset), header.nodeCount),
+                    ArrayView<ObjectId>(reinterpret_cast<const ObjectId *>(base + header.primOffset), header.primCount),
+                    reinterpret_cast<const float *>(base + header.sphereDataOffset), stats);
+    return true;
+}
+
+// 加载场景文件并建好BVH：缓存（path.bin）有效时直接映射，否则解析文本、建树并重新写缓存。
+// cacheCurrent不为nullptr时记下path.bin是否与场景文件一致（映射了有效的缓存或者重新写成功了）
+inline bool LoadScene(const char *path, Scene &scene, bool *cacheCurrent = nullptr) {
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t size;
+    int64_t time;
+    if (!SceneSourceStamp(path, size, time)) {
+        fprintf(stderr, "%s: unable to open scene file\n", path);
+        return false;
+    }
+    std::string cachePath = std::string(path) + ".bin";
+    bool cached = LoadSceneCache(cachePath.c_str(), scene, size, time);
+    if (cacheCurrent != nullptr)
+        *cacheCurrent = cached;
+    if (!cached) {
+        std::vector<std::string> meshPaths;
+        if (!LoadSceneText(path, scene, &meshPaths) || !scene.build())
+            return false;
+        if (!SaveSceneCache(cachePath.c_str(), scene, size, time, meshPaths))
+            fprintf(stderr, "%s: unable to write scene cache\n", cachePath.c_str());
+        else if (cacheCurrent != nullptr)
+            *cacheCurrent = true;
+    }
+    printf("Scene: %s, %zu objects, %s in %.1f ms\n", path, scene.objects.size(),
+           cached ? "mapped compiled cache" : "parsed text and built BVH",
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+    for (const TriangleMesh &mesh: scene.objects.meshes) {
+        printf("Mesh: %zu triangles, %zu vertices, %.1f bytes/triangle, BVH %d nodes, depth %d\n",
+               mesh.triangleCount(), mesh.vertexCount(), double(mesh.memoryBytes()) / double(mesh.triangleCount()),
+               mesh.getStats().nodeCount, mesh.getStats().depth);
+    }
+    return true;
+}
+
+#endif //TCODE_SCENE_FILE_H
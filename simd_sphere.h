@@ -0,0 +1,462 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_SIMD_SPHERE_H
+#define TCODE_SIMD_SPHERE_H
+
+#include <cmath>
+#include <cstddef>
+#include <new>
+#include "objects.h"
+#include "packet.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TCODE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// 64字节对齐的float数组，尾部多留一些空间，向量化读取时不会越界。也可以借用外部的只读内存
+class AlignedFloats {
+    float *buffer = nullptr;
+    size_t count = 0;
+    bool owned = true;
+
+    void release() {
+        if (buffer != nullptr && owned)
+            ::operator delete[](buffer, std::align_val_t(64));
+        buffer = nullptr;
+        count = 0;
+        owned = true;
+    }
+
+public:
+    AlignedFloats() = default;
+
+    AlignedFloats(const AlignedFloats &) = delete;
+    AlignedFloats &operator=(const AlignedFloats &) = delete;
+
+    ~AlignedFloats() { release(); }
+
+    void assign(size_t n, float value) {
+        if (n != count || !owned) {
+            release();
+            buffer = static_cast<float *>(::operator new[](n * sizeof(float), std::align_val_t(64)));
+            count = n;
+        }
+        for (size_t i = 0; i < n; i++)
+            buffer[i] = value;
+    }
+
+    // 使用外部的n个float，不复制，也不负责释放；借用期间不能写入
+    void borrow(const float *external, size_t n) {
+        release();
+        buffer = const_cast<float *>(external);
+        count = n;
+        owned = false;
+    }
+
+    float &operator[](size_t i) { return buffer[i]; }
+
+    const float *data() const { return buffer; }
+};
+
+// 结构体数组(SoA)形式的球：球心x/y/z和半径平方分别连续存放，供向量化求交使用
+struct SphereSoA {
+    static const int Padding = 16;        // 尾部填充，最宽的核一次读16个
+    AlignedFloats cx, cy, cz, r2;
+    int size = 0;
+
+    // 所有位置先填成不会相交的占位（半径平方为负无穷）
+    void resize(int n) {
+        size = n;
+        cx.assign(n + Padding, 0);
+        cy.assign(n + Padding, 0);
+        cz.assign(n + Padding, 0);
+        r2.assign(n + Padding, -INFINITY);
+    }
+
+    // 每个数组占的float数（含填充），取16的倍数，几个数组连续存放时都保持64字节对齐
+    static size_t stride(int n) { return (size_t(n) + Padding + 15) & ~size_t(15); }
+
+    // 使用外部连续存放的cx、cy、cz、r2四个数组，每个stride(n)个float
+    void borrow(int n, const float *data) {
+        size = n;
+        cx.borrow(data, stride(n));
+        cy.borrow(data + stride(n), stride(n));
+        cz.borrow(data + 2 * stride(n), stride(n));
+        r2.borrow(data + 3 * stride(n), stride(n));
+    }
+
+    void set(int i, const Vec3 &center, float radius) {
+        cx[i] = center[0];
+        cy[i] = center[1];
+        cz[i] = center[2];
+        r2[i] = radius * radius;
+    }
+
+    void set(int i, const Sphere &sphere) {        // 直接用球构造时算好的r^2
+        cx[i] = sphere.getCenter()[0];
+        cy[i] = sphere.getCenter()[1];
+        cz[i] = sphere.getCenter()[2];
+        r2[i] = sphere.getRadius2();
+    }
+};
+
+// 在[begin, end)的球中找t在(tMin, tBest)内的最近交点，找到时更新tBest并返回下标，否则返回-1。要求光线方向已归一化
+typedef int (*SphereNearestFn)(const SphereSoA &, const Ray &, int begin, int end, float tMin, float &tBest);
+// 在[begin, end)的球中找任意一个t在(tMin, tMax)内的交点，返回其下标，没有返回-1
+typedef int (*SphereAnyFn)(const SphereSoA &, const Ray &, int begin, int end, float tMin, float tMax);
+
+// 用第i个球遮挡阴影光线束中的光线：前lanes条光线中t在(tMin, tMax)内与球相交的标记为被挡住。
+// 光线共起点，o = origin - c和c = o·o - r²对所有通道相同，SIMD通道对应不同的光线
+typedef void (*SphereShadowFn)(const SphereSoA &, int i, ShadowPacket &, int lanes);
+
+struct SphereKernel {
+    int width;                // 一次测试的球数/光线数
+    const char *name;
+    SphereNearestFn nearest;
+    SphereAnyFn any;
+    SphereShadowFn shadow;
+};
+
+// 单个球求交，返回(tMin, tMax)内较近的根，没有返回INFINITY
+inline float SphereRoot(const SphereSoA &s, const Ray &ray, int i, float tMin, float tMax) {
+    float ox = ray.start[0] - s.cx.data()[i];
+    float oy = ray.start[1] - s.cy.data()[i];
+    float oz = ray.start[2] - s.cz.data()[i];
+    float b = ox * ray.dir[0] + oy * ray.dir[1] + oz * ray.dir[2];
+    float c = ox * ox + oy * oy + oz * oz - s.r2.data()[i];
+    float delta = b * b - c;
+    if (delta < 0)
+        return INFINITY;
+    float sqrt_delta = sqrtf(delta);
+    float t = -b - sqrt_delta;
+    if (!(t > tMin))
+        t = -b + sqrt_delta;
+    return (t > tMin && t < tMax) ? t : INFINITY;
+}
+
+inline int SphereNearestScalar(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float &tBest) {
+    int best = -1;
+    for (int i = begin; i < end; i++) {
+        float t = SphereRoot(s, ray, i, tMin, tBest);
+        if (t < tBest) {
+            tBest = t;
+            best = i;
+        }
+    }
+    return best;
+}
+
+inline int SphereAnyScalar(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float tMax) {
+    for (int i = begin; i < end; i++) {
+        if (SphereRoot(s, ray, i, tMin, tMax) < tMax)
+            return i;
+    }
+    return -1;
+}
+
+inline void SphereShadowScalar(const SphereSoA &s, int i, ShadowPacket &p, int lanes) {
+    float ox = p.origin[0] - s.cx.data()[i];
+    float oy = p.origin[1] - s.cy.data()[i];
+    float oz = p.origin[2] - s.cz.data()[i];
+    float c = ox * ox + oy * oy + oz * oz - s.r2.data()[i];
+    for (int k = 0; k < lanes; k++) {
+        float b = ox * p.dx[k] + oy * p.dy[k] + oz * p.dz[k];
+        float delta = b * b - c;
+        if (delta < 0)
+            continue;
+        float sqrt_delta = sqrtf(delta);
+        float t = -b - sqrt_delta;
+        if (!(t > p.tMin))
+            t = -b + sqrt_delta;
+        if (t > p.tMin && t < p.tMax[k])
+            p.block(k);
+    }
+}
+
+// 从一组候选的t中挑出最小的，bits为有效通道
+inline int PickNearestLane(const float *t, unsigned bits, float &tBest) {
+    int best = -1;
+    for (int lane = 0; bits != 0; lane++, bits >>= 1) {
+        if ((bits & 1) && t[lane] < tBest) {
+            tBest = t[lane];
+            best = lane;
+        }
+    }
+    return best;
+}
+
+inline unsigned LaneBits(int n, int width) {        // 剩余n个球时的有效通道
+    return n >= width ? (1u << width) - 1 : (1u << n) - 1;
+}
+
+#ifdef TCODE_X86_SIMD
+
+// 以下三组核的计算步骤完全相同，只是宽度不同：
+// o = start - c, b = o·d, c = o·o - r², delta = b² - c, t = -b ∓ sqrt(delta)。
+// GCC把这些内建函数展开成普通的向量运算，avx512f目标自带FMA时会把乘加合并，舍入与其他宽度不同，
+// 图像就会随CPU（运行时选的核、分布式渲染的各台机器）变化。这里禁止合并，各宽度的结果逐位相同
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+__attribute__((target("sse2")))
+inline __m128 SphereRoots4(const SphereSoA &s, const Ray &ray, int i, float tMin, __m128 &valid) {
+    __m128 ox = _mm_sub_ps(_mm_set1_ps(ray.start[0]), _mm_loadu_ps(s.cx.data() + i));
+    __m128 oy = _mm_sub_ps(_mm_set1_ps(ray.start[1]), _mm_loadu_ps(s.cy.data() + i));
+    __m128 oz = _mm_sub_ps(_mm_set1_ps(ray.start[2]), _mm_loadu_ps(s.cz.data() + i));
+    __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, _mm_set1_ps(ray.dir[0])), _mm_mul_ps(oy, _mm_set1_ps(ray.dir[1]))),
+                          _mm_mul_ps(oz, _mm_set1_ps(ray.dir[2])));
+    __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)),
+                          _mm_loadu_ps(s.r2.data() + i));
+    __m128 delta = _mm_sub_ps(_mm_mul_ps(b, b), c);
+    __m128 sq = _mm_sqrt_ps(_mm_max_ps(delta, _mm_setzero_ps()));
+    __m128 nb = _mm_sub_ps(_mm_setzero_ps(), b);
+    __m128 t0 = _mm_sub_ps(nb, sq), t1 = _mm_add_ps(nb, sq);
+    __m128 vMin = _mm_set1_ps(tMin);
+    __m128 useT0 = _mm_cmpgt_ps(t0, vMin);
+    __m128 t = _mm_or_ps(_mm_and_ps(useT0, t0), _mm_andnot_ps(useT0, t1));
+    valid = _mm_and_ps(_mm_cmpge_ps(delta, _mm_setzero_ps()), _mm_cmpgt_ps(t, vMin));
+    return t;
+}
+
+__attribute__((target("sse2")))
+inline int SphereNearestSSE(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float &tBest) {
+    int best = -1;
+    alignas(16) float t[4];
+    for (int i = begin; i < end; i += 4) {
+        __m128 valid;
+        __m128 tv = SphereRoots4(s, ray, i, tMin, valid);
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(tv, _mm_set1_ps(tBest)));
+        unsigned bits = unsigned(_mm_movemask_ps(valid)) & LaneBits(end - i, 4);
+        if (bits == 0)
+            continue;
+        _mm_store_ps(t, tv);
+        int lane = PickNearestLane(t, bits, tBest);
+        if (lane >= 0)
+            best = i + lane;
+    }
+    return best;
+}
+
+__attribute__((target("sse2")))
+inline int SphereAnySSE(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float tMax) {
+    for (int i = begin; i < end; i += 4) {
+        __m128 valid;
+        __m128 tv = SphereRoots4(s, ray, i, tMin, valid);
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(tv, _mm_set1_ps(tMax)));
+        unsigned bits = unsigned(_mm_movemask_ps(valid)) & LaneBits(end - i, 4);
+        if (bits != 0)
+            return i + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+__attribute__((target("sse2")))
+inline void SphereShadowSSE(const SphereSoA &s, int i, ShadowPacket &p, int lanes) {
+    float ox = p.origin[0] - s.cx.data()[i], oy = p.origin[1] - s.cy.data()[i], oz = p.origin[2] - s.cz.data()[i];
+    __m128 vx = _mm_set1_ps(ox), vy = _mm_set1_ps(oy), vz = _mm_set1_ps(oz);
+    __m128 c = _mm_set1_ps(ox * ox + oy * oy + oz * oz - s.r2.data()[i]);
+    __m128 vMin = _mm_set1_ps(p.tMin), blocked = _mm_set1_ps(-INFINITY);
+    for (int k = 0; k < lanes; k += 4) {
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_load_ps(p.dx + k)), _mm_mul_ps(vy, _mm_load_ps(p.dy + k))),
+                              _mm_mul_ps(vz, _mm_load_ps(p.dz + k)));
+        __m128 delta = _mm_sub_ps(_mm_mul_ps(b, b), c);
+        __m128 sq = _mm_sqrt_ps(_mm_max_ps(delta, _mm_setzero_ps()));
+        __m128 nb = _mm_sub_ps(_mm_setzero_ps(), b);
+        __m128 t0 = _mm_sub_ps(nb, sq), t1 = _mm_add_ps(nb, sq);
+        __m128 useT0 = _mm_cmpgt_ps(t0, vMin);
+        __m128 t = _mm_or_ps(_mm_and_ps(useT0, t0), _mm_andnot_ps(useT0, t1));
+        __m128 tMax = _mm_load_ps(p.tMax + k);
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(delta, _mm_setzero_ps()),
+                                _mm_and_ps(_mm_cmpgt_ps(t, vMin), _mm_cmplt_ps(t, tMax)));
+        _mm_store_ps(p.tMax + k, _mm_or_ps(_mm_and_ps(hit, blocked), _mm_andnot_ps(hit, tMax)));
+    }
+}
+
+__attribute__((target("avx2")))
+inline __m256 SphereRoots8(const SphereSoA &s, const Ray &ray, int i, float tMin, __m256 &valid) {
+    __m256 ox = _mm256_sub_ps(_mm256_set1_ps(ray.start[0]), _mm256_loadu_ps(s.cx.data() + i));
+    __m256 oy = _mm256_sub_ps(_mm256_set1_ps(ray.start[1]), _mm256_loadu_ps(s.cy.data() + i));
+    __m256 oz = _mm256_sub_ps(_mm256_set1_ps(ray.start[2]), _mm256_loadu_ps(s.cz.data() + i));
+    __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, _mm256_set1_ps(ray.dir[0])),
+                                           _mm256_mul_ps(oy, _mm256_set1_ps(ray.dir[1]))),
+                             _mm256_mul_ps(oz, _mm256_set1_ps(ray.dir[2])));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)),
+                                           _mm256_mul_ps(oz, oz)),
+                             _mm256_loadu_ps(s.r2.data() + i));
+    __m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+    __m256 sq = _mm256_sqrt_ps(_mm256_max_ps(delta, _mm256_setzero_ps()));
+    __m256 nb = _mm256_sub_ps(_mm256_setzero_ps(), b);
+    __m256 t0 = _mm256_sub_ps(nb, sq), t1 = _mm256_add_ps(nb, sq);
+    __m256 vMin = _mm256_set1_ps(tMin);
+    __m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, vMin, _CMP_GT_OQ));
+    valid = _mm256_and_ps(_mm256_cmp_ps(delta, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_cmp_ps(t, vMin, _CMP_GT_OQ));
+    return t;
+}
+
+__attribute__((target("avx2")))
+inline int SphereNearestAVX2(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float &tBest) {
+    int best = -1;
+    alignas(32) float t[8];
+    for (int i = begin; i < end; i += 8) {
+        __m256 valid;
+        __m256 tv = SphereRoots8(s, ray, i, tMin, valid);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(tv, _mm256_set1_ps(tBest), _CMP_LT_OQ));
+        unsigned bits = unsigned(_mm256_movemask_ps(valid)) & LaneBits(end - i, 8);
+        if (bits == 0)
+            continue;
+        _mm256_store_ps(t, tv);
+        int lane = PickNearestLane(t, bits, tBest);
+        if (lane >= 0)
+            best = i + lane;
+    }
+    return best;
+}
+
+__attribute__((target("avx2")))
+inline int SphereAnyAVX2(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float tMax) {
+    for (int i = begin; i < end; i += 8) {
+        __m256 valid;
+        __m256 tv = SphereRoots8(s, ray, i, tMin, valid);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(tv, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+        unsigned bits = unsigned(_mm256_movemask_ps(valid)) & LaneBits(end - i, 8);
+        if (bits != 0)
+            return i + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+inline void SphereShadowAVX2(const SphereSoA &s, int i, ShadowPacket &p, int lanes) {
+    float ox = p.origin[0] - s.cx.data()[i], oy = p.origin[1] - s.cy.data()[i], oz = p.origin[2] - s.cz.data()[i];
+    __m256 vx = _mm256_set1_ps(ox), vy = _mm256_set1_ps(oy), vz = _mm256_set1_ps(oz);
+    __m256 c = _mm256_set1_ps(ox * ox + oy * oy + oz * oz - s.r2.data()[i]);
+    __m256 vMin = _mm256_set1_ps(p.tMin), blocked = _mm256_set1_ps(-INFINITY);
+    for (int k = 0; k < lanes; k += 8) {
+        __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, _mm256_load_ps(p.dx + k)),
+                                               _mm256_mul_ps(vy, _mm256_load_ps(p.dy + k))),
+                                 _mm256_mul_ps(vz, _mm256_load_ps(p.dz + k)));
+        __m256 delta = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+        __m256 sq = _mm256_sqrt_ps(_mm256_max_ps(delta, _mm256_setzero_ps()));
+        __m256 nb = _mm256_sub_ps(_mm256_setzero_ps(), b);
+        __m256 t0 = _mm256_sub_ps(nb, sq), t1 = _mm256_add_ps(nb, sq);
+        __m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, vMin, _CMP_GT_OQ));
+        __m256 tMax = _mm256_load_ps(p.tMax + k);
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(delta, _mm256_setzero_ps(), _CMP_GE_OQ),
+                                   _mm256_and_ps(_mm256_cmp_ps(t, vMin, _CMP_GT_OQ), _mm256_cmp_ps(t, tMax, _CMP_LT_OQ)));
+        _mm256_store_ps(p.tMax + k, _mm256_blendv_ps(tMax, blocked, hit));
+    }
+}
+
+__attribute__((target("avx512f")))
+inline __m512 SphereRoots16(const SphereSoA &s, const Ray &ray, int i, float tMin, __mmask16 &valid) {
+    __m512 ox = _mm512_sub_ps(_mm512_set1_ps(ray.start[0]), _mm512_loadu_ps(s.cx.data() + i));
+    __m512 oy = _mm512_sub_ps(_mm512_set1_ps(ray.start[1]), _mm512_loadu_ps(s.cy.data() + i));
+    __m512 oz = _mm512_sub_ps(_mm512_set1_ps(ray.start[2]), _mm512_loadu_ps(s.cz.data() + i));
+    __m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, _mm512_set1_ps(ray.dir[0])),
+                                           _mm512_mul_ps(oy, _mm512_set1_ps(ray.dir[1]))),
+                             _mm512_mul_ps(oz, _mm512_set1_ps(ray.dir[2])));
+    __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, ox), _mm512_mul_ps(oy, oy)),
+                                           _mm512_mul_ps(oz, oz)),
+                             _mm512_loadu_ps(s.r2.data() + i));
+    __m512 delta = _mm512_sub_ps(_mm512_mul_ps(b, b), c);
+    __m512 sq = _mm512_sqrt_ps(_mm512_max_ps(delta, _mm512_setzero_ps()));
+    __m512 nb = _mm512_sub_ps(_mm512_setzero_ps(), b);
+    __m512 t0 = _mm512_sub_ps(nb, sq), t1 = _mm512_add_ps(nb, sq);
+    __m512 vMin = _mm512_set1_ps(tMin);
+    __m512 t = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(t0, vMin, _CMP_GT_OQ), t1, t0);
+    valid = _mm512_cmp_ps_mask(delta, _mm512_setzero_ps(), _CMP_GE_OQ) & _mm512_cmp_ps_mask(t, vMin, _CMP_GT_OQ);
+    return t;
+}
+
+__attribute__((target("avx512f")))
+inline int SphereNearestAVX512(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float &tBest) {
+    int best = -1;
+    alignas(64) float t[16];
+    for (int i = begin; i < end; i += 16) {
+        __mmask16 valid;
+        __m512 tv = SphereRoots16(s, ray, i, tMin, valid);
+        valid &= _mm512_cmp_ps_mask(tv, _mm512_set1_ps(tBest), _CMP_LT_OQ);
+        unsigned bits = unsigned(valid) & LaneBits(end - i, 16);
+        if (bits == 0)
+            continue;
+        _mm512_store_ps(t, tv);
+        int lane = PickNearestLane(t, bits, tBest);
+        if (lane >= 0)
+            best = i + lane;
+    }
+    return best;
+}
+
+__attribute__((target("avx512f")))
+inline int SphereAnyAVX512(const SphereSoA &s, const Ray &ray, int begin, int end, float tMin, float tMax) {
+    for (int i = begin; i < end; i += 16) {
+        __mmask16 valid;
+        __m512 tv = SphereRoots16(s, ray, i, tMin, valid);
+        valid &= _mm512_cmp_ps_mask(tv, _mm512_set1_ps(tMax), _CMP_LT_OQ);
+        unsigned bits = unsigned(valid) & LaneBits(end - i, 16);
+        if (bits != 0)
+            return i + __builtin_ctz(bits);
+    }
+    return -1;
+}
+
+__attribute__((target("avx512f")))
+inline void SphereShadowAVX512(const SphereSoA &s, int i, ShadowPacket &p, int lanes) {
+    float ox = p.origin[0] - s.cx.data()[i], oy = p.origin[1] - s.cy.data()[i], oz = p.origin[2] - s.cz.data()[i];
+    __m512 vx = _mm512_set1_ps(ox), vy = _mm512_set1_ps(oy), vz = _mm512_set1_ps(oz);
+    __m512 c = _mm512_set1_ps(ox * ox + oy * oy + oz * oz - s.r2.data()[i]);
+    __m512 vMin = _mm512_set1_ps(p.tMin), blocked = _mm512_set1_ps(-INFINITY);
+    for (int k = 0; k < lanes; k += 16) {
+        __m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(vx, _mm512_load_ps(p.dx + k)),
+                                               _mm512_mul_ps(vy, _mm512_load_ps(p.dy + k))),
+                                 _mm512_mul_ps(vz, _mm512_load_ps(p.dz + k)));
+        __m512 delta = _mm512_sub_ps(_mm512_mul_ps(b, b), c);
+        __m512 sq = _mm512_sqrt_ps(_mm512_max_ps(delta, _mm512_setzero_ps()));
+        __m512 nb = _mm512_sub_ps(_mm512_setzero_ps(), b);
+        __m512 t0 = _mm512_sub_ps(nb, sq), t1 = _mm512_add_ps(nb, sq);
+        __m512 t = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(t0, vMin, _CMP_GT_OQ), t1, t0);
+        __m512 tMax = _mm512_load_ps(p.tMax + k);
+        __mmask16 hit = _mm512_cmp_ps_mask(delta, _mm512_setzero_ps(), _CMP_GE_OQ) &
+                        _mm512_cmp_ps_mask(t, vMin, _CMP_GT_OQ) & _mm512_cmp_ps_mask(t, tMax, _CMP_LT_OQ);
+        _mm512_store_ps(p.tMax + k, _mm512_mask_blend_ps(hit, tMax, blocked));
+    }
+}
+
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT DEFAULT
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif // TCODE_X86_SIMD
+
+// 按宽度取核，width为0时按CPU支持的指令集选最宽的；不支持的宽度退回标量
+inline SphereKernel FindSphereKernel(int width) {
+#ifdef TCODE_X86_SIMD
+    __builtin_cpu_init();
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    if ((width == 0 || width == 16) && avx512)
+        return {16, "avx512", SphereNearestAVX512, SphereAnyAVX512, SphereShadowAVX512};
+    if ((width == 0 || width == 8) && avx2)
+        return {8, "avx2", SphereNearestAVX2, SphereAnyAVX2, SphereShadowAVX2};
+    if (width == 0 || width == 4)
+        return {4, "sse", SphereNearestSSE, SphereAnySSE, SphereShadowSSE};
+#endif
+    return {1, "scalar", SphereNearestScalar, SphereAnyScalar, SphereShadowScalar};
+}
+
+// 当前使用的核，程序启动时按CPU自动选择
+inline SphereKernel &ActiveSphereKernel() {
+    static SphereKernel kernel = FindSphereKernel(0);
+    return kernel;
+}
+
+#endif //TCODE_SIMD_SPHERE_H
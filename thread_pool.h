@@ -0,0 +1,126 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_THREAD_POOL_H
+#define TCODE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池：每个工作线程有自己的任务队列，从队头取任务；
+// 自己的队列空了以后从其他线程的队尾偷任务。线程常驻，可以反复提交任务。
+class ThreadPool {
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<WorkQueue> queues;
+    std::mutex submitLock;                // 同一时间只允许一批任务
+    std::mutex jobLock;
+    std::condition_variable jobStart, jobDone;
+    const std::function<void(int, int)> *job = nullptr;
+    unsigned long long generation = 0;    // 每提交一批任务加一，用于唤醒工作线程
+    unsigned busyWorkers = 0;
+    bool stopping = false;
+
+    bool popTask(unsigned id, int &task) {
+        WorkQueue &q = queues[id];
+        std::lock_guard<std::mutex> lk(q.lock);
+        if (q.tasks.empty())
+            return false;
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool stealTask(unsigned id, int &task) {
+        for (unsigned i = 1; i < queues.size(); i++) {
+            WorkQueue &q = queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> lk(q.lock);
+            if (!q.tasks.empty()) {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned id) {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(jobLock);
+                jobStart.wait(lk, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            int task;
+            while (popTask(id, task) || stealTask(id, task))
+                (*job)(task, int(id));
+            {
+                std::lock_guard<std::mutex> lk(jobLock);
+                if (--busyWorkers == 0)
+                    jobDone.notify_all();
+            }
+        }
+    }
+
+public:
+    // threadCount为0时使用硬件线程数
+    explicit ThreadPool(unsigned threadCount = 0) {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+        queues = std::vector<WorkQueue>(threadCount);
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lk(jobLock);
+            stopping = true;
+        }
+        jobStart.notify_all();
+        for (std::thread &t: workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return unsigned(workers.size()); }
+
+    // 执行fn(task, worker)，task取[0, count)，阻塞直到全部完成。
+    // 任务按顺序切成连续的几段分给各线程，保证每个线程先处理相邻的任务
+    void parallelFor(int count, const std::function<void(int, int)> &fn) {
+        if (count <= 0)
+            return;
+        std::lock_guard<std::mutex> submit(submitLock);
+        unsigned n = size();
+        for (unsigned w = 0; w < n; w++) {
+            std::lock_guard<std::mutex> lk(queues[w].lock);
+            for (long long i = (long long) count * w / n; i < (long long) count * (w + 1) / n; i++)
+                queues[w].tasks.push_back(int(i));
+        }
+        std::unique_lock<std::mutex> lk(jobLock);
+        job = &fn;
+        busyWorkers = n;
+        generation++;
+        jobStart.notify_all();
+        jobDone.wait(lk, [&] { return busyWorkers == 0; });
+        job = nullptr;
+    }
+};
+
+#endif //TCODE_THREAD_POOL_H
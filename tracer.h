@@ -0,0 +1,770 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_TRACER_H
+#define TCODE_TRACER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "alloc_counter.h"
+#include "camera.h"
+#include "counters.h"
+#include "lightmap.h"
+#include "objects.h"
+#include "packet.h"
+#include "profile.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include "wavefront.h"
+
+const int MaxTraceDepth = 5; // 最大递归层数（弹射次数）
+
+inline thread_local uint64_t threadShadowRays = 0; // 本线程发出的阴影光线数
+
+// 每个方向上的分层数：n个采样对应约sqrt(n) x sqrt(n)的网格
+inline int ShadowGridSide(int samples) {
+    return std::min(std::max(int(sqrt(float(samples)) + 0.5f), 1), MaxShadowGridSide);
+}
+
+// 光线追踪器：对一个建好BVH的场景计算光线的颜色，只读场景，可以被多个线程同时使用。
+// 不依赖窗口和OpenGL，窗口程序和基准测试共用。lightmaps不为nullptr时，平面和球上的着色点从烘焙好的光照图里取可见度
+class Tracer {
+public:
+    Tracer(const Scene &_scene, const RenderSettings &_settings, const Lightmaps *_lightmaps = nullptr)
+            : scene(_scene), settings(_settings), lightmaps(_lightmaps) {}
+
+    const Scene &getScene() const { return scene; }
+
+    const RenderSettings &getSettings() const { return settings; }
+
+    // 计算该光源照到该点的光照强度；lastOccluder为该光源上一次的遮挡物，逐条光线查询时先测试它。
+    // 阴影光线从该点出发，作为光线束一起求交，视锥取该点到正方形光源四个角。
+    // 自适应采样时把光源分成grid x grid个小格：先在coarse x coarse个大格里各随机取一个小格，在格内随机取一点；
+    // 这些光线全部照到或全部被挡住就直接返回，否则该点在半影里，其余小格也各取一点。
+    // 随机数种子由该点和光源的位置决定，结果与像素的计算顺序无关
+    Vec3 calLightIntensity(const Vec3 &position, const Light &light, ObjectId &lastOccluder) const {
+        int total;
+        int visible = shadowSamples(position, light, lastOccluder, total);
+        if (!settings.adaptiveShadows)
+            return light.dLightIntensity * float(visible);
+        if (visible == 0)
+            return Vec3(0, 0, 0);
+        if (visible == total)
+            return light.lightIntensity;
+        return light.lightIntensity * (float(visible) / float(total));
+    }
+
+    // 该点看到光源的比例（0 ~ 1），与calLightIntensity发出相同的阴影光线，用于烘焙光照图
+    float lightVisibility(const Vec3 &position, const Light &light) const {
+        ObjectId lastOccluder = NoObject;
+        int total;
+        int visible = shadowSamples(position, light, lastOccluder, total);
+        return float(visible) / float(total);
+    }
+
+    // 发出该点到光源的阴影光线，返回没被挡住的条数，total为发出的条数
+    int shadowSamples(const Vec3 &position, const Light &light, ObjectId &lastOccluder, int &total) const {
+        float h = light.r / 2;
+        Vec3 corners[4] = {light.position + Vec3(-h, 0, -h), light.position + Vec3(h, 0, -h),
+                           light.position + Vec3(h, 0, h), light.position + Vec3(-h, 0, h)};
+        for (Vec3 &corner: corners)
+            corner -= position;
+        Frustum frustum;
+        bool valid = frustum.build(position, corners, light.position - position); // 该点与光源几乎共面时视锥退化
+        frustum.setFar(light.position, Vec3(0, position[1] < light.position[1] ? -1.0f : 1.0f, 0));
+        const Frustum *cull = valid ? &frustum : nullptr;
+        ShadowPacket packet;
+        packet.reset(position);
+        Vec3x8 targets;        // 光照元按8个一组计算光线方向
+        int n = 0, visible = 0;
+        auto push = [&]() {
+            if (!packet.add(targets, n)) {
+                visible += flushShadowPacket(packet, cull, lastOccluder);
+                packet.add(targets, n);
+            }
+            n = 0;
+        };
+        if (!settings.adaptiveShadows) { // 固定的piece x piece个光照元
+            for (int i = 0; i < piece; i++) {
+                for (int j = 0; j < piece; j++) {
+                    targets.set(n++, light.position + Vec3(-light.r / 2 + light.r / piece * i, 0, -light.r / 2 + light.r / piece * j));
+                    if (n == 8)
+                        push();
+                }
+            }
+            push();
+            total = piece * piece;
+            return visible + flushShadowPacket(packet, cull, lastOccluder);
+        }
+
+        int grid = ShadowGridSide(settings.shadowSamples);
+        int coarse = std::min(ShadowGridSide(settings.initialShadowSamples), grid);
+        uint32_t seed = 0;
+        for (int k = 0; k < 3; k++)
+            seed = HashFloat(HashFloat(seed, position[k]), light.position[k]);
+        Random random(seed);
+        bool used[MaxShadowGridSide * MaxShadowGridSide] = {};
+        float cell = light.r / grid;
+        auto sample = [&](int i, int j) {
+            used[i * grid + j] = true;
+            float u = random.nextFloat();
+            float v = random.nextFloat();
+            targets.set(n++, light.position + Vec3(-h + cell * (i + u), 0, -h + cell * (j + v)));
+            if (n == 8)
+                push();
+        };
+        for (int a = 0; a < coarse; a++) {
+            int i0 = (a * grid + coarse - 1) / coarse, i1 = ((a + 1) * grid + coarse - 1) / coarse;
+            for (int b = 0; b < coarse; b++) {
+                int j0 = (b * grid + coarse - 1) / coarse, j1 = ((b + 1) * grid + coarse - 1) / coarse;
+                int i = i0 + random.nextInt(i1 - i0);
+                sample(i, j0 + random.nextInt(j1 - j0));
+            }
+        }
+        push();
+        visible += flushShadowPacket(packet, cull, lastOccluder);
+        total = coarse * coarse;
+        if (visible == 0 || visible == total)
+            return visible;
+        for (int i = 0; i < grid; i++) {
+            for (int j = 0; j < grid; j++) {
+                if (!used[i * grid + j])
+                    sample(i, j);
+            }
+        }
+        push();
+        total = grid * grid;
+        return visible + flushShadowPacket(packet, cull, lastOccluder);
+    }
+
+    // 不需要继续追踪的情况：光线先碰到光源、没有交点或者交点在粗糙表面上，返回true，radiance为这条光线的颜色；
+    // 交点在反射/折射表面上时返回false，颜色由scatter给出的光线决定。
+    // 光源多于settings.lightSamples时不逐个计算，而是按估计的贡献抽样（见sampleLights）
+    bool directRadiance(const Ray &ray, const Hit &nearHit, ObjectId nearId, Vec3 &radiance) const {
+        int light = scene.lightTree.intersect(ray, nearHit.t); // 与光源相交，返回光源亮度
+        if (light >= 0) {
+            radiance = scene.lights[light]->lightIntensity;
+            return true;
+        }
+        if (nearId == NoObject) { // 没有与物体相交
+            radiance = scene.ambientLight;
+            return true;
+        }
+        if (nearHit.material->type != ROUGH)
+            return false;
+        Vec3 outRadiance = nearHit.material->ka * scene.ambientLight; // 初始化返回光线（利用环境光）
+        int samples = std::min(settings.lightSamples, MaxLightSamples);
+        if (samples == 0 || scene.lights.size() <= size_t(samples)) {
+            for (size_t i = 0; i < scene.lights.size(); i++) // fixed 改成有限面光源
+                addLight(ray, nearHit, nearId, i, 1, outRadiance);
+        } else {
+            int lights[MaxLightSamples];
+            float weights[MaxLightSamples];
+            int count = sampleLights(nearHit, samples, lights, weights);
+            for (int k = 0; k < count; k++)
+                addLight(ray, nearHit, nearId, size_t(lights[k]), weights[k], outRadiance);
+        }
+        radiance = outRadiance;
+        return true;
+    }
+
+    // 第i个光源照到交点的漫反射和镜面反射乘上weight加到outRadiance上
+    void addLight(const Ray &ray, const Hit &nearHit, ObjectId nearId, size_t i, float weight, Vec3 &outRadiance) const {
+        const Light *light = scene.lights[i];
+        ObjectId lastOccluder = NoObject; // 该光源上一次的遮挡物，只在这个着色点内有效，结果与像素的计算顺序无关
+        float visibility;
+        Vec3 nowLightIntensity = lightmaps != nullptr && lightmaps->lookup(nearId, i, nearHit.position, visibility)
+                                 ? light->lightIntensity * visibility
+                                 : calLightIntensity(nearHit.position, *light, lastOccluder);
+        Vec3 direction = Normalize(light->position - nearHit.position); // direction = position->light
+        float cosTheta = Dot(nearHit.normal, direction);
+        if (cosTheta > 0)    // 如果cos小于0（钝角），说明光照到的是物体背面，相机看不到
+        {
+            if (nowLightIntensity != Vec3(0, 0, 0))    // 有亮度
+            {
+                outRadiance += nowLightIntensity * nearHit.material->kd * cosTheta * weight; // 漫反射成分
+                Vec3 halfway = Normalize(-ray.dir + direction);
+                float cosDelta = Dot(nearHit.normal, halfway);
+                if (cosDelta > 0) { // 镜面反射成分
+                    outRadiance += light->dLightIntensity * nearHit.material->ks * powf(cosDelta, nearHit.material->shininess) * weight;
+                }
+            }
+        }
+    }
+
+    // 用光源BVH按估计的贡献为交点抽samples次光源（有放回），同一个光源只算一次，权重为各次1/(pdf * samples)之和，
+    // 结果是所有光源之和的无偏估计。返回不同光源的个数。随机数种子由交点位置决定，结果与像素的计算顺序无关
+    int sampleLights(const Hit &nearHit, int samples, int *lights, float *weights) const {
+        uint32_t seed = 0;
+        for (int k = 0; k < 3; k++)
+            seed = HashFloat(seed, nearHit.position[k]);
+        Random random(seed);
+        int count = 0;
+        for (int s = 0; s < samples; s++) {
+            float pdf;
+            float u = (float(s) + random.nextFloat()) / float(samples);        // 分层：各次抽样落在树的不同部分
+            int light = scene.lightTree.sample(nearHit.position, nearHit.normal, std::min(u, 0x1.fffffep-1f), pdf);
+            if (light < 0)        // 这一层抽到的光源贡献都为0，这次抽样的贡献就是0，其余各层照常抽
+                continue;
+            float weight = 1 / (pdf * float(samples));
+            int k = 0;
+            while (k < count && lights[k] != light)
+                k++;
+            if (k == count) {
+                lights[count] = light;
+                weights[count++] = 0;
+            }
+            weights[k] += weight;
+        }
+        return count;
+    }
+
+    // 反射/折射表面上需要继续追踪的光线和它们的权重（菲涅尔项），返回光线数：反射光线一条，透明物体再加一条折射光线
+    static int scatter(const Ray &ray, const Hit &nearHit, Ray rays[2], Vec3 weights[2]) {
+        const Vec3 one(1, 1, 1);
+        float cosa = -Dot(ray.dir, nearHit.normal);        // 镜面反射（继续追踪）
+        Vec3 F = nearHit.material->F0 + (one - nearHit.material->F0) * pow(1 - cosa, 5);
+        Vec3 reflectedDir = ray.dir - nearHit.normal * (Dot(nearHit.normal, ray.dir) * 2.0f);		// 反射光线R = v + 2Ncosa
+        rays[0] = Ray(nearHit.position + nearHit.normal * epsilon, reflectedDir);
+        weights[0] = F;
+        if (nearHit.material->type == REFRACTIVE)     // 对于透明物体，计算折射（继续追踪）
+        {
+            float disc = 1 - (1 - cosa * cosa) / nearHit.material->ior / nearHit.material->ior;
+            if (disc >= 0) {
+                Vec3 refractedDir = ray.dir * (1.0 / nearHit.material->ior) + nearHit.normal * (cosa / nearHit.material->ior - sqrt(disc));
+                rays[1] = Ray(nearHit.position - nearHit.normal * epsilon, refractedDir);
+                weights[1] = one - F;
+                return 2;
+            }
+        }
+        return 1;
+    }
+
+    // 已知最近交点后计算这条光线的颜色（光线束和单条光线共用），反射/折射光线递归追踪
+    Vec3 shade(const Ray &ray, int depth, const Hit &nearHit, ObjectId nearId) const {
+        Vec3 radiance;
+        if (directRadiance(ray, nearHit, nearId, radiance))
+            return radiance;
+        Ray rays[2];
+        Vec3 weights[2];
+        int n = scatter(ray, nearHit, rays, weights);
+        radiance = trace(rays[0], depth + 1) * weights[0];
+        if (n == 2)
+            radiance += trace(rays[1], depth + 1) * weights[1];
+        return radiance;
+    }
+
+    Vec3 trace(const Ray &ray, int depth) const {
+        if (depth > MaxTraceDepth) { // 到达最大递归层数
+            return scene.ambientLight;
+        }
+        Hit nearHit;
+        nearHit.t = INFINITY;
+        ObjectId nearId = NoObject;
+        CountRay(depth);
+        scene.intersect(ray, nearHit, nearId); // 确定最近的交点
+        return shade(ray, depth, nearHit, nearId);
+    }
+
+    // 波前模式下一条光线的一次弹射：颜色乘上权重累加到像素上，反射/折射光线放进下一次弹射的队列。
+    // color是块的颜色缓冲，每像素3个float，需要预先清零
+    void shadeWavefront(Wavefront &wavefront, const WavefrontRay &r, const Hit &nearHit, ObjectId nearId, float *color) const {
+        float *out = color + size_t(r.pixel) * 3;
+        Vec3 radiance;
+        if (directRadiance(r.ray, nearHit, nearId, radiance)) {
+            radiance = radiance * r.weight;
+            out[0] += radiance[0], out[1] += radiance[1], out[2] += radiance[2];
+            return;
+        }
+        Ray rays[2];
+        Vec3 weights[2];
+        int n = scatter(r.ray, nearHit, rays, weights);
+        for (int k = 0; k < n; k++) {
+            Vec3 weight = r.weight * weights[k];
+            if (r.depth + 1 <= MaxTraceDepth && wavefront.emit(rays[k], weight, r.pixel, r.depth + 1))
+                continue;
+            radiance = trace(rays[k], r.depth + 1) * weight; // 超过最大层数时trace返回环境光；队列满时直接递归追踪
+            out[0] += radiance[0], out[1] += radiance[1], out[2] += radiance[2];
+        }
+    }
+
+    // 波前模式下追踪一块中主光线之后的各次弹射；cost不为nullptr时把每条光线的开销记到它的像素上
+    void runWavefront(Wavefront &wavefront, float *color, TileCost *cost = nullptr) const {
+        runWavefront(wavefront, color, cost, [](int pixel) { return pixel; });
+    }
+
+    // 同上，颜色缓冲的下标不是块中的像素时（抗锯齿的一批采样），开销记到costPixel(下标)上
+    template<class CostPixelFn>
+    void runWavefront(Wavefront &wavefront, float *color, TileCost *cost, CostPixelFn costPixel) const {
+        wavefront.run([&](const WavefrontRay &r, Hit &hit, ObjectId &id) {
+                          PixelCostScope scope(cost, cost != nullptr ? costPixel(r.pixel) : 0);
+                          CountRay(r.depth);
+                          scene.intersect(r.ray, hit, id);
+                      },
+                      [&](const WavefrontRay &r, const Hit &hit, ObjectId id) {
+                          PixelCostScope scope(cost, cost != nullptr ? costPixel(r.pixel) : 0);
+                          shadeWavefront(wavefront, r, hit, id, color);
+                      });
+    }
+
+private:
+    const Scene &scene;
+    RenderSettings settings;
+    const Lightmaps *lightmaps;
+
+    // 求出packet中没被挡住的阴影光线数，然后清空packet
+    int flushShadowPacket(ShadowPacket &packet, const Frustum *frustum, ObjectId &lastOccluder) const {
+        if (packet.count == 0)
+            return 0;
+        threadShadowRays += packet.count;
+        Count(ShadowRays, packet.count);
+        int visible = scene.occludePacket(packet, frustum, lastOccluder);
+        packet.reset(packet.origin);
+        return visible;
+    }
+};
+
+struct RenderStats {        // 一帧的统计
+    double seconds = 0;
+    unsigned threads = 0;
+    size_t tiles = 0, passes = 0;
+    uint64_t shadowRays = 0;
+    uint64_t tracingAllocations = 0;    // 光线追踪过程中的堆分配次数，应当为0
+    uint64_t aaSamples = 0;             // 抗锯齿加的采样数
+    size_t aaPixels = 0;                // 加了采样的像素数
+};
+
+// 跨帧复用的渲染资源：线程池、分块、渐进的各遍和每个线程的缓冲（块的颜色、波前队列）。
+// 连续渲染多帧（动画）时只创建一次，每帧不再启动线程、分配内存
+struct RenderContext {
+    int width, height;
+    ThreadPool pool;
+    std::vector<Tile> tiles;
+    std::vector<Pass> passes;
+    std::vector<Wavefront> wavefronts;          // 每个线程一组波前队列，容量够放一块的光线各弹射两条
+    std::vector<TileContext> tileContexts;
+    Tile aaRegion;                              // 抗锯齿：tiles覆盖的矩形
+    std::vector<float> aaContrast;              // aaRegion中每个像素与3x3邻域的颜色差，按行存放
+    Tile aaBorders[4];                          // aaRegion外面的一圈（上、下、左、右），aaRegion是整幅图像时都为空
+    std::unique_ptr<FrameBuffer> aaBorderFrames[4];     // 这一圈像素的中心采样
+
+    // wholeImage为false时不切块，由调用者每次只放要画的那部分块（分带渲染、分布式渲染的worker），图像再大也不占内存
+    RenderContext(const RenderSettings &settings, int _width, int _height, bool wholeImage = true)
+            : width(_width), height(_height), pool(settings.threads),
+              tiles(wholeImage ? MakeTiles(_width, _height, settings.tileSize) : std::vector<Tile>()),
+              passes(MakePasses(settings.coarseStride)),
+              wavefronts(pool.size()), tileContexts(pool.size()) {
+        for (Wavefront &wavefront: wavefronts)
+            wavefront.reserve(2 * settings.tileSize * settings.tileSize);
+        size_t tilePixels = size_t(settings.tileSize) * settings.tileSize;
+        for (TileContext &ctx: tileContexts) {
+            ctx.color.reserve(tilePixels * 3);
+            ctx.aaPixels.reserve(tilePixels);
+            ctx.aaColor.reserve(tilePixels * 3);
+            ctx.aaOwner.reserve(tilePixels);
+        }
+        if (wholeImage && settings.aaMaxSamples > 1)
+            aaContrast.reserve(size_t(_width) * _height);
+    }
+};
+
+const int AASamplesPerRound = 4;    // 抗锯齿每轮给每个像素加的采样数
+const int AAGridSide = 4;           // 抗锯齿采样在像素内按AAGridSide x AAGridSide的格子分层
+
+// 像素内第index个抗锯齿采样（从1开始，0是像素中心）的位置：按种子把格子的顺序打乱，依次在各格内随机取一点
+inline void AASamplePosition(uint32_t seed, int index, float &fx, float &fy) {
+    const int Cells = AAGridSide * AAGridSide;
+    int order[Cells];
+    for (int i = 0; i < Cells; i++)
+        order[i] = i;
+    Random shuffle(seed);
+    for (int i = Cells - 1; i > 0; i--)
+        std::swap(order[i], order[shuffle.nextInt(i + 1)]);
+    int cell = order[(index - 1) % Cells];
+    Random jitter(HashCombine(seed, uint32_t(index)));
+    fx = (float(cell % AAGridSide) + jitter.nextFloat()) / AAGridSide;
+    fy = (float(cell / AAGridSide) + jitter.nextFloat()) / AAGridSide;
+}
+
+inline bool TileContains(const Tile &tile, int x, int y) {
+    return x >= tile.x0 && x < tile.x1 && y >= tile.y0 && y < tile.y1;
+}
+
+// 抗锯齿前先算出这一块每个像素与3x3邻域（在整幅图像内，不按块截断）中颜色（显示值）的最大分量差，写进contrast
+// （按region的行存放）。region是frame中画好的部分，邻居在region之外时从borders（外面一圈的中心采样）读。
+// 这时frame里都是每像素一个中心采样的结果，颜色差与块的大小、线程数、分带渲染和分布式渲染无关
+inline void AAContrastTile(const Tile &tile, const FrameBuffer &frame, const Tile &region, const Tile *borders,
+                           const std::unique_ptr<FrameBuffer> *borderFrames, int width, int height, float *contrast) {
+    auto display = [](float v) { return std::min(std::max(v, 0.0f), 1.0f); };
+    auto center = [&](int x, int y) -> const FrameBuffer & {
+        if (TileContains(region, x, y))
+            return frame;
+        int i = 0;
+        while (!TileContains(borders[i], x, y))
+            i++;
+        return *borderFrames[i];
+    };
+    for (int y = tile.y0; y < tile.y1; y++) {
+        for (int x = tile.x0; x < tile.x1; x++) {
+            float lo[3] = {1, 1, 1}, hi[3] = {0, 0, 0};
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+                    const FrameBuffer &source = center(nx, ny);
+                    for (int k = 0; k < 3; k++) {
+                        float v = display(source.get(nx, ny, k));
+                        lo[k] = std::min(lo[k], v), hi[k] = std::max(hi[k], v);
+                    }
+                }
+            }
+            contrast[size_t(y - region.y0) * (region.x1 - region.x0) + (x - region.x0)] =
+                    std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+        }
+    }
+}
+
+// 自适应抗锯齿：frame中这一块已经画好（每像素一个中心采样），color是要写回的块颜色，
+// contrast是AAContrastTile算出的region中各像素的颜色差。
+// 颜色差超过aaContrast的像素按颜色差从大到小每轮各加AASamplesPerRound个分层抖动的采样，
+// 直到标准误差低于aaError、达到aaMaxSamples或者用完这一块的预算（aaBudget x 块的像素数）。
+// 采样照常走波前，不分配内存；cost不为nullptr时每个采样的开销记到它的像素上。返回加的采样数
+template<class PixelDirFn>
+uint64_t AntialiasTile(const Tracer &tracer, const PixelDirFn &pixelDir, const Tile &tile, const FrameBuffer &frame,
+                       const Tile &region, const float *contrast, TileContext &ctx, Wavefront &wavefront, float *color,
+                       size_t &aaPixels, TileCost *cost = nullptr) {
+    const Scene &scene = tracer.getScene();
+    const RenderSettings &settings = tracer.getSettings();
+    int tileWidth = tile.x1 - tile.x0, tileHeight = tile.y1 - tile.y0;
+    int pixels = tileWidth * tileHeight;
+    for (int y = tile.y0; y < tile.y1; y++) {
+        for (int x = tile.x0; x < tile.x1; x++) {
+            float *c = color + size_t((y - tile.y0) * tileWidth + (x - tile.x0)) * 3;
+            for (int k = 0; k < 3; k++)
+                c[k] = frame.get(x, y, k);
+        }
+    }
+    auto display = [](float v) { return std::min(std::max(v, 0.0f), 1.0f); };
+    std::vector<AAPixel> &list = ctx.aaPixels;
+    list.clear();
+    for (int ly = 0; ly < tileHeight; ly++) {
+        const float *row = contrast + size_t(tile.y0 + ly - region.y0) * (region.x1 - region.x0) + (tile.x0 - region.x0);
+        for (int lx = 0; lx < tileWidth; lx++) {
+            if (row[lx] <= settings.aaContrast)
+                continue;
+            AAPixel a;
+            a.pixel = ly * tileWidth + lx;
+            a.contrast = row[lx];
+            a.count = 1;
+            a.done = false;
+            const float *c = color + size_t(a.pixel) * 3;
+            a.weight = 1 / (1 + std::max(std::max(c[0], c[1]), std::max(c[2], 0.0f)));
+            for (int k = 0; k < 3; k++) {
+                a.sum[k] = display(c[k]);
+                a.sumSq[k] = a.sum[k] * a.sum[k];
+                a.weighted[k] = c[k] * a.weight;
+            }
+            list.push_back(a);
+        }
+    }
+    if (list.empty())
+        return 0;
+    std::sort(list.begin(), list.end(), [](const AAPixel &a, const AAPixel &b) {
+        return a.contrast != b.contrast ? a.contrast > b.contrast : a.pixel < b.pixel;
+    });
+
+    // 一批采样最多pixels个，与主光线的一批相同，波前队列一定放得下
+    std::vector<float> &samples = ctx.aaColor;
+    std::vector<int> &owner = ctx.aaOwner;
+    samples.resize(size_t(pixels) * 3);
+    owner.resize(size_t(pixels));
+    int batch = 0;
+    auto flush = [&]() {
+        tracer.runWavefront(wavefront, samples.data(), cost, [&](int i) { return list[owner[i]].pixel; });
+        for (int i = 0; i < batch; i++) {
+            AAPixel &a = list[owner[i]];
+            const float *c = &samples[size_t(i) * 3];
+            float w = 1 / (1 + std::max(std::max(c[0], c[1]), std::max(c[2], 0.0f)));
+            for (int k = 0; k < 3; k++) {
+                float v = display(c[k]);
+                a.sum[k] += v, a.sumSq[k] += v * v;
+                a.weighted[k] += c[k] * w;
+            }
+            a.weight += w;
+            a.count++;
+        }
+        batch = 0;
+    };
+    int budget = int(settings.aaBudget * float(pixels) + 0.5f);
+    uint64_t added = 0;
+    while (budget > 0) {
+        bool any = false;
+        for (size_t i = 0; i < list.size() && budget > 0; i++) {
+            AAPixel &a = list[i];
+            if (a.done)
+                continue;
+            int n = std::min(std::min(AASamplesPerRound, settings.aaMaxSamples - a.count), budget);
+            if (n <= 0)
+                continue;
+            int first = a.count;        // 批满时flush会更新count，采样的编号按这一轮开始时算
+            int x = tile.x0 + a.pixel % tileWidth, y = tile.y0 + a.pixel / tileWidth;
+            uint32_t seed = HashCombine(HashUint32(uint32_t(x)), uint32_t(y));
+            for (int k = 0; k < n; k++) {
+                if (batch == pixels)
+                    flush();
+                float fx, fy;
+                AASamplePosition(seed, first + k, fx, fy);
+                Ray ray(scene.camera, Normalize(pixelDir(x + fx, y + fy)));
+                Hit hit;
+                hit.t = INFINITY;
+                ObjectId id = NoObject;
+                float *out = &samples[size_t(batch) * 3];
+                out[0] = out[1] = out[2] = 0;
+                owner[batch] = int(i);
+                {
+                    PixelCostScope scope(cost, a.pixel);
+                    CountRay(0);
+                    scene.intersect(ray, hit, id);
+                    tracer.shadeWavefront(wavefront, {ray, Vec3(1, 1, 1), batch, 0}, hit, id, samples.data());
+                }
+                batch++;
+            }
+            budget -= n;
+            added += uint64_t(n);
+            any = true;
+        }
+        if (batch > 0)
+            flush();
+        if (!any)
+            break;
+        for (AAPixel &a: list) {
+            if (a.done)
+                continue;
+            if (a.count >= settings.aaMaxSamples) {
+                a.done = true;
+                continue;
+            }
+            float worst = 0;        // 各分量中最大的均值方差（标准误差的平方）= 总体方差 / (n - 1)
+            for (int k = 0; k < 3; k++) {
+                float mean = a.sum[k] / float(a.count);
+                worst = std::max(worst, std::max(a.sumSq[k] / float(a.count) - mean * mean, 0.0f) / float(a.count - 1));
+            }
+            a.done = sqrtf(worst) < settings.aaError;
+        }
+    }
+    for (const AAPixel &a: list) {
+        float *c = color + size_t(a.pixel) * 3;
+        for (int k = 0; k < 3; k++)
+            c[k] = a.weighted[k] / a.weight;
+    }
+    aaPixels += list.size();
+    return added;
+}
+
+// 渐进地渲染一帧：先隔coarseStride个像素算一遍得到粗略的图像，之后每遍步长减半，每画完一块就写进帧缓冲。
+// 相机位置在scene.camera，朝向为scene.cameraYaw、cameraPitch（camera.h），视场角CameraFOV，图像大小为context.width x context.height。每遍结束后调用onPass(第几遍, 这一遍的步长)。
+// 最后一遍之后，settings.aaMaxSamples大于1时再逐块做自适应抗锯齿（AntialiasTile）。
+// cancel被置为true时尽快停下并返回false。profile不为nullptr时统计光线数、求交测试数、每个像素的开销和每块的耗时。
+// context必须按tracer的设置创建。frame通常是整幅图像；只画图像的一部分时（分带渲染、分布式渲染的worker），
+// context.tiles换成这部分的块，frame只需要覆盖这些块
+template<class OnPassFn>
+bool RenderFrame(RenderContext &context, const Tracer &tracer, FrameBuffer &frame, const std::atomic<bool> &cancel,
+                 RenderStats &stats, OnPassFn onPass, TraceProfile *profile = nullptr) {
+    const Scene &scene = tracer.getScene();
+    const RenderSettings &settings = tracer.getSettings();
+    int width = context.width, height = context.height;
+    PersProjInfo projection = {CameraFOV, float(width), float(height), epsilon, INFINITY};
+    Camera camera(scene.camera, scene.cameraYaw, scene.cameraPitch, projection);
+
+    // 光线追踪开始，分块多线程进行光线追踪
+    auto begin = std::chrono::steady_clock::now();
+    ThreadPool &pool = context.pool;
+    const std::vector<Tile> &tiles = context.tiles;
+    std::vector<Wavefront> &wavefronts = context.wavefronts;
+    auto pixelDir = [&](double px, double py) { return camera.pixelDir(px, py); };
+    std::atomic<uint64_t> tracingAllocations(0);
+    std::atomic<uint64_t> shadowRays(0);
+    if (profile != nullptr)
+        profile->begin(width, height, tiles, settings.tileSize, pool.size());
+    TraceProfile *tileProfile = profile;        // 只统计context.tiles中的块，画frame外面一圈时为nullptr
+    auto shadeTile = [&](const Tile &tile, const Pass &pass, float *color, unsigned worker) {
+        if (cancel.load(std::memory_order_relaxed))
+            return false;
+        uint64_t allocationsBefore = ThreadAllocationCount(), shadowRaysBefore = threadShadowRays;
+        TileCost *cost = nullptr;
+        std::chrono::steady_clock::time_point tileBegin;
+        if (tileProfile != nullptr) { // 这一块的计数记到这个线程自己的计数器上
+            threadCounters = tileProfile->counters(worker);
+            cost = tileProfile->tileCost(worker);
+            tileBegin = std::chrono::steady_clock::now();
+        }
+        int tileWidth = tile.x1 - tile.x0;
+        int step = (settings.packets ? PacketWidth : 1) * pass.stride;
+        for (int by = tile.y0; by < tile.y1; by += step) {
+            for (int bx = tile.x0; bx < tile.x1; bx += step) {
+                // 一个光线束：[bx, ex) x [by, ey)中这一遍要算的像素
+                int ex = std::min(bx + step, tile.x1), ey = std::min(by + step, tile.y1);
+                Ray rays[PacketRays];
+                Hit hits[PacketRays];
+                ObjectId nearIds[PacketRays];
+                int pixels[PacketRays];
+                int count = 0;
+                for (int y = by; y < ey; y += pass.stride) {
+                    for (int x = bx; x < ex; x += pass.stride) {
+                        if (!pass.samples(x - tile.x0, y - tile.y0))
+                            continue;
+                        rays[count] = Ray(scene.camera, Normalize(pixelDir(x + 0.5, y + 0.5)));
+                        hits[count].t = INFINITY;
+                        nearIds[count] = NoObject;
+                        pixels[count++] = (y - tile.y0) * tileWidth + (x - tile.x0);
+                    }
+                }
+                uint64_t testsBefore = threadCounters != nullptr ? threadCounters->tests() : 0;
+                for (int k = 0; k < count; k++)
+                    CountRay(0);
+                if (count == 1) {
+                    scene.intersect(rays[0], hits[0], nearIds[0]);
+                } else if (count > 1) {
+                    // 视锥取光线束覆盖的像素区域的四个角，比像素中心多出半个像素，保证包住所有光线
+                    Vec3 corners[4] = {pixelDir(bx, by), pixelDir(ex, by), pixelDir(ex, ey), pixelDir(bx, ey)};
+                    Frustum frustum;
+                    frustum.build(scene.camera, corners, pixelDir((bx + ex) * 0.5, (by + ey) * 0.5));
+                    scene.intersectPacket(frustum, rays, count, hits, nearIds);
+                }
+                if (cost != nullptr && count > 0) { // 光线束求交的开销平均分给各条光线的像素
+                    uint64_t tests = threadCounters->tests() - testsBefore;
+                    for (int k = 0; k < count; k++) {
+                        cost->rays[pixels[k]]++;
+                        cost->tests[pixels[k]] += uint32_t(tests / count + (uint64_t(k) < tests % count ? 1 : 0));
+                    }
+                }
+                for (int k = 0; k < count; k++) {
+                    PixelCostScope scope(cost, pixels[k]);
+                    float *out = color + size_t(pixels[k]) * 3;
+                    if (settings.wavefront) {
+                        out[0] = out[1] = out[2] = 0;
+                        tracer.shadeWavefront(wavefronts[worker], {rays[k], Vec3(1, 1, 1), pixels[k], 0}, hits[k],
+                                              nearIds[k], color);
+                        continue;
+                    }
+                    Vec3 c = tracer.shade(rays[k], 0, hits[k], nearIds[k]);
+                    out[0] = c[0], out[1] = c[1], out[2] = c[2];
+                }
+            }
+        }
+        if (settings.wavefront) // 主光线之后的各次弹射
+            tracer.runWavefront(wavefronts[worker], color, cost);
+        if (tileProfile != nullptr) {
+            std::chrono::duration<double> tileTime = std::chrono::steady_clock::now() - tileBegin;
+            tileProfile->endTile(worker, size_t(&tile - tiles.data()), tileTime.count());
+            threadCounters = nullptr;
+        }
+        tracingAllocations += ThreadAllocationCount() - allocationsBefore;
+        shadowRays += threadShadowRays - shadowRaysBefore;
+        return true;
+    };
+    const std::vector<Pass> &passes = context.passes;
+    for (size_t i = 0; i < passes.size() && !cancel; i++) {
+        RenderTiles(pool, tiles, passes[i], frame, context.tileContexts, shadeTile);
+        if (!cancel)
+            onPass(int(i), passes[i].stride);
+    }
+    // 所有像素都画完（最后一遍步长为1）之后，先算出每个像素与邻域的颜色差，再逐块给边缘像素加采样。
+    // 颜色差要在加采样之前全部算完，否则会读到相邻块加过采样的颜色
+    std::atomic<uint64_t> aaSamples(0);
+    std::atomic<size_t> aaPixels(0);
+    auto contrastTile = [&](const Tile &tile, const Pass &, float *, unsigned) {
+        if (!cancel.load(std::memory_order_relaxed))
+            AAContrastTile(tile, frame, context.aaRegion, context.aaBorders, context.aaBorderFrames, width, height,
+                           context.aaContrast.data());
+        return false;       // 不写回frame
+    };
+    auto antialiasTile = [&](const Tile &tile, const Pass &, float *color, unsigned worker) {
+        if (cancel.load(std::memory_order_relaxed))
+            return false;
+        uint64_t allocationsBefore = ThreadAllocationCount(), shadowRaysBefore = threadShadowRays;
+        TileCost *cost = nullptr;
+        std::chrono::steady_clock::time_point tileBegin;
+        if (tileProfile != nullptr) { // 与各遍一样记到像素和块上，热力图和每块的耗时包括抗锯齿
+            threadCounters = tileProfile->counters(worker);
+            cost = tileProfile->tileCost(worker);
+            tileBegin = std::chrono::steady_clock::now();
+        }
+        size_t pixels = 0;
+        aaSamples += AntialiasTile(tracer, pixelDir, tile, frame, context.aaRegion, context.aaContrast.data(),
+                                   context.tileContexts[worker], wavefronts[worker], color, pixels, cost);
+        aaPixels += pixels;
+        if (tileProfile != nullptr) {
+            std::chrono::duration<double> tileTime = std::chrono::steady_clock::now() - tileBegin;
+            tileProfile->endTile(worker, size_t(&tile - tiles.data()), tileTime.count());
+            threadCounters = nullptr;
+        }
+        tracingAllocations += ThreadAllocationCount() - allocationsBefore;
+        shadowRays += threadShadowRays - shadowRaysBefore;
+        return true;
+    };
+    if (settings.aaMaxSamples > 1 && !passes.empty() && passes.back().stride == 1 && !cancel) {
+        // 只画图像的一部分时，这部分外面一圈像素的中心采样另外画出来，块边上的像素也能看到完整的邻域
+        Tile &region = context.aaRegion;
+        region = tiles.empty() ? Tile{0, 0, 0, 0} : tiles[0];
+        for (const Tile &t: tiles)
+            region = {std::min(region.x0, t.x0), std::min(region.y0, t.y0), std::max(region.x1, t.x1),
+                      std::max(region.y1, t.y1)};
+        int x0 = region.x0, y0 = region.y0, x1 = region.x1, y1 = region.y1;
+        int bx0 = std::max(x0 - 1, 0), by0 = std::max(y0 - 1, 0);
+        int bx1 = std::min(x1 + 1, width), by1 = std::min(y1 + 1, height);
+        Tile borders[4] = {{bx0, by0, bx1, y0}, {bx0, y1, bx1, by1}, {bx0, y0, x0, y1}, {x1, y0, bx1, y1}};
+        tileProfile = nullptr;
+        for (int i = 0; i < 4 && !cancel; i++) {
+            const Tile &b = borders[i];
+            context.aaBorders[i] = b;
+            if (b.x0 >= b.x1 || b.y0 >= b.y1)
+                continue;
+            std::unique_ptr<FrameBuffer> &border = context.aaBorderFrames[i];
+            if (!border || border->getWidth() != b.x1 - b.x0 || border->getHeight() != b.y1 - b.y0)
+                border.reset(new FrameBuffer(b.x1 - b.x0, b.y1 - b.y0));
+            border->setOrigin(b.x0, b.y0);
+            RenderTiles(pool, SplitTile(b, settings.tileSize), Pass(), *border, context.tileContexts, shadeTile);
+        }
+        tileProfile = profile;
+        context.aaContrast.resize(size_t(x1 - x0) * (y1 - y0));
+        if (!cancel)
+            RenderTiles(pool, tiles, Pass(), frame, context.tileContexts, contrastTile);
+        if (!cancel)
+            RenderTiles(pool, tiles, Pass(), frame, context.tileContexts, antialiasTile);
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    stats.threads = pool.size();
+    stats.tiles = tiles.size();
+    stats.passes = passes.size();
+    stats.shadowRays = shadowRays;
+    stats.tracingAllocations = tracingAllocations;
+    stats.aaSamples = aaSamples;
+    stats.aaPixels = aaPixels;
+    if (profile != nullptr)
+        profile->setSeconds(stats.seconds);
+    return !cancel;
+}
+
+// 按tracer的阴影设置烘焙光照图，或者在场景变化之后只更新受影响的图，返回重新烘焙的纹素数
+inline size_t BakeLightmaps(Lightmaps &lightmaps, const Tracer &tracer, ThreadPool &pool) {
+    return lightmaps.update(tracer.getScene(), tracer.getSettings(), pool, [&](const Vec3 &position, const Light &light) {
+        return tracer.lightVisibility(position, light);
+    });
+}
+
+// 只渲染一帧时临时创建渲染资源
+template<class OnPassFn>
+bool RenderFrame(const Tracer &tracer, FrameBuffer &frame, const std::atomic<bool> &cancel, RenderStats &stats,
+                 OnPassFn onPass, TraceProfile *profile = nullptr) {
+    RenderContext context(tracer.getSettings(), frame.getWidth(), frame.getHeight());
+    return RenderFrame(context, tracer, frame, cancel, stats, onPass, profile);
+}
+
+#endif //TCODE_TRACER_H
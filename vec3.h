@@ -0,0 +1,227 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_VEC3_H
+#define TCODE_VEC3_H
+
+#include <cmath>
+
+// 用GCC的向量扩展实现逐分量运算，在x86上直接编译为SSE指令，向量始终留在寄存器里；
+// 其他编译器或者定义了TCODE_VEC3_SCALAR时使用标量实现。两种实现的运算都是constexpr，结果逐位相同
+#if defined(__GNUC__) && defined(__SSE__) && !defined(TCODE_VEC3_SCALAR)
+#define TCODE_VEC3_SSE 1
+typedef float Float4 __attribute__((vector_size(16)));
+#endif
+
+// 三维向量，按值传递和返回。占16字节并按16字节对齐，第四个分量只做填充，始终为0，
+// 这样整个向量可以放进一个SSE寄存器
+struct alignas(16) Vec3 {
+#ifdef TCODE_VEC3_SSE
+    Float4 v;
+
+    explicit constexpr Vec3(Float4 m) : v(m) {}
+#else
+    float v[4];
+#endif
+
+    constexpr Vec3() : v{0, 0, 0, 0} {}
+
+    constexpr Vec3(float x, float y, float z) : v{x, y, z, 0} {}
+
+    explicit constexpr Vec3(float s) : v{s, s, s, 0} {}
+
+    explicit Vec3(const float *p) : v{p[0], p[1], p[2], 0} {}        // 从float[3]读取
+
+    constexpr float operator[](int i) const { return v[i]; }
+
+    constexpr float &operator[](int i) { return v[i]; }
+
+    const float *data() const { return reinterpret_cast<const float *>(&v); }        // 传给仍然使用float[3]的函数
+
+    constexpr float x() const { return v[0]; }
+
+    constexpr float y() const { return v[1]; }
+
+    constexpr float z() const { return v[2]; }
+};
+
+#ifdef TCODE_VEC3_SSE
+
+constexpr Vec3 operator+(const Vec3 &a, const Vec3 &b) { return Vec3(a.v + b.v); }
+
+constexpr Vec3 operator-(const Vec3 &a, const Vec3 &b) { return Vec3(a.v - b.v); }
+
+constexpr Vec3 operator*(const Vec3 &a, const Vec3 &b) { return Vec3(a.v * b.v); }
+
+constexpr Vec3 operator*(const Vec3 &a, float k) { return Vec3(a.v * k); }
+
+constexpr Vec3 operator/(const Vec3 &a, float k) { return Vec3(a.v / k); }
+
+constexpr Vec3 operator-(const Vec3 &a) { return Vec3(Float4{} - a.v); }
+
+constexpr Vec3 Min(const Vec3 &a, const Vec3 &b) { return Vec3(a.v < b.v ? a.v : b.v); }
+
+constexpr Vec3 Max(const Vec3 &a, const Vec3 &b) { return Vec3(a.v > b.v ? a.v : b.v); }
+
+#else
+
+constexpr Vec3 operator+(const Vec3 &a, const Vec3 &b) { return Vec3(a[0] + b[0], a[1] + b[1], a[2] + b[2]); }
+
+constexpr Vec3 operator-(const Vec3 &a, const Vec3 &b) { return Vec3(a[0] - b[0], a[1] - b[1], a[2] - b[2]); }
+
+constexpr Vec3 operator*(const Vec3 &a, const Vec3 &b) { return Vec3(a[0] * b[0], a[1] * b[1], a[2] * b[2]); }
+
+constexpr Vec3 operator*(const Vec3 &a, float k) { return Vec3(a[0] * k, a[1] * k, a[2] * k); }
+
+constexpr Vec3 operator/(const Vec3 &a, float k) { return Vec3(a[0] / k, a[1] / k, a[2] / k); }
+
+constexpr Vec3 operator-(const Vec3 &a) { return Vec3(0 - a[0], 0 - a[1], 0 - a[2]); }        // 与0 - a一致，不产生-0
+
+// 写成比较形式，遇到NaN时与向量实现一样返回第二个参数
+constexpr Vec3 Min(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a[0] < b[0] ? a[0] : b[0], a[1] < b[1] ? a[1] : b[1], a[2] < b[2] ? a[2] : b[2]);
+}
+
+constexpr Vec3 Max(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a[0] > b[0] ? a[0] : b[0], a[1] > b[1] ? a[1] : b[1], a[2] > b[2] ? a[2] : b[2]);
+}
+
+#endif // TCODE_VEC3_SSE
+
+// 按分量相除，分母的填充分量是0，两种实现都逐个分量计算
+constexpr Vec3 operator/(const Vec3 &a, const Vec3 &b) { return Vec3(a[0] / b[0], a[1] / b[1], a[2] / b[2]); }
+
+constexpr Vec3 operator*(float k, const Vec3 &a) { return a * k; }
+
+constexpr Vec3 &operator+=(Vec3 &a, const Vec3 &b) { return a = a + b; }
+
+constexpr Vec3 &operator-=(Vec3 &a, const Vec3 &b) { return a = a - b; }
+
+constexpr Vec3 &operator*=(Vec3 &a, const Vec3 &b) { return a = a * b; }
+
+constexpr Vec3 &operator*=(Vec3 &a, float k) { return a = a * k; }
+
+constexpr Vec3 &operator/=(Vec3 &a, float k) { return a = a / k; }
+
+constexpr bool operator==(const Vec3 &a, const Vec3 &b) { return a[0] == b[0] && a[1] == b[1] && a[2] == b[2]; }
+
+constexpr bool operator!=(const Vec3 &a, const Vec3 &b) { return !(a == b); }
+
+// 点积、叉积逐个分量计算（只有三个分量，水平求和不划算），求和顺序与DotVector3相同
+constexpr float Dot(const Vec3 &a, const Vec3 &b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+constexpr Vec3 Cross(const Vec3 &a, const Vec3 &b) {
+    return Vec3(a[1] * b[2] - b[1] * a[2], a[2] * b[0] - b[2] * a[0], a[0] * b[1] - b[0] * a[1]);
+}
+
+constexpr float LengthSquared(const Vec3 &a) { return Dot(a, a); }
+
+inline float Length(const Vec3 &a) { return sqrtf(LengthSquared(a)); }
+
+inline Vec3 Normalize(const Vec3 &a) { return a * (1.0f / Length(a)); }
+
+inline bool IsFinite(const Vec3 &a) { return std::isfinite(a[0]) && std::isfinite(a[1]) && std::isfinite(a[2]); }
+
+// 四维向量（齐次坐标、四元数），同样16字节对齐
+struct alignas(16) Vec4 {
+    float v[4];
+
+    constexpr Vec4() : v{0, 0, 0, 0} {}
+
+    constexpr Vec4(float x, float y, float z, float w) : v{x, y, z, w} {}
+
+    constexpr Vec4(const Vec3 &a, float w) : v{a[0], a[1], a[2], w} {}
+
+    constexpr float operator[](int i) const { return v[i]; }
+
+    constexpr float &operator[](int i) { return v[i]; }
+
+    constexpr Vec3 xyz() const { return Vec3(v[0], v[1], v[2]); }
+};
+
+constexpr Vec4 operator+(const Vec4 &a, const Vec4 &b) { return Vec4(a[0] + b[0], a[1] + b[1], a[2] + b[2], a[3] + b[3]); }
+
+constexpr Vec4 operator-(const Vec4 &a, const Vec4 &b) { return Vec4(a[0] - b[0], a[1] - b[1], a[2] - b[2], a[3] - b[3]); }
+
+constexpr Vec4 operator*(const Vec4 &a, float k) { return Vec4(a[0] * k, a[1] * k, a[2] * k, a[3] * k); }
+
+constexpr float Dot(const Vec4 &a, const Vec4 &b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; }
+
+// 8个float，Vec3x8逐通道运算的结果
+struct alignas(32) Float8 {
+    float v[8];
+
+    float operator[](int i) const { return v[i]; }
+
+    float &operator[](int i) { return v[i]; }
+};
+
+// 8个三维向量，x、y、z分别连续存放（SoA），用于一次处理多条光线的批量核。
+// 逐通道的循环长度固定为8，编译器可以直接向量化
+struct alignas(32) Vec3x8 {
+    float x[8], y[8], z[8];
+
+    static Vec3x8 Load(const float *px, const float *py, const float *pz) {
+        Vec3x8 r;
+        for (int i = 0; i < 8; i++) {
+            r.x[i] = px[i];
+            r.y[i] = py[i];
+            r.z[i] = pz[i];
+        }
+        return r;
+    }
+
+    // 只写回前n个通道
+    void store(float *px, float *py, float *pz, int n = 8) const {
+        for (int i = 0; i < n; i++) {
+            px[i] = x[i];
+            py[i] = y[i];
+            pz[i] = z[i];
+        }
+    }
+
+    void set(int lane, const Vec3 &a) {
+        x[lane] = a[0];
+        y[lane] = a[1];
+        z[lane] = a[2];
+    }
+
+    Vec3 get(int lane) const { return Vec3(x[lane], y[lane], z[lane]); }
+};
+
+inline Vec3x8 operator-(const Vec3x8 &a, const Vec3 &b) {        // 每个通道减去同一个向量
+    Vec3x8 r;
+    for (int i = 0; i < 8; i++) {
+        r.x[i] = a.x[i] - b[0];
+        r.y[i] = a.y[i] - b[1];
+        r.z[i] = a.z[i] - b[2];
+    }
+    return r;
+}
+
+inline Vec3x8 operator/(const Vec3x8 &a, const Float8 &k) {        // 每个通道除以各自的数
+    Vec3x8 r;
+    for (int i = 0; i < 8; i++) {
+        r.x[i] = a.x[i] / k.v[i];
+        r.y[i] = a.y[i] / k.v[i];
+        r.z[i] = a.z[i] / k.v[i];
+    }
+    return r;
+}
+
+inline Float8 Dot(const Vec3x8 &a, const Vec3 &b) {
+    Float8 r;
+    for (int i = 0; i < 8; i++)
+        r.v[i] = a.x[i] * b[0] + a.y[i] * b[1] + a.z[i] * b[2];
+    return r;
+}
+
+inline Float8 Length(const Vec3x8 &a) {
+    Float8 r;
+    for (int i = 0; i < 8; i++)
+        r.v[i] = sqrtf(a.x[i] * a.x[i] + a.y[i] * a.y[i] + a.z[i] * a.z[i]);
+    return r;
+}
+
+#endif //TCODE_VEC3_H
@@ -0,0 +1,98 @@
+//
+// Created by gdfwj on 2026/10/17.
+//
+
+#ifndef TCODE_WAVEFRONT_H
+#define TCODE_WAVEFRONT_H
+
+#include <utility>
+#include <vector>
+#include "objects.h"
+#include "object_store.h"
+
+struct WavefrontRay {
+    Ray ray;
+    Vec3 weight;        // 这条光线的颜色对像素的贡献（沿路径累乘的反射/折射比例）
+    int pixel;          // 所属像素，由调用者解释
+    int depth;          // 弹射次数
+};
+
+// 波前（流式）追踪：同一次弹射的光线放在一个队列里，先按方向分组成批求交，再按材质分组着色，
+// 着色时产生的下一次弹射的光线带着权重放进下一个队列，直到队列为空。没有递归，栈深度固定。
+// 队列容量在渲染前预留好，追踪时不分配内存
+class Wavefront {
+public:
+    void reserve(int capacity) {
+        current.resize(capacity);
+        next.resize(capacity);
+        hits.resize(capacity);
+        ids.resize(capacity);
+        keys.resize(capacity);
+        order.resize(capacity);
+    }
+
+    int capacity() const { return int(next.size()); }
+
+    // 把光线放进下一次弹射的队列，队列已满时返回false，由调用者自己追踪这条光线
+    bool emit(const Ray &ray, const Vec3 &weight, int pixel, int depth) {
+        if (nextCount == capacity())
+            return false;
+        next[nextCount++] = {ray, weight, pixel, depth};
+        return true;
+    }
+
+    // 逐次弹射处理队列中的光线。intersect(wavefrontRay, hit, id)求最近交点（hit.t已设为INFINITY），
+    // shade(wavefrontRay, hit, id)计算颜色，需要继续追踪的光线通过emit放进下一个队列
+    template<class IntersectFn, class ShadeFn>
+    void run(IntersectFn intersect, ShadeFn shade) {
+        while (nextCount > 0) {
+            std::swap(current, next);
+            int count = nextCount;
+            nextCount = 0;
+            // 方向在同一个卦限的光线访问的BVH结点相近，放在一起求交
+            for (int i = 0; i < count; i++) {
+                const Vec3 &d = current[i].ray.dir;
+                keys[i] = (d[0] < 0 ? 1 : 0) | (d[1] < 0 ? 2 : 0) | (d[2] < 0 ? 4 : 0);
+            }
+            sortByKey(count, 8);
+            for (int k = 0; k < count; k++) {
+                int i = order[k];
+                hits[i].t = INFINITY;
+                ids[i] = NoObject;
+                intersect(current[i], hits[i], ids[i]);
+            }
+            // 按交点的材质分组着色：没有交点的在最前，其次粗糙、反射、折射
+            for (int i = 0; i < count; i++)
+                keys[i] = ids[i] == NoObject ? 0 : 1 + int(hits[i].material->type);
+            sortByKey(count, 4);
+            for (int k = 0; k < count; k++) {
+                int i = order[k];
+                shade(current[i], hits[i], ids[i]);
+            }
+        }
+    }
+
+private:
+    std::vector<WavefrontRay> current, next;
+    std::vector<Hit> hits;
+    std::vector<ObjectId> ids;
+    std::vector<unsigned char> keys;
+    std::vector<int> order;
+    int nextCount = 0;
+
+    // 按keys对前count条光线做计数排序（稳定），结果是order中的下标序列
+    void sortByKey(int count, int keyCount) {
+        int start[8] = {0};
+        for (int i = 0; i < count; i++)
+            start[keys[i]]++;
+        for (int k = 0, sum = 0; k < keyCount; k++) {
+            int n = start[k];
+            start[k] = sum;
+            sum += n;
+        }
+        for (int i = 0; i < count; i++)
+            order[start[keys[i]]++] = i;
+    }
+};
+
+#endif //TCODE_WAVEFRONT_H